@@ -48,6 +48,9 @@
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
 
+/* Most sectors one READ or WRITE SECTOR command can transfer. */
+#define MAX_SECTORS_PER_COMMAND 256
+
 /* An ATA device. */
 struct disk {
 	char name[8];               /* Name, e.g. "hd0:1". */
@@ -84,7 +87,7 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -209,47 +212,95 @@ disk_size (struct disk *d) {
    per-disk locking is unneeded. */
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
+	disk_readv (d, sec_no, &buffer, 1);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   DISK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
+	disk_writev (d, sec_no, &buffer, 1);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D, sector
+   SEC_NO + I into BUFFERS[I], which must have room for
+   DISK_SECTOR_SIZE bytes.  Issues one command for up to 256
+   sectors, instead of one per sector as a loop over disk_read()
+   would, and keeps the channel for the whole transfer. */
+void
+disk_readv (struct disk *d, disk_sector_t sec_no, void *const buffers[],
+		size_t cnt) {
 	struct channel *c;
 
 	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
+	ASSERT (buffers != NULL);
 
 	c = d->channel;
 	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-	sema_down (&c->completion_wait);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-	input_sector (c, buffer);
-	d->read_cnt++;
+	while (cnt > 0) {
+		size_t n = cnt < MAX_SECTORS_PER_COMMAND ? cnt : MAX_SECTORS_PER_COMMAND;
+		size_t i;
+
+		select_sector (d, sec_no, n);
+		issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+		for (i = 0; i < n; i++) {
+			/* The disk interrupts once for each sector it has
+			   ready. */
+			sema_down (&c->completion_wait);
+			if (!wait_while_busy (d))
+				PANIC ("%s: disk read failed, sector=%"PRDSNu,
+						d->name, sec_no + (disk_sector_t) i);
+			input_sector (c, buffers[i]);
+		}
+		d->read_cnt += n;
+		sec_no += n;
+		buffers += n;
+		cnt -= n;
+	}
 	lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
+/* Writes the CNT sectors starting at SEC_NO to disk D, sector
+   SEC_NO + I from BUFFERS[I], which must contain
    DISK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+   acknowledged receiving all the data.  Like disk_readv(), uses
+   one command for up to 256 sectors. */
 void
-disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
+disk_writev (struct disk *d, disk_sector_t sec_no,
+		const void *const buffers[], size_t cnt) {
 	struct channel *c;
 
 	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
+	ASSERT (buffers != NULL);
 
 	c = d->channel;
 	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-	output_sector (c, buffer);
-	sema_down (&c->completion_wait);
-	d->write_cnt++;
+	while (cnt > 0) {
+		size_t n = cnt < MAX_SECTORS_PER_COMMAND ? cnt : MAX_SECTORS_PER_COMMAND;
+		size_t i;
+
+		select_sector (d, sec_no, n);
+		issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+		for (i = 0; i < n; i++) {
+			/* The disk interrupts once it has taken each
+			   sector. */
+			if (!wait_while_busy (d))
+				PANIC ("%s: disk write failed, sector=%"PRDSNu,
+						d->name, sec_no + (disk_sector_t) i);
+			output_sector (c, buffers[i]);
+			sema_down (&c->completion_wait);
+		}
+		d->write_cnt += n;
+		sec_no += n;
+		buffers += n;
+		cnt -= n;
+	}
 	lock_release (&c->lock);
 }
-
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
@@ -402,17 +453,18 @@ print_ata_string (char *string, size_t size) {
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT, the number of sectors to transfer, to
+   the disk's sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) {
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
-	ASSERT (sec_no < d->capacity);
-	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt >= 1 && cnt <= MAX_SECTORS_PER_COMMAND);
+	ASSERT (sec_no + cnt <= d->capacity);
+	ASSERT (sec_no + cnt <= (1UL << 28));
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt);        /* 0 means 256. */
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
@@ -122,6 +122,39 @@ serial_putc (uint8_t byte) {
 	intr_set_level (old_level);
 }
 
+/* Sends the N bytes in BUFFER to the serial port.  Equivalent to
+   calling serial_putc() on each byte, but disables interrupts and
+   updates the interrupt enable register only once for the whole
+   buffer. */
+void
+serial_puts (const char *buffer, size_t n) {
+	enum intr_level old_level = intr_disable ();
+
+	if (mode != QUEUE) {
+		if (mode == UNINIT)
+			init_poll ();
+		while (n-- > 0)
+			putc_poll (*buffer++);
+	} else {
+		while (n-- > 0) {
+			if (intq_full (&txq)) {
+				/* As in serial_putc(), poll out a byte if we can't
+				   wait.  Otherwise intq_putc() will sleep until the
+				   interrupt handler drains the queue, so make sure
+				   the transmit interrupt is enabled first. */
+				if (old_level == INTR_OFF)
+					putc_poll (intq_getc (&txq));
+				else
+					write_ier ();
+			}
+			intq_putc (&txq, *buffer++);
+		}
+		write_ier ();
+	}
+
+	intr_set_level (old_level);
+}
+
 /* Flushes anything in the serial buffer out the port in polling
    mode. */
 void
@@ -25,6 +25,7 @@ static size_t cx, cy;
    The attribute at (x,y) is fb[y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
+static void putc_no_cursor (int c);
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
@@ -52,7 +53,31 @@ vga_putc (int c) {
 	enum intr_level old_level = intr_disable ();
 
 	init ();
+	putc_no_cursor (c);
+	move_cursor ();
+
+	intr_set_level (old_level);
+}
+
+/* Writes the N characters in BUFFER to the VGA text display, as
+   vga_putc() would, but with interrupts disabled only once and
+   with a single hardware cursor update at the end. */
+void
+vga_puts (const char *buffer, size_t n) {
+	enum intr_level old_level = intr_disable ();
+
+	init ();
+	while (n-- > 0)
+		putc_no_cursor (*buffer++);
+	move_cursor ();
 
+	intr_set_level (old_level);
+}
+
+/* Writes C to the framebuffer, interpreting control characters,
+   without moving the hardware cursor. */
+static void
+putc_no_cursor (int c) {
 	switch (c) {
 		case '\n':
 			newline ();
@@ -84,11 +109,6 @@ vga_putc (int c) {
 				newline ();
 			break;
 	}
-
-	/* Update cursor position. */
-	move_cursor ();
-
-	intr_set_level (old_level);
 }
 
 /* Clears the screen and moves the cursor to the upper left. */
@@ -86,6 +86,19 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
 	return inode_read_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Reads SIZE bytes from FILE, starting at offset FILE_OFS, which
+ * must be a multiple of DISK_SECTOR_SIZE, into the CNT pages in
+ * PAGES, filling one before going on to the next, and zeroes the
+ * rest of the pages.  See inode_read_pages().
+ * Returns the number of bytes actually read,
+ * which may be less than SIZE if end of file is reached.
+ * The file's current position is unaffected. */
+off_t
+file_read_pages (struct file *file, void *const pages[], size_t cnt,
+		off_t size, off_t file_ofs) {
+	return inode_read_pages (file->inode, pages, cnt, size, file_ofs);
+}
+
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at the file's current position.
  * Returns the number of bytes actually written,
@@ -113,6 +126,19 @@ file_write_at (struct file *file, const void *buffer, off_t size,
 	return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Writes SIZE bytes to FILE, starting at offset FILE_OFS, which
+ * must be a multiple of DISK_SECTOR_SIZE, from the CNT pages in
+ * PAGES, taking PGSIZE bytes from one before going on to the
+ * next.  See inode_write_pages().
+ * Returns the number of bytes actually written,
+ * which may be less than SIZE if end of file is reached.
+ * The file's current position is unaffected. */
+off_t
+file_write_pages (struct file *file, void *const pages[], size_t cnt,
+		off_t size, off_t file_ofs) {
+	return inode_write_pages (file->inode, pages, cnt, size, file_ofs);
+}
+
 /* Prevents write operations on FILE's underlying inode
  * until file_allow_write() is called or FILE is closed. */
 void
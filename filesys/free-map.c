@@ -4,6 +4,7 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/malloc.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
@@ -11,9 +12,17 @@ static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
 /* Initializes the free map. */
 void
 free_map_init (void) {
+	size_t sum_size;
+	void *sum;
+
 	free_map = bitmap_create (disk_size (filesys_disk));
 	if (free_map == NULL)
 		PANIC ("bitmap creation failed--disk is too large");
+	sum_size = bitmap_summary_buf_size (disk_size (filesys_disk));
+	sum = malloc (sum_size);
+	if (sum == NULL)
+		PANIC ("bitmap creation failed--disk is too large");
+	bitmap_enable_summary (free_map, sum, sum_size);
 	bitmap_mark (free_map, FREE_MAP_SECTOR);
 	bitmap_mark (free_map, ROOT_DIR_SECTOR);
 }
@@ -6,6 +6,7 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/vaddr.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -225,6 +226,61 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	return bytes_read;
 }
 
+/* Reads SIZE bytes from INODE, starting at OFFSET, which must be
+ * a multiple of DISK_SECTOR_SIZE, into the CNT pages in PAGES,
+ * PGSIZE bytes into each in turn, and zeroes the rest of the
+ * pages.  Unlike inode_read_at(), reads whole sectors straight
+ * into the pages, each run of sectors that are adjacent on disk
+ * in one disk command.
+ * Returns the number of bytes actually read, which may be less
+ * than SIZE if end of file is reached. */
+off_t
+inode_read_pages (struct inode *inode, void *const pages[], size_t cnt,
+		off_t size, off_t offset) {
+	enum { SECTORS_PER_PAGE = PGSIZE / DISK_SECTOR_SIZE };
+	void *buffers[8 * SECTORS_PER_PAGE];
+	size_t sector_cnt, done, i;
+
+	ASSERT (offset % DISK_SECTOR_SIZE == 0);
+	ASSERT ((size_t) size <= cnt * PGSIZE);
+
+	if (size > inode_length (inode) - offset)
+		size = offset < inode_length (inode) ? inode_length (inode) - offset : 0;
+
+	/* Read up to eight pages' worth of sectors at a time, looking
+	 * up each sector so as not to assume that the file is
+	 * contiguous on disk. */
+	sector_cnt = bytes_to_sectors (size);
+	for (done = 0; done < sector_cnt; done += i) {
+		disk_sector_t first = byte_to_sector (inode,
+				offset + done * DISK_SECTOR_SIZE);
+
+		for (i = 0; i < sizeof buffers / sizeof *buffers
+				&& done + i < sector_cnt; i++) {
+			size_t sector = done + i;
+
+			if (i > 0 && byte_to_sector (inode, offset
+						+ sector * DISK_SECTOR_SIZE) != first + i)
+				break;
+			buffers[i] = (uint8_t *) pages[sector / SECTORS_PER_PAGE]
+				+ sector % SECTORS_PER_PAGE * DISK_SECTOR_SIZE;
+		}
+		disk_readv (filesys_disk, first, buffers, i);
+	}
+
+	/* Zero everything past the data, including the part of the
+	 * last sector that is past it. */
+	for (i = 0; i < cnt; i++) {
+		off_t page_ofs = i * PGSIZE;
+
+		if (page_ofs + PGSIZE > size) {
+			off_t start = size > page_ofs ? size - page_ofs : 0;
+			memset ((uint8_t *) pages[i] + start, 0, PGSIZE - start);
+		}
+	}
+	return size;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
  * Returns the number of bytes actually written, which may be
  * less than SIZE if end of file is reached or an error occurs.
@@ -287,6 +343,62 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 	return bytes_written;
 }
 
+/* Writes SIZE bytes into INODE, starting at OFFSET, which must
+ * be a multiple of DISK_SECTOR_SIZE, from the CNT pages in PAGES,
+ * PGSIZE bytes from each in turn.  Unlike inode_write_at(),
+ * writes whole sectors straight from the pages, each run of
+ * sectors that are adjacent on disk in one disk command.
+ * Returns the number of bytes actually written, which may be
+ * less than SIZE if end of file is reached or writes are
+ * denied. */
+off_t
+inode_write_pages (struct inode *inode, void *const pages[], size_t cnt,
+		off_t size, off_t offset) {
+	enum { SECTORS_PER_PAGE = PGSIZE / DISK_SECTOR_SIZE };
+	const void *buffers[8 * SECTORS_PER_PAGE];
+	size_t sector_cnt, done, i;
+	off_t tail;
+
+	ASSERT (offset % DISK_SECTOR_SIZE == 0);
+	ASSERT ((size_t) size <= cnt * PGSIZE);
+
+	if (inode->deny_write_cnt)
+		return 0;
+	if (size > inode_length (inode) - offset)
+		size = offset < inode_length (inode) ? inode_length (inode) - offset : 0;
+
+	/* Write up to eight pages' worth of whole sectors at a time,
+	 * looking up each sector as inode_read_pages() does. */
+	sector_cnt = size / DISK_SECTOR_SIZE;
+	for (done = 0; done < sector_cnt; done += i) {
+		disk_sector_t first = byte_to_sector (inode,
+				offset + done * DISK_SECTOR_SIZE);
+
+		for (i = 0; i < sizeof buffers / sizeof *buffers
+				&& done + i < sector_cnt; i++) {
+			size_t sector = done + i;
+
+			if (i > 0 && byte_to_sector (inode, offset
+						+ sector * DISK_SECTOR_SIZE) != first + i)
+				break;
+			buffers[i] = (const uint8_t *) pages[sector / SECTORS_PER_PAGE]
+				+ sector % SECTORS_PER_PAGE * DISK_SECTOR_SIZE;
+		}
+		disk_writev (filesys_disk, first, buffers, i);
+	}
+
+	/* Write a partial last sector through inode_write_at(), which
+	 * keeps the rest of the sector. */
+	tail = size % DISK_SECTOR_SIZE;
+	if (tail > 0) {
+		off_t pos = size - tail;
+
+		inode_write_at (inode, (uint8_t *) pages[pos / PGSIZE] + pos % PGSIZE,
+				tail, offset + pos);
+	}
+	return size;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 	void
@@ -11,6 +11,8 @@
 struct bitmap *bitmap_create (size_t bit_cnt);
 struct bitmap *bitmap_create_in_buf (size_t bit_cnt, void *, size_t byte_cnt);
 size_t bitmap_buf_size (size_t bit_cnt);
+size_t bitmap_summary_buf_size (size_t bit_cnt);
+void bitmap_enable_summary (struct bitmap *, void *, size_t byte_cnt);
 void bitmap_destroy (struct bitmap *);
 
 /* Bitmap size. */
@@ -35,6 +37,8 @@ bool bitmap_all (const struct bitmap *, size_t start, size_t cnt);
 /* Finding set or unset bits. */
 #define BITMAP_ERROR SIZE_MAX
 size_t bitmap_scan (const struct bitmap *, size_t start, size_t cnt, bool);
+size_t bitmap_scan_from_hint (const struct bitmap *, size_t hint, size_t cnt,
+		bool);
 size_t bitmap_scan_and_flip (struct bitmap *, size_t start, size_t cnt, bool);
 
 /* File input and output. */
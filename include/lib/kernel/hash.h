@@ -54,11 +54,19 @@ typedef bool hash_less_func (const struct hash_elem *a,
  * data AUX. */
 typedef void hash_action_func (struct hash_elem *e, void *aux);
 
-/* Hash table. */
+/* Hash table.
+ *
+ * While the table is being resized, the elements are spread
+ * over two bucket arrays: OLD_BUCKETS, which is emptied a few
+ * buckets at a time by each insertion or deletion, and the new
+ * BUCKETS.  See rehash() in hash.c. */
 struct hash {
 	size_t elem_cnt;            /* Number of elements in table. */
 	size_t bucket_cnt;          /* Number of buckets, a power of 2. */
 	struct list *buckets;       /* Array of `bucket_cnt' lists. */
+	size_t old_bucket_cnt;      /* Number of old buckets, a power of 2. */
+	struct list *old_buckets;   /* Buckets being emptied, or null. */
+	size_t migrate_idx;         /* Next old bucket to empty. */
 	hash_hash_func *hash;       /* Hash function. */
 	hash_less_func *less;       /* Comparison function. */
 	void *aux;                  /* Auxiliary data for `hash' and `less'. */
@@ -96,5 +104,6 @@ bool hash_empty (struct hash *);
 uint64_t hash_bytes (const void *, size_t);
 uint64_t hash_string (const char *);
 uint64_t hash_int (int);
+uint64_t hash_ptr (const void *);
 
 #endif /* lib/kernel/hash.h */
@@ -0,0 +1,41 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+/* LZ compression.
+ *
+ * A byte-oriented LZ77 codec in the style of LZ4, meant for
+ * compressing memory pages quickly rather than tightly.  The
+ * compressor finds matches through a small hash table of
+ * recent positions, which the caller supplies as a work area of
+ * LZ_WORK_SIZE bytes, so that neither function allocates memory
+ * or needs much stack.
+ *
+ * The compressed data is a series of sequences, each a token
+ * byte whose high and low nibbles give the number of literal
+ * bytes and the length of the match less LZ_MIN_MATCH, with 15
+ * meaning that more length bytes follow; then any more literal
+ * length bytes, the literals, a two-byte little-endian match
+ * offset, and any more match length bytes.  The last sequence
+ * stops after its literals. */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Shortest match encoded as one. */
+#define LZ_MIN_MATCH 4
+
+/* Size of the work area that lz_compress() needs. */
+#define LZ_WORK_SIZE 4096
+
+/* Largest input that lz_compress() accepts. */
+#define LZ_MAX_SIZE 65536
+
+/* Largest output of lz_compress() for SIZE bytes of input. */
+#define LZ_BOUND(SIZE) ((SIZE) + (SIZE) / 255 + 16)
+
+size_t lz_compress (const void *src, size_t size, void *dst, size_t dst_size,
+		void *work);
+bool lz_decompress (const void *src, size_t size, void *dst,
+		size_t dst_size);
+
+#endif /* lib/kernel/lz.h */
@@ -0,0 +1,85 @@
+#ifndef __LIB_KERNEL_PHEAP_H
+#define __LIB_KERNEL_PHEAP_H
+
+/* Pairing heap.
+ *
+ * A priority queue: the least element, according to a LESS
+ * function, can be found in O(1) time and removed in O(lg n)
+ * amortized time, and elements can be inserted, merged, and
+ * moved forward after their keys decrease in O(1) time.  For a
+ * queue that yields the greatest element first, such as a ready
+ * queue ordered by priority, pass a LESS function that returns
+ * true if A is greater than B.
+ *
+ * Like struct list, the heap does not allocate memory.  Each
+ * structure that can be in a heap embeds a struct pheap_elem
+ * member, and pheap_entry converts from a struct pheap_elem back
+ * to the structure that contains it:
+ *
+ * struct foo {
+ *   struct pheap_elem elem;
+ *   int64_t wakeup;
+ * };
+ *
+ * struct pheap sleepers;
+ * pheap_init (&sleepers, wakeup_less, NULL);
+ * pheap_push (&sleepers, &f->elem);
+ * ...
+ * while (!pheap_empty (&sleepers)
+ *        && pheap_entry (pheap_min (&sleepers), struct foo,
+ *                        elem)->wakeup <= now)
+ *   wake (pheap_entry (pheap_pop_min (&sleepers), struct foo, elem));
+ *
+ * Equal elements come out in no particular order. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Pairing heap element.  The heap is a tree in which each
+ * element is no greater than its children.  Each element's
+ * children form a doubly linked list through NEXT and PREV, where
+ * the first child's PREV points to the parent. */
+struct pheap_elem {
+	struct pheap_elem *child;   /* First child, or null. */
+	struct pheap_elem *next;    /* Next sibling, or null. */
+	struct pheap_elem *prev;    /* Previous sibling or parent, or null. */
+};
+
+/* Converts pointer to heap element PHEAP_ELEM into a pointer to
+ * the structure that PHEAP_ELEM is embedded inside.  Supply the
+ * name of the outer structure STRUCT and the member name MEMBER
+ * of the heap element. */
+#define pheap_entry(PHEAP_ELEM, STRUCT, MEMBER)         \
+	((STRUCT *) ((uint8_t *) &(PHEAP_ELEM)->child   \
+		- offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B. */
+typedef bool pheap_less_func (const struct pheap_elem *a,
+		const struct pheap_elem *b, void *aux);
+
+/* Pairing heap. */
+struct pheap {
+	struct pheap_elem *root;    /* Least element, or null if empty. */
+	size_t size;                /* Number of elements. */
+	pheap_less_func *less;      /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+void pheap_init (struct pheap *, pheap_less_func *, void *aux);
+
+/* Insertion and removal. */
+void pheap_push (struct pheap *, struct pheap_elem *);
+struct pheap_elem *pheap_pop_min (struct pheap *);
+void pheap_remove (struct pheap *, struct pheap_elem *);
+void pheap_decrease (struct pheap *, struct pheap_elem *);
+void pheap_merge (struct pheap *, struct pheap *);
+
+/* Properties. */
+struct pheap_elem *pheap_min (const struct pheap *);
+size_t pheap_size (const struct pheap *);
+bool pheap_empty (const struct pheap *);
+
+#endif /* lib/kernel/pheap.h */
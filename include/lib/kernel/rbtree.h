@@ -0,0 +1,147 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+ *
+ * A balanced binary search tree that keeps its elements sorted,
+ * so that insertion, removal, lookup, and finding the minimum or
+ * maximum all take O(lg n) time, where list_insert_ordered() and
+ * list_max() take O(n).
+ *
+ * Like struct list, the tree does not allocate memory.  Each
+ * structure that can be in a tree embeds a struct rb_elem member,
+ * and rb_entry converts from a struct rb_elem back to the
+ * structure that contains it:
+ *
+ * struct foo {
+ *   struct rb_elem elem;
+ *   int key;
+ * };
+ *
+ * static bool
+ * foo_less (const struct rb_elem *a, const struct rb_elem *b,
+ *           void *aux) {
+ *   return rb_entry (a, struct foo, elem)->key
+ *          < rb_entry (b, struct foo, elem)->key;
+ * }
+ *
+ * struct rb_tree foo_tree;
+ * struct rb_elem *e;
+ *
+ * rb_init (&foo_tree, foo_less, NULL);
+ * ...
+ * for (e = rb_min (&foo_tree); e != NULL; e = rb_next (e)) {
+ *   struct foo *f = rb_entry (e, struct foo, elem);
+ *   ...do something with f...
+ * }
+ *
+ * Equal elements are allowed; an element is inserted after any
+ * equal elements already in the tree.
+ *
+ * A tree can also be augmented with a value computed for each
+ * element from the element and its two subtrees, such as the
+ * largest key in the subtree.  The tree calls an AUGMENT function
+ * to recompute the value of each element whose subtree changed.
+ * The interval tree below is built this way. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Red-black tree element. */
+struct rb_elem {
+	struct rb_elem *parent;     /* Parent, or null for the root. */
+	struct rb_elem *left;       /* Left child, or null. */
+	struct rb_elem *right;      /* Right child, or null. */
+	bool red;                   /* Red or black? */
+};
+
+/* Converts pointer to tree element RB_ELEM into a pointer to the
+ * structure that RB_ELEM is embedded inside.  Supply the name of
+ * the outer structure STRUCT and the member name MEMBER of the
+ * tree element. */
+#define rb_entry(RB_ELEM, STRUCT, MEMBER)               \
+	((STRUCT *) ((uint8_t *) &(RB_ELEM)->parent     \
+		- offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_elem *a,
+		const struct rb_elem *b, void *aux);
+
+/* Recomputes the augmented value of E from E itself and its
+ * children, whose values are up to date. */
+typedef void rb_augment_func (struct rb_elem *e);
+
+/* Red-black tree. */
+struct rb_tree {
+	struct rb_elem *root;       /* Root, or null if empty. */
+	size_t size;                /* Number of elements. */
+	rb_less_func *less;         /* Comparison function. */
+	rb_augment_func *augment;   /* Augmentation function, or null. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+void rb_init (struct rb_tree *, rb_less_func *, void *aux);
+void rb_init_augmented (struct rb_tree *, rb_less_func *,
+		rb_augment_func *, void *aux);
+
+/* Insertion and removal. */
+void rb_insert (struct rb_tree *, struct rb_elem *);
+void rb_remove (struct rb_tree *, struct rb_elem *);
+
+/* Lookup. */
+struct rb_elem *rb_find (const struct rb_tree *, const struct rb_elem *key);
+struct rb_elem *rb_lower_bound (const struct rb_tree *,
+		const struct rb_elem *key);
+struct rb_elem *rb_upper_bound (const struct rb_tree *,
+		const struct rb_elem *key);
+
+/* Traversal. */
+struct rb_elem *rb_min (const struct rb_tree *);
+struct rb_elem *rb_max (const struct rb_tree *);
+struct rb_elem *rb_next (const struct rb_elem *);
+struct rb_elem *rb_prev (const struct rb_elem *);
+
+/* Properties. */
+size_t rb_size (const struct rb_tree *);
+bool rb_empty (const struct rb_tree *);
+
+/* Interval tree.
+ *
+ * A red-black tree of half-open intervals [START, END), sorted
+ * by START and augmented with the largest END in each subtree,
+ * which lets it find the intervals that overlap a given range in
+ * O(lg n) time per interval found.  Suited, for example, to
+ * finding the mapped regions of an address space that overlap a
+ * new mapping. */
+
+/* Interval tree element. */
+struct interval_elem {
+	struct rb_elem rb_elem;     /* Red-black tree element. */
+	uint64_t start;             /* First value in the interval. */
+	uint64_t end;               /* One past the last value. */
+	uint64_t max_end;           /* Largest END in this subtree. */
+};
+
+/* Converts pointer to interval element INTERVAL_ELEM into a
+ * pointer to the structure that it is embedded inside. */
+#define interval_entry(INTERVAL_ELEM, STRUCT, MEMBER)           \
+	((STRUCT *) ((uint8_t *) &(INTERVAL_ELEM)->start        \
+		- offsetof (STRUCT, MEMBER.start)))
+
+/* Interval tree. */
+struct interval_tree {
+	struct rb_tree tree;
+};
+
+void interval_tree_init (struct interval_tree *);
+void interval_tree_insert (struct interval_tree *, struct interval_elem *);
+void interval_tree_remove (struct interval_tree *, struct interval_elem *);
+struct interval_elem *interval_tree_first (struct interval_tree *,
+		uint64_t start, uint64_t end);
+struct interval_elem *interval_tree_next (struct interval_elem *,
+		uint64_t start, uint64_t end);
+
+#endif /* lib/kernel/rbtree.h */
@@ -0,0 +1,105 @@
+#ifndef __LIB_KERNEL_RHASH_H
+#define __LIB_KERNEL_RHASH_H
+
+/* Open-addressing hash table.
+ *
+ * This is a drop-in alternative to the chained hash table in
+ * hash.h for tables on hot paths.  It has the same interface,
+ * with `rhash' in place of `hash', but stores the table in a
+ * single array of slots instead of an array of linked lists, so
+ * a lookup usually touches one or two cache lines instead of
+ * chasing a list pointer per element.
+ *
+ * Collisions are resolved by linear probing with Robin Hood
+ * insertion: an element that has probed further from its home
+ * slot displaces one that has probed less, so that probe
+ * sequences stay short and uniform even at high load.  Each slot
+ * also keeps a fingerprint of its element's hash value, so that
+ * the comparison function is called almost only for elements
+ * that are actually equal.
+ *
+ * As with hash.h, elements are not copied into the table.  Each
+ * structure that can be in an rhash must embed a struct
+ * rhash_elem member, and rhash_entry converts back from a struct
+ * rhash_elem to the structure that contains it. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Hash element. */
+struct rhash_elem {
+	uint64_t hash;              /* Hash value, cached for resizing. */
+};
+
+/* Converts pointer to hash element RHASH_ELEM into a pointer to
+ * the structure that RHASH_ELEM is embedded inside.  Supply the
+ * name of the outer structure STRUCT and the member name MEMBER
+ * of the hash element. */
+#define rhash_entry(RHASH_ELEM, STRUCT, MEMBER)                 \
+	((STRUCT *) ((uint8_t *) &(RHASH_ELEM)->hash            \
+		- offsetof (STRUCT, MEMBER.hash)))
+
+/* Computes and returns the hash value for hash element E, given
+ * auxiliary data AUX. */
+typedef uint64_t rhash_hash_func (const struct rhash_elem *e, void *aux);
+
+/* Compares the value of two hash elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B. */
+typedef bool rhash_less_func (const struct rhash_elem *a,
+		const struct rhash_elem *b,
+		void *aux);
+
+/* Performs some operation on hash element E, given auxiliary
+ * data AUX. */
+typedef void rhash_action_func (struct rhash_elem *e, void *aux);
+
+/* A slot in the table. */
+struct rhash_slot {
+	uint32_t fingerprint;       /* Low 32 bits of the element's hash. */
+	uint32_t dist;              /* Probe distance plus 1, 0 if empty. */
+	struct rhash_elem *elem;    /* Element in this slot. */
+};
+
+/* Hash table. */
+struct rhash {
+	size_t elem_cnt;            /* Number of elements in table. */
+	size_t slot_cnt;            /* Number of slots, a power of 2. */
+	int shift;                  /* 64 - log2 (slot_cnt). */
+	struct rhash_slot *slots;   /* Array of `slot_cnt' slots. */
+	rhash_hash_func *hash;      /* Hash function. */
+	rhash_less_func *less;      /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `hash' and `less'. */
+};
+
+/* A hash table iterator. */
+struct rhash_iterator {
+	struct rhash *hash;         /* The hash table. */
+	size_t idx;                 /* Index of current slot. */
+	struct rhash_elem *elem;    /* Current hash element. */
+};
+
+/* Basic life cycle. */
+bool rhash_init (struct rhash *, rhash_hash_func *, rhash_less_func *,
+		void *aux);
+void rhash_clear (struct rhash *, rhash_action_func *);
+void rhash_destroy (struct rhash *, rhash_action_func *);
+
+/* Search, insertion, deletion. */
+struct rhash_elem *rhash_insert (struct rhash *, struct rhash_elem *);
+struct rhash_elem *rhash_replace (struct rhash *, struct rhash_elem *);
+struct rhash_elem *rhash_find (struct rhash *, struct rhash_elem *);
+struct rhash_elem *rhash_delete (struct rhash *, struct rhash_elem *);
+
+/* Iteration. */
+void rhash_apply (struct rhash *, rhash_action_func *);
+void rhash_first (struct rhash_iterator *, struct rhash *);
+struct rhash_elem *rhash_next (struct rhash_iterator *);
+struct rhash_elem *rhash_cur (struct rhash_iterator *);
+
+/* Information. */
+size_t rhash_size (struct rhash *);
+bool rhash_empty (struct rhash *);
+
+#endif /* lib/kernel/rhash.h */
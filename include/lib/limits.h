@@ -23,9 +23,9 @@
 #define INT_MIN (-INT_MAX - 1)
 #define UINT_MAX 4294967295U
 
-#define LONG_MAX 2147483647L
+#define LONG_MAX 9223372036854775807L
 #define LONG_MIN (-LONG_MAX - 1)
-#define ULONG_MAX 4294967295UL
+#define ULONG_MAX 18446744073709551615UL
 
 #define LLONG_MAX 9223372036854775807LL
 #define LLONG_MIN (-LLONG_MAX - 1)
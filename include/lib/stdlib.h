@@ -5,6 +5,8 @@
 
 /* Standard functions. */
 int atoi (const char *);
+long strtol (const char *, char **end, int base);
+unsigned long strtoul (const char *, char **end, int base);
 void qsort (void *array, size_t cnt, size_t size,
 		int (*compare) (const void *, const void *));
 void *bsearch (const void *key, const void *array, size_t cnt,
@@ -14,6 +16,9 @@ void *bsearch (const void *key, const void *array, size_t cnt,
 void sort (void *array, size_t cnt, size_t size,
 		int (*compare) (const void *, const void *, void *aux),
 		void *aux);
+void heap_sort (void *array, size_t cnt, size_t size,
+		int (*compare) (const void *, const void *, void *aux),
+		void *aux);
 void *binary_search (const void *key, const void *array, size_t cnt,
 		size_t size,
 		int (*compare) (const void *, const void *, void *aux),
@@ -4,4 +4,37 @@
 int hprintf (int, const char *, ...) PRINTF_FORMAT (2, 3);
 int vhprintf (int, const char *, va_list) PRINTF_FORMAT (2, 0);
 
+/* Buffered streams. */
+#define EOF (-1)
+#define BUFSIZ 4096             /* Default stream buffer size. */
+#define FOPEN_MAX 3             /* Streams, including stdin and stdout. */
+
+/* Buffering modes for setvbuf(). */
+#define _IONBF 0                /* Unbuffered. */
+#define _IOLBF 1                /* Line buffered. */
+#define _IOFBF 2                /* Fully buffered. */
+
+typedef struct __FILE FILE;
+extern FILE *stdin;
+extern FILE *stdout;
+
+FILE *fdopen (int fd, const char *mode);
+int fclose (FILE *);
+int fflush (FILE *);
+int setvbuf (FILE *, char *buf, int mode, size_t size);
+size_t fread (void *, size_t size, size_t cnt, FILE *);
+size_t fwrite (const void *, size_t size, size_t cnt, FILE *);
+int fgetc (FILE *);
+char *fgets (char *, int size, FILE *);
+int fputc (int, FILE *);
+int fputs (const char *, FILE *);
+int fprintf (FILE *, const char *, ...) PRINTF_FORMAT (2, 3);
+int vfprintf (FILE *, const char *, va_list) PRINTF_FORMAT (2, 0);
+int fileno (FILE *);
+int feof (FILE *);
+int ferror (FILE *);
+
+/* Internal functions. */
+void __stdio_sync (int fd);
+
 #endif /* lib/user/stdio.h */
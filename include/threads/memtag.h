@@ -0,0 +1,35 @@
+#ifndef THREADS_MEMTAG_H
+#define THREADS_MEMTAG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Kernel memory accounting.
+
+   When enabled with the -memtag kernel option, every malloc()
+   and palloc_get_*() call is charged to a tag identified by its
+   call site.  Each tag keeps live and peak byte counts, so that
+   the report printed at shutdown (or on demand by calling
+   memtag_dump()) shows which parts of the kernel hold memory.
+
+   Tags are identified by a small integer that the allocators
+   store alongside the allocation, so that the matching free can
+   be charged back to the same tag.  Tag 0 means "untracked". */
+
+/* Kinds of allocations. */
+enum memtag_kind {
+	MEMTAG_MALLOC,              /* malloc(), calloc(), realloc(). */
+	MEMTAG_PALLOC               /* palloc_get_page(), palloc_get_multiple(). */
+};
+
+/* -memtag: Account kernel allocations by call site? */
+extern bool memtag_enabled;
+
+uint16_t memtag_alloc (enum memtag_kind, const void *site, size_t bytes);
+void memtag_free (uint16_t tag, size_t bytes);
+void memtag_checkpoint (void);
+void memtag_dump (size_t top_cnt);
+void memtag_print_stats (void);
+
+#endif /* threads/memtag.h */
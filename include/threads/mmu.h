@@ -2,27 +2,55 @@
 #define THREAD_MMU_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "threads/pte.h"
 
 typedef bool pte_for_each_func (uint64_t *pte, void *va, void *aux);
 
+/* Pages queued by a tlb_gather before it falls back to flushing
+ * the whole TLB. */
+#define TLB_GATHER_MAX 32
+
+/* A batch of TLB invalidations for one page map.  See mmu.c. */
+struct tlb_gather {
+	uint64_t *pml4;                 /* Page map being changed. */
+	size_t cnt;                     /* Queued pages, at most MAX + 1. */
+	uint64_t va[TLB_GATHER_MAX];    /* Queued pages. */
+};
+
 uint64_t *pml4e_walk (uint64_t *pml4, const uint64_t va, int create);
+uint64_t *pml4e_walk_huge (uint64_t *pml4, const uint64_t va, int create);
 uint64_t *pml4_create (void);
 bool pml4_for_each (uint64_t *, pte_for_each_func *, void *);
 void pml4_destroy (uint64_t *pml4);
 void pml4_activate (uint64_t *pml4);
+void pml4_switch (uint64_t *pml4);
 void *pml4_get_page (uint64_t *pml4, const void *upage);
 bool pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
+bool pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
 void pml4_clear_page (uint64_t *pml4, void *upage);
 bool pml4_is_dirty (uint64_t *pml4, const void *upage);
 void pml4_set_dirty (uint64_t *pml4, const void *upage, bool dirty);
 bool pml4_is_accessed (uint64_t *pml4, const void *upage);
 void pml4_set_accessed (uint64_t *pml4, const void *upage, bool accessed);
+void tlb_gather_init (struct tlb_gather *, uint64_t *pml4);
+void tlb_gather_flush (struct tlb_gather *);
+void pml4_clear_page_gather (struct tlb_gather *, void *upage);
+void pml4_set_dirty_gather (struct tlb_gather *, const void *upage,
+		bool dirty);
+void pml4_set_accessed_gather (struct tlb_gather *, const void *upage,
+		bool accessed);
+void pml4_set_writable_gather (struct tlb_gather *, const void *upage,
+		bool writable);
+void pcid_init (void);
+bool pcid_set_enabled (bool enable);
+void mmu_print_stats (void);
 
 #define is_writable(pte) (*(pte) & PTE_W)
 #define is_user_pte(pte) (*(pte) & PTE_U)
 #define is_kern_pte(pte) (!is_user_pte (pte))
+#define is_huge_pte(pte) (*(pte) & PTE_PS)
 
 #define pte_get_paddr(pte) (pg_round_down(*(pte)))
 
@@ -28,6 +28,16 @@
 #define PTX(la)  ((((uint64_t) (la)) >> PTXSHIFT) & 0x1FF)
 #define PTE_ADDR(pte) ((uint64_t) (pte) & ~0xFFF)
 
+/* Huge pages.
+ * A page directory entry with PTE_PS set maps a whole 2 MB,
+ * 2 MB-aligned region directly, with no page table below it.
+ * Such an entry has the same P, W, U, A and D bits as a PTE. */
+#define HPGBITS   21                               /* Huge page offset bits. */
+#define HPGSIZE   (1UL << HPGBITS)                 /* Bytes in a huge page. */
+#define HPGMASK   (HPGSIZE - 1)                    /* Huge page offset bits. */
+#define HPG_PAGE_CNT (HPGSIZE / PGSIZE)            /* Pages in a huge page. */
+#define HPTE_ADDR(pde) ((uint64_t) (pde) & ~HPGMASK)
+
 /* The important flags are listed below.
    When a PDE or PTE is not "present", the other flags are
    ignored.
@@ -41,5 +51,6 @@
 #define PTE_U 0x4                        /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20                       /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40                       /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80                      /* 1=2 MB huge page (PDEs only). */
 
 #endif /* threads/pte.h */
@@ -101,6 +101,9 @@ struct thread {
 #ifdef VM
     /* Table for whole virtual memory owned by thread. */
     struct supplemental_page_table spt;
+    /* User stack pointer saved on system call entry, for growing the
+       stack on a fault in the kernel.  0 before the first call. */
+    uintptr_t user_rsp;
 #endif
 
     /* Owned by thread.c. */
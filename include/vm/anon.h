@@ -2,12 +2,22 @@
 #define VM_ANON_H
 #include "vm/vm.h"
 struct page;
+struct segment;
 enum vm_type;
 
 struct anon_page {
+	size_t slot;           /* Swap slot with a copy of the page, or
+	                          BITMAP_ERROR if none. */
+	struct segment *seg;   /* Segment of a file with the page's initial
+	                          contents, or null.  Dropped once the page
+	                          has a slot. */
 };
 
 void vm_anon_init (void);
+void swap_print_stats (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_init_segment (struct page *page, struct segment *seg);
+void anon_copy (struct page *dst, struct page *src);
+bool anon_is_zero (const struct page *page);
 
 #endif
@@ -1,17 +1,69 @@
 #ifndef VM_FILE_H
 #define VM_FILE_H
+#include <stdint.h>
 #include "filesys/file.h"
 #include "vm/vm.h"
 
 struct page;
+struct frame;
 enum vm_type;
 
+/* A segment: a run of pages whose contents come from a file.  The pages
+ * from START hold READ_BYTES bytes of FILE starting at offset OFS, and
+ * zeros after that.  load() creates one for each loadable segment of an
+ * executable, and mmap() one for each mapping, and its pages refer to it
+ * instead of each describing where its data is. */
+struct segment {
+	struct file *file;     /* Handle on the file, shared by the pages. */
+	off_t ofs;             /* Offset in FILE of the data at START. */
+	uint8_t *start;        /* Address of the first page. */
+	size_t read_bytes;     /* Bytes of FILE; the rest are zeros. */
+	size_t page_cnt;       /* Number of pages. */
+	unsigned ref_cnt;      /* Pages referring to the segment, and others. */
+	bool shared;           /* A mapping made by mmap(), whose writable
+	                          pages are written back to FILE? */
+
+	/* Readahead.  A hint shared by the processes that map the segment,
+	 * so it is updated without locking. */
+	uint8_t *ra_next;      /* Page a sequential reader faults on next. */
+	size_t ra_pages;       /* Pages read on the last fault. */
+};
+
 struct file_page {
+	struct segment *seg;   /* Segment that holds the page's data. */
+};
+
+/* Why dirty pages of a mapping were written back. */
+enum writeback_reason {
+	WB_THREAD,             /* By the writeback thread. */
+	WB_EVICT,              /* To evict them. */
+	WB_UNMAP,              /* On munmap() or exit. */
+	WB_REASON_CNT
 };
 
 void vm_file_init (void);
+void file_print_stats (void);
 bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
+void file_init_segment (struct page *page, struct segment *seg);
+void file_backed_copy (struct page *dst, struct page *src);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+bool file_mapped_pos (const struct page *page, struct inode **inode,
+		off_t *ofs);
+void file_write_back (struct page *const pages[], size_t cnt,
+		enum writeback_reason reason);
+
+/* Segments. */
+struct segment *segment_create (struct file *file, off_t ofs, void *start,
+		size_t read_bytes, size_t zero_bytes);
+struct segment *segment_get (struct segment *seg);
+void segment_put (struct segment *seg);
+bool segment_read (struct segment *seg, struct page *page, void *kva);
+size_t segment_page_bytes (const struct segment *seg, const void *va);
+
+/* Cache of frames holding read-only file pages. */
+struct frame *file_cache_lookup (struct page *page);
+void file_cache_insert (struct page *page, struct frame *frame);
+void file_cache_remove (struct frame *frame);
 #endif
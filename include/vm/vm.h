@@ -20,6 +20,9 @@ enum vm_type {
 	VM_MARKER_0 = (1 << 3),
 	VM_MARKER_1 = (1 << 4),
 
+	/* Marks the pages of the user stack. */
+	VM_STACK = VM_MARKER_0,
+
 	/* DO NOT EXCEED THIS VALUE. */
 	VM_MARKER_END = (1 << 31),
 };
@@ -46,6 +49,11 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	struct thread *owner;  /* Process whose address space holds the page. */
+	bool writable;         /* Writable by the user process? */
+	struct page *frame_next; /* Next page mapping the same frame. */
+	bool faulted_around;   /* Loaded by fault-around, not yet accessed? */
+	bool zero_mapped;      /* Mapped read-only to the zero page? */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -59,10 +67,23 @@ struct page {
 	};
 };
 
-/* The representation of "frame" */
+/* The representation of "frame"
+ *
+ * There is one for each page of the user pool, in a table indexed by
+ * physical page, so a frame is never allocated or freed, only put in and
+ * out of use.  PAGE heads the list, linked through page->frame_next, of
+ * the pages that map the frame.  More than one page maps a frame only after
+ * fork(), which shares frames copy-on-write: all of their mappings are then
+ * read-only, and the first write to one of the pages gives it a frame of
+ * its own, or when processes map the same read-only part of a file, which
+ * they find in the file page cache (see vm/file.c). */
 struct frame {
 	void *kva;
-	struct page *page;
+	struct page *page;     /* Pages mapping the frame, or null if free. */
+	unsigned ref_cnt;      /* Number of pages in the PAGE list. */
+	bool pinned;           /* Exempt from eviction? */
+	bool writeback;        /* Being written by the writeback thread? */
+	struct file_cache_entry *cache; /* File page cache entry, or null. */
 };
 
 /* The function table for page operations.
@@ -82,11 +103,21 @@ struct page_operations {
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
 /* Representation of current process's memory space.
- * We don't want to force you to obey any specific design for this struct.
- * All designs up to you for this. */
+ *
+ * A radix tree indexed by virtual page number, with the same shape as the
+ * x86-64 page table that threads/mmu.c walks: four levels of 512-entry
+ * nodes, each one page in size, indexed by the PML4, PDPE, PDX and PTX bits
+ * of the address.  The leaves are dense arrays of struct page pointers.
+ * Lookup is four dependent loads, and iteration visits pages in address
+ * order, skipping unpopulated regions a whole node at a time. */
 struct supplemental_page_table {
+	void **root;           /* Top level node, or null if empty. */
+	size_t page_cnt;       /* Number of pages in the table. */
 };
 
+/* Called by spt_for_each() for each page.  Returns false to stop. */
+typedef bool spt_page_func (struct page *, void *aux);
+
 #include "threads/thread.h"
 void supplemental_page_table_init (struct supplemental_page_table *spt);
 bool supplemental_page_table_copy (struct supplemental_page_table *dst,
@@ -96,8 +127,21 @@ struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
+void spt_remove_pages (struct supplemental_page_table *spt,
+		struct page *const pages[], size_t cnt);
+bool spt_for_each (struct supplemental_page_table *spt, void *start, void *end,
+		spt_page_func *func, void *aux);
+
+extern size_t vm_fault_around_pages;
+extern bool vm_huge_pages;
+extern unsigned vm_dirty_ratio;
 
 void vm_init (void);
+void vm_print_stats (void);
+struct frame *vm_frame_get_spare (void);
+bool vm_frame_install (struct page *page, struct frame *frame);
+void vm_frame_put_spare (struct frame *frame);
+void vm_writeback_start (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
 
@@ -106,6 +150,7 @@ bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
 void vm_dealloc_page (struct page *page);
+bool vm_alloc_segment (struct segment *seg, enum vm_type type, bool writable);
 bool vm_claim_page (void *va);
 enum vm_type page_get_type (struct page *page);
 
@@ -0,0 +1,16 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stdbool.h>
+#include <stddef.h>
+
+struct disk;
+
+extern size_t zswap_pool_pages;
+
+void zswap_init (struct disk *swap_disk, size_t slot_cnt);
+void zswap_print_stats (void);
+bool zswap_store (size_t slot, const void *kva);
+bool zswap_load (size_t slot, void *kva);
+void zswap_invalidate (size_t slot);
+
+#endif
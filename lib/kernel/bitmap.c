@@ -3,6 +3,8 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -23,10 +25,23 @@ typedef unsigned long elem_type;
 
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   A bitmap may also have a summary, set up by
+   bitmap_enable_summary(), that lets searches skip long stretches
+   of elements in constant time.  For each VALUE, SUMMARY[VALUE]
+   has one bit per element of BITS, set if that element has any
+   bit set to VALUE; that is, SUMMARY[false] marks the elements
+   that are not full and SUMMARY[true] those that are not empty.
+   TOP[VALUE] in turn has one bit per element of SUMMARY[VALUE],
+   set if that element is nonzero.  Two levels cover 2**18 bits
+   per element of TOP, so TOP is a few elements long for any
+   bitmap that fits in memory. */
 struct bitmap {
-	size_t bit_cnt;     /* Number of bits. */
-	elem_type *bits;    /* Elements that represent bits. */
+	size_t bit_cnt;             /* Number of bits. */
+	elem_type *bits;            /* Elements that represent bits. */
+	elem_type *summary[2];      /* Elements with a bit of each value. */
+	elem_type *top[2];          /* Nonzero elements of SUMMARY. */
 };
 
 /* Returns the index of the element that contains the bit
@@ -63,6 +78,152 @@ last_mask (const struct bitmap *b) {
 	return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns element ELEM_IDX of B, inverted if VALUE is false so
+   that the bits set to VALUE are 1s, and with the bits past the
+   end of B cleared. */
+static inline elem_type
+value_elem (const struct bitmap *b, size_t elem_idx, bool value) {
+	elem_type e = value ? b->bits[elem_idx] : ~b->bits[elem_idx];
+	if (elem_idx == elem_cnt (b->bit_cnt) - 1)
+		e &= last_mask (b);
+	return e;
+}
+
+/* Returns the index of the least significant 1 in E, which must
+   be nonzero.  Compiles to a single BSF instruction. */
+static inline size_t
+first_one (elem_type e) {
+	return __builtin_ctzl (e);
+}
+
+/* Returns the index of the first element of B at or after
+   ELEM_IDX that has a bit set to VALUE.  Without a summary, this
+   is just ELEM_IDX.  Returns elem_cnt (B->bit_cnt) if there is
+   no such element. */
+static size_t
+next_elem (const struct bitmap *b, size_t elem_idx, bool value) {
+	size_t cnt = elem_cnt (b->bit_cnt);
+	size_t sum_cnt = elem_cnt (cnt);
+	const elem_type *summary = b->summary[value];
+	size_t i;
+	elem_type e;
+
+	if (summary == NULL || elem_idx >= cnt)
+		return elem_idx < cnt ? elem_idx : cnt;
+
+	/* Look in the rest of ELEM_IDX's summary element. */
+	i = elem_idx / ELEM_BITS;
+	e = summary[i] & ((elem_type) -1 << (elem_idx % ELEM_BITS));
+	if (e != 0)
+		return i * ELEM_BITS + first_one (e);
+
+	/* Find the next nonzero summary element. */
+	for (i++; i < sum_cnt; i = (i / ELEM_BITS + 1) * ELEM_BITS) {
+		e = b->top[value][i / ELEM_BITS] & ((elem_type) -1 << (i % ELEM_BITS));
+		if (e != 0) {
+			i = i / ELEM_BITS * ELEM_BITS + first_one (e);
+			return i * ELEM_BITS + first_one (summary[i]);
+		}
+	}
+	return cnt;
+}
+
+/* Brings the summary bits for element IDX of B up to date
+   with its current contents, if B has a summary.
+
+   The element is read with interrupts disabled, and every update
+   to an element is followed by a call to this function, so the
+   last refresh always sees the latest contents.  This keeps the
+   summary exact without a lock, which matters because palloc
+   frees pages with interrupts off in the scheduler. */
+static void
+refresh_summary (struct bitmap *b, size_t idx) {
+	enum intr_level old_level;
+	size_t i = idx / ELEM_BITS;
+	int value;
+
+	if (b->summary[0] == NULL)
+		return;
+
+	old_level = intr_disable ();
+	for (value = 0; value < 2; value++) {
+		elem_type *summary = b->summary[value];
+		elem_type mask = bit_mask (idx);
+
+		if (value_elem (b, idx, value) != 0)
+			summary[i] |= mask;
+		else
+			summary[i] &= ~mask;
+		if (summary[i] != 0)
+			b->top[value][elem_idx (i)] |= bit_mask (i);
+		else
+			b->top[value][elem_idx (i)] &= ~bit_mask (i);
+	}
+	intr_set_level (old_level);
+}
+
+/* Finds and returns the index of the first group of CNT
+   consecutive bits in B that are set to VALUE and lie between
+   START and END, exclusive.  If there is no such group, returns
+   BITMAP_ERROR.  CNT must be nonzero.
+
+   Works a word at a time: words with no bit set to VALUE are
+   skipped outright, the start of a run is found with a bit scan,
+   and its length by a bit scan of the inverted word.  After a
+   run that is too short, the search resumes past its end rather
+   than one bit after its start, and with a summary, whole
+   stretches of elements without a bit set to VALUE are skipped
+   at once. */
+static size_t
+find_run (const struct bitmap *b, size_t start, size_t end, size_t cnt,
+		bool value) {
+	size_t run_start = start;
+	size_t run = 0;
+	size_t i = start;
+
+	ASSERT (cnt > 0);
+	ASSERT (end <= b->bit_cnt);
+
+	while (i < end) {
+		size_t ofs = i % ELEM_BITS;
+		size_t avail = ELEM_BITS - ofs;
+		elem_type e = value_elem (b, elem_idx (i), value) >> ofs;
+		size_t ones;
+
+		if (run == 0) {
+			/* Not enough bits left for a run? */
+			if (end - i < cnt)
+				break;
+
+			/* Find the next bit set to VALUE, using the summary
+			   to skip elements that have none. */
+			if (e == 0) {
+				i = next_elem (b, elem_idx (i) + 1, value) * ELEM_BITS;
+				continue;
+			}
+			ones = first_one (e);
+			e >>= ones;
+			avail -= ones;
+			i += ones;
+			run_start = i;
+		}
+
+		/* Count the bits set to VALUE starting at I.  Shifting in
+		   zeros above AVAIL stops the count at the end of the
+		   word. */
+		ones = ~e != 0 ? first_one (~e) : avail;
+		run += ones;
+		i += ones;
+		if (run >= cnt && run_start + cnt <= end)
+			return run_start;
+		if (ones < avail || i >= end)
+			run = 0;
+	}
+	return BITMAP_ERROR;
+}
+
+static void rebuild_summary (struct bitmap *);
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -75,6 +236,7 @@ bitmap_create (size_t bit_cnt) {
 	if (b != NULL) {
 		b->bit_cnt = bit_cnt;
 		b->bits = malloc (byte_cnt (bit_cnt));
+		b->summary[0] = b->summary[1] = NULL;
 		if (b->bits != NULL || bit_cnt == 0) {
 			bitmap_set_all (b, false);
 			return b;
@@ -95,6 +257,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED) {
 
 	b->bit_cnt = bit_cnt;
 	b->bits = (elem_type *) (b + 1);
+	b->summary[0] = b->summary[1] = NULL;
 	bitmap_set_all (b, false);
 	return b;
 }
@@ -106,6 +269,50 @@ bitmap_buf_size (size_t bit_cnt) {
 	return sizeof (struct bitmap) + byte_cnt (bit_cnt);
 }
 
+/* Returns the number of bytes of storage needed for the summary
+   of a bitmap with BIT_CNT bits (for use with
+   bitmap_enable_summary()). */
+size_t
+bitmap_summary_buf_size (size_t bit_cnt) {
+	size_t sum_cnt = elem_cnt (elem_cnt (bit_cnt));
+	return 2 * sizeof (elem_type) * (sum_cnt + elem_cnt (sum_cnt));
+}
+
+/* Adds a summary to B, stored in the BLOCK_SIZE bytes at BLOCK,
+   which must be at least bitmap_summary_buf_size() bytes for B's
+   size.  From then on, searches for bits of either value take
+   nearly constant time however full or empty B is, at the cost
+   of a little extra work to keep the summary up to date on every
+   change to B.  The storage remains the caller's; it must outlive
+   B, and bitmap_destroy() does not free it. */
+void
+bitmap_enable_summary (struct bitmap *b, void *block,
+		size_t block_size UNUSED) {
+	size_t sum_cnt = elem_cnt (elem_cnt (b->bit_cnt));
+	elem_type *e = block;
+	int value;
+
+	ASSERT (block_size >= bitmap_summary_buf_size (b->bit_cnt));
+
+	for (value = 0; value < 2; value++) {
+		b->summary[value] = e;
+		e += sum_cnt;
+		b->top[value] = e;
+		e += elem_cnt (sum_cnt);
+	}
+	memset (block, 0, bitmap_summary_buf_size (b->bit_cnt));
+	rebuild_summary (b);
+}
+
+/* Recomputes B's summary, if it has one, from its contents. */
+static void
+rebuild_summary (struct bitmap *b) {
+	size_t i;
+
+	for (i = 0; i < elem_cnt (b->bit_cnt); i++)
+		refresh_summary (b, i);
+}
+
 /* Destroys bitmap B, freeing its storage.
    Not for use on bitmaps created by
    bitmap_create_preallocated(). */
@@ -148,6 +355,7 @@ bitmap_mark (struct bitmap *b, size_t bit_idx) {
 	   is guaranteed to be atomic on a uniprocessor machine.  See
 	   the description of the OR instruction in [IA32-v2b]. */
 	asm ("lock orq %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+	refresh_summary (b, idx);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -160,6 +368,7 @@ bitmap_reset (struct bitmap *b, size_t bit_idx) {
 	   is guaranteed to be atomic on a uniprocessor machine.  See
 	   the description of the AND instruction in [IA32-v2a]. */
 	asm ("lock andq %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+	refresh_summary (b, idx);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -174,6 +383,7 @@ bitmap_flip (struct bitmap *b, size_t bit_idx) {
 	   is guaranteed to be atomic on a uniprocessor machine.  See
 	   the description of the XOR instruction in [IA32-v2b]. */
 	asm ("lock xorq %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+	refresh_summary (b, idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -194,17 +404,32 @@ bitmap_set_all (struct bitmap *b, bool value) {
 	bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element is updated atomically, but the range as a whole
+   is not. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
+	size_t end = start + cnt;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		bitmap_set (b, start + i, value);
+	while (start < end) {
+		size_t idx = elem_idx (start);
+		size_t ofs = start % ELEM_BITS;
+		size_t n = end - start < ELEM_BITS - ofs ? end - start : ELEM_BITS - ofs;
+		elem_type mask = (n < ELEM_BITS ? ((elem_type) 1 << n) - 1
+				: (elem_type) -1) << ofs;
+
+		/* See bitmap_mark() and bitmap_reset(). */
+		if (value)
+			asm ("lock orq %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+		else
+			asm ("lock andq %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+		refresh_summary (b, idx);
+		start += n;
+	}
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -228,16 +453,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
    exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
-
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			return true;
-	return false;
+	return cnt > 0 && find_run (b, start, start + cnt, 1, value) != BITMAP_ERROR;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -272,14 +492,36 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 
-	if (cnt <= b->bit_cnt) {
-		size_t last = b->bit_cnt - cnt;
-		size_t i;
-		for (i = start; i <= last; i++)
-			if (!bitmap_contains (b, i, cnt, !value))
-				return i;
+	if (cnt == 0)
+		return start;
+	return find_run (b, start, b->bit_cnt, cnt, value);
+}
+
+/* Like bitmap_scan(), but for next-fit allocation: searches from
+   HINT to the end of B, then wraps around to search from the
+   beginning up to HINT.  Callers typically pass the index just
+   past the previous group they allocated, so that successive
+   searches do not rescan the same used bits at the start of B.
+   If CNT is zero, returns HINT. */
+size_t
+bitmap_scan_from_hint (const struct bitmap *b, size_t hint, size_t cnt,
+		bool value) {
+	size_t idx;
+
+	ASSERT (b != NULL);
+
+	if (hint > b->bit_cnt)
+		hint = 0;
+	if (cnt == 0)
+		return hint;
+
+	idx = find_run (b, hint, b->bit_cnt, cnt, value);
+	if (idx == BITMAP_ERROR && hint > 0) {
+		/* Runs that start before HINT may extend past it. */
+		size_t end = hint + cnt - 1 < b->bit_cnt ? hint + cnt - 1 : b->bit_cnt;
+		idx = find_run (b, 0, end, cnt, value);
 	}
-	return BITMAP_ERROR;
+	return idx;
 }
 
 /* Finds the first group of CNT consecutive bits in B at or after
@@ -315,6 +557,7 @@ bitmap_read (struct bitmap *b, struct file *file) {
 		off_t size = byte_cnt (b->bit_cnt);
 		success = file_read_at (file, b->bits, size, 0) == size;
 		b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+		rebuild_summary (b);
 	}
 	return success;
 }
@@ -1,6 +1,7 @@
 #include <console.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/serial.h"
 #include "devices/vga.h"
 #include "threads/init.h"
@@ -8,8 +9,22 @@
 #include "threads/synch.h"
 
 static void vprintf_helper (char, void *);
+static void putbuf_have_lock (const char *, size_t);
 static void putchar_have_lock (uint8_t c);
 
+/* vprintf() formats into a buffer of this many bytes on the
+   stack and writes it out whenever it fills, so that the console
+   layers are entered once per buffer instead of once per
+   character.  Kernel stacks are small, so keep this modest. */
+#define VPRINTF_BUF_SIZE 128
+
+/* Output buffer for vprintf(). */
+struct vprintf_buf {
+	char buf[VPRINTF_BUF_SIZE];   /* Formatted characters not yet written. */
+	size_t len;                   /* Number of characters in BUF. */
+	int char_cnt;                 /* Total characters formatted. */
+};
+
 /* The console lock.
    Both the vga and serial layers do their own locking, so it's
    safe to call them at any time.
@@ -116,13 +131,17 @@ console_locked_by_current_thread (void) {
    Writes its output to both vga display and serial port. */
 int
 vprintf (const char *format, va_list args) {
-	int char_cnt = 0;
+	struct vprintf_buf b;
+
+	b.len = 0;
+	b.char_cnt = 0;
 
 	acquire_console ();
-	__vprintf (format, args, vprintf_helper, &char_cnt);
+	__vprintf (format, args, vprintf_helper, &b);
+	putbuf_have_lock (b.buf, b.len);
 	release_console ();
 
-	return char_cnt;
+	return b.char_cnt;
 }
 
 /* Writes string S to the console, followed by a new-line
@@ -130,8 +149,7 @@ vprintf (const char *format, va_list args) {
 int
 puts (const char *s) {
 	acquire_console ();
-	while (*s != '\0')
-		putchar_have_lock (*s++);
+	putbuf_have_lock (s, strlen (s));
 	putchar_have_lock ('\n');
 	release_console ();
 
@@ -142,8 +160,7 @@ puts (const char *s) {
 void
 putbuf (const char *buffer, size_t n) {
 	acquire_console ();
-	while (n-- > 0)
-		putchar_have_lock (*buffer++);
+	putbuf_have_lock (buffer, n);
 	release_console ();
 }
 
@@ -157,12 +174,31 @@ putchar (int c) {
 	return c;
 }
 
-/* Helper function for vprintf(). */
+/* Helper function for vprintf().  Appends C to the buffer in
+   B_, writing the buffer out first if it is full. */
 static void
-vprintf_helper (char c, void *char_cnt_) {
-	int *char_cnt = char_cnt_;
-	(*char_cnt)++;
-	putchar_have_lock (c);
+vprintf_helper (char c, void *b_) {
+	struct vprintf_buf *b = b_;
+
+	if (b->len >= sizeof b->buf) {
+		putbuf_have_lock (b->buf, b->len);
+		b->len = 0;
+	}
+	b->buf[b->len++] = c;
+	b->char_cnt++;
+}
+
+/* Writes the N characters in BUFFER to the vga display and serial
+   port.  The caller has already acquired the console lock if
+   appropriate. */
+static void
+putbuf_have_lock (const char *buffer, size_t n) {
+	ASSERT (console_locked_by_current_thread ());
+	if (n == 0)
+		return;
+	write_cnt += n;
+	serial_puts (buffer, n);
+	vga_puts (buffer, n);
 }
 
 /* Writes C to the vga display and serial port.
@@ -6,6 +6,7 @@
    See hash.h for basic information. */
 
 #include "hash.h"
+#include <string.h>
 #include "../debug.h"
 #include "threads/malloc.h"
 
@@ -15,6 +16,8 @@
 static struct list *find_bucket (struct hash *, struct hash_elem *);
 static struct hash_elem *find_elem (struct hash *, struct list *,
 		struct hash_elem *);
+static struct hash_elem *find_old_elem (struct hash *, struct hash_elem *);
+static struct list *next_bucket (struct hash *, struct list *);
 static void insert_elem (struct hash *, struct list *, struct hash_elem *);
 static void remove_elem (struct hash *, struct hash_elem *);
 static void rehash (struct hash *);
@@ -27,6 +30,9 @@ hash_init (struct hash *h,
 	h->elem_cnt = 0;
 	h->bucket_cnt = 4;
 	h->buckets = malloc (sizeof *h->buckets * h->bucket_cnt);
+	h->old_bucket_cnt = 0;
+	h->old_buckets = NULL;
+	h->migrate_idx = 0;
 	h->hash = hash;
 	h->less = less;
 	h->aux = aux;
@@ -49,11 +55,9 @@ hash_init (struct hash *h,
    whether done in DESTRUCTOR or elsewhere. */
 void
 hash_clear (struct hash *h, hash_action_func *destructor) {
-	size_t i;
-
-	for (i = 0; i < h->bucket_cnt; i++) {
-		struct list *bucket = &h->buckets[i];
+	struct list *bucket;
 
+	for (bucket = h->buckets; bucket != NULL; bucket = next_bucket (h, bucket)) {
 		if (destructor != NULL)
 			while (!list_empty (bucket)) {
 				struct list_elem *list_elem = list_pop_front (bucket);
@@ -64,6 +68,9 @@ hash_clear (struct hash *h, hash_action_func *destructor) {
 		list_init (bucket);
 	}
 
+	/* Nothing is left to migrate. */
+	free (h->old_buckets);
+	h->old_buckets = NULL;
 	h->elem_cnt = 0;
 }
 
@@ -81,6 +88,7 @@ void
 hash_destroy (struct hash *h, hash_action_func *destructor) {
 	if (destructor != NULL)
 		hash_clear (h, destructor);
+	free (h->old_buckets);
 	free (h->buckets);
 }
 
@@ -93,6 +101,8 @@ hash_insert (struct hash *h, struct hash_elem *new) {
 	struct list *bucket = find_bucket (h, new);
 	struct hash_elem *old = find_elem (h, bucket, new);
 
+	if (old == NULL)
+		old = find_old_elem (h, new);
 	if (old == NULL)
 		insert_elem (h, bucket, new);
 
@@ -108,6 +118,8 @@ hash_replace (struct hash *h, struct hash_elem *new) {
 	struct list *bucket = find_bucket (h, new);
 	struct hash_elem *old = find_elem (h, bucket, new);
 
+	if (old == NULL)
+		old = find_old_elem (h, new);
 	if (old != NULL)
 		remove_elem (h, old);
 	insert_elem (h, bucket, new);
@@ -121,7 +133,8 @@ hash_replace (struct hash *h, struct hash_elem *new) {
    null pointer if no equal element exists in the table. */
 struct hash_elem *
 hash_find (struct hash *h, struct hash_elem *e) {
-	return find_elem (h, find_bucket (h, e), e);
+	struct hash_elem *found = find_elem (h, find_bucket (h, e), e);
+	return found != NULL ? found : find_old_elem (h, e);
 }
 
 /* Finds, removes, and returns an element equal to E in hash
@@ -133,7 +146,7 @@ hash_find (struct hash *h, struct hash_elem *e) {
    responsibility to deallocate them. */
 struct hash_elem *
 hash_delete (struct hash *h, struct hash_elem *e) {
-	struct hash_elem *found = find_elem (h, find_bucket (h, e), e);
+	struct hash_elem *found = hash_find (h, e);
 	if (found != NULL) {
 		remove_elem (h, found);
 		rehash (h);
@@ -149,12 +162,11 @@ hash_delete (struct hash *h, struct hash_elem *e) {
    undefined behavior, whether done from ACTION or elsewhere. */
 void
 hash_apply (struct hash *h, hash_action_func *action) {
-	size_t i;
+	struct list *bucket;
 
 	ASSERT (action != NULL);
 
-	for (i = 0; i < h->bucket_cnt; i++) {
-		struct list *bucket = &h->buckets[i];
+	for (bucket = h->buckets; bucket != NULL; bucket = next_bucket (h, bucket)) {
 		struct list_elem *elem, *next;
 
 		for (elem = list_begin (bucket); elem != list_end (bucket); elem = next) {
@@ -205,7 +217,8 @@ hash_next (struct hash_iterator *i) {
 
 	i->elem = list_elem_to_hash_elem (list_next (&i->elem->list_elem));
 	while (i->elem == list_elem_to_hash_elem (list_end (i->bucket))) {
-		if (++i->bucket >= i->hash->buckets + i->hash->bucket_cnt) {
+		i->bucket = next_bucket (i->hash, i->bucket);
+		if (i->bucket == NULL) {
 			i->elem = NULL;
 			break;
 		}
@@ -235,47 +248,75 @@ hash_empty (struct hash *h) {
 	return h->elem_cnt == 0;
 }
 
-/* Fowler-Noll-Vo hash constants, for 32-bit word sizes. */
-#define FNV_64_PRIME 0x00000100000001B3UL
-#define FNV_64_BASIS 0xcbf29ce484222325UL
+/* Sample hash functions.
+
+   These process input 8 bytes at a time, in the style of wyhash.
+   Each step folds the 128-bit product of the running state and
+   the next word into 64 bits.  A 64x64-bit multiply is a single
+   instruction on x86-64 and needs no SSE, and unlike the
+   byte-at-a-time FNV hash used before, every output bit depends
+   on every input bit.  That matters because hash tables index
+   their buckets with the low bits of the hash, which for FNV or
+   a plain multiply depend only on the low bits of the input,
+   and keys such as page addresses have all-zero low bits. */
+
+/* Multiplier constants from wyhash. */
+#define HASH_SEED 0xa0761d6478bd642fULL
+#define HASH_MUL 0xe7037ed1a0b428dbULL
+
+/* An unaligned 64-bit word that may alias anything. */
+typedef uint64_t hash_word __attribute__ ((may_alias, aligned (1)));
+
+/* Returns the 128-bit product of A and B, folded to 64 bits by
+   xoring its halves. */
+static inline uint64_t
+mix (uint64_t a, uint64_t b) {
+	unsigned __int128 r = (unsigned __int128) a * b;
+	return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
 
 /* Returns a hash of the SIZE bytes in BUF. */
 uint64_t
 hash_bytes (const void *buf_, size_t size) {
-	/* Fowler-Noll-Vo 32-bit hash, for bytes. */
 	const unsigned char *buf = buf_;
-	uint64_t hash;
+	uint64_t hash = HASH_SEED ^ mix (size ^ HASH_SEED, HASH_MUL);
+	uint64_t tail = 0;
+	size_t i;
 
-	ASSERT (buf != NULL);
+	ASSERT (buf != NULL || size == 0);
 
-	hash = FNV_64_BASIS;
-	while (size-- > 0)
-		hash = (hash * FNV_64_PRIME) ^ *buf++;
+	for (; size >= 8; buf += 8, size -= 8)
+		hash = mix (hash ^ *(const hash_word *) buf, HASH_MUL);
+	for (i = 0; i < size; i++)
+		tail |= (uint64_t) buf[i] << (8 * i);
 
-	return hash;
+	return mix (hash ^ tail, HASH_MUL ^ HASH_SEED);
 }
 
-/* Returns a hash of string S. */
+/* Returns a hash of string S.  This is the same as hash_bytes()
+   over the string's characters, not including the null
+   terminator; strlen() finds the end a word at a time, too. */
 uint64_t
-hash_string (const char *s_) {
-	const unsigned char *s = (const unsigned char *) s_;
-	uint64_t hash;
-
+hash_string (const char *s) {
 	ASSERT (s != NULL);
 
-	hash = FNV_64_BASIS;
-	while (*s != '\0')
-		hash = (hash * FNV_64_PRIME) ^ *s++;
-
-	return hash;
+	return hash_bytes (s, strlen (s));
 }
 
 /* Returns a hash of integer I. */
 uint64_t
 hash_int (int i) {
-	return hash_bytes (&i, sizeof i);
+	return mix ((uint64_t) (unsigned) i ^ HASH_SEED, HASH_MUL);
 }
-
+
+/* Returns a hash of pointer P, which need not point to anything.
+   Useful for tables keyed by address, such as a supplemental
+   page table. */
+uint64_t
+hash_ptr (const void *p) {
+	return mix ((uint64_t) p ^ HASH_SEED, HASH_MUL);
+}
+
 /* Returns the bucket in H that E belongs in. */
 static struct list *
 find_bucket (struct hash *h, struct hash_elem *e) {
@@ -297,6 +338,36 @@ find_elem (struct hash *h, struct list *bucket, struct hash_elem *e) {
 	return NULL;
 }
 
+/* If H is being resized, searches the old bucket that E would
+   have been in for a hash element equal to E.  Returns it if
+   found or a null pointer otherwise. */
+static struct hash_elem *
+find_old_elem (struct hash *h, struct hash_elem *e) {
+	size_t bucket_idx;
+
+	if (h->old_buckets == NULL)
+		return NULL;
+	bucket_idx = h->hash (e, h->aux) & (h->old_bucket_cnt - 1);
+	if (bucket_idx < h->migrate_idx)
+		return NULL;
+	return find_elem (h, &h->old_buckets[bucket_idx], e);
+}
+
+/* Returns the bucket in H after BUCKET, going through the new
+   buckets and then any old buckets, or a null pointer after the
+   last bucket. */
+static struct list *
+next_bucket (struct hash *h, struct list *bucket) {
+	if (bucket >= h->buckets && bucket < h->buckets + h->bucket_cnt) {
+		if (++bucket < h->buckets + h->bucket_cnt)
+			return bucket;
+		return h->old_buckets;
+	}
+	if (++bucket < h->old_buckets + h->old_bucket_cnt)
+		return bucket;
+	return NULL;
+}
+
 /* Returns X with its lowest-order bit set to 1 turned off. */
 static inline size_t
 turn_off_least_1bit (size_t x) {
@@ -314,21 +385,61 @@ is_power_of_2 (size_t x) {
 #define BEST_ELEMS_PER_BUCKET 2 /* Ideal elems/bucket. */
 #define MAX_ELEMS_PER_BUCKET  4 /* Elems/bucket > 4: increase # of buckets. */
 
+/* Number of old buckets emptied per insertion or deletion while
+   a resize is in progress. */
+#define MIGRATE_BUCKETS 4
+
+/* Moves the elements of up to MIGRATE_BUCKETS more old buckets
+   of H into its new buckets, and frees the old buckets once they
+   are all empty. */
+static void
+migrate (struct hash *h) {
+	size_t end = h->migrate_idx + MIGRATE_BUCKETS;
+
+	if (end > h->old_bucket_cnt)
+		end = h->old_bucket_cnt;
+	for (; h->migrate_idx < end; h->migrate_idx++) {
+		struct list *old_bucket = &h->old_buckets[h->migrate_idx];
+
+		while (!list_empty (old_bucket)) {
+			struct list_elem *elem = list_pop_front (old_bucket);
+			list_push_front (find_bucket (h, list_elem_to_hash_elem (elem)),
+					elem);
+		}
+	}
+
+	if (h->migrate_idx == h->old_bucket_cnt) {
+		free (h->old_buckets);
+		h->old_buckets = NULL;
+	}
+}
+
 /* Changes the number of buckets in hash table H to match the
    ideal.  This function can fail because of an out-of-memory
    condition, but that'll just make hash accesses less efficient;
-   we can still continue. */
+   we can still continue.
+
+   Moving every element at once would make the insertion or
+   deletion that triggers a resize take time proportional to the
+   size of the table.  Instead, the old buckets are kept beside
+   the new ones and emptied a few at a time by this function on
+   each later insertion or deletion, so that no operation does
+   more than a constant amount of migration.  Lookups check the
+   old bucket as well until it has been emptied.  Another resize
+   does not start until the current one finishes. */
 static void
 rehash (struct hash *h) {
-	size_t old_bucket_cnt, new_bucket_cnt;
-	struct list *new_buckets, *old_buckets;
+	size_t new_bucket_cnt;
+	struct list *new_buckets;
 	size_t i;
 
 	ASSERT (h != NULL);
 
-	/* Save old bucket info for later use. */
-	old_buckets = h->buckets;
-	old_bucket_cnt = h->bucket_cnt;
+	/* Continue a resize in progress. */
+	if (h->old_buckets != NULL) {
+		migrate (h);
+		return;
+	}
 
 	/* Calculate the number of buckets to use now.
 	   We want one bucket for about every BEST_ELEMS_PER_BUCKET.
@@ -341,7 +452,7 @@ rehash (struct hash *h) {
 		new_bucket_cnt = turn_off_least_1bit (new_bucket_cnt);
 
 	/* Don't do anything if the bucket count wouldn't change. */
-	if (new_bucket_cnt == old_bucket_cnt)
+	if (new_bucket_cnt == h->bucket_cnt)
 		return;
 
 	/* Allocate new buckets and initialize them as empty. */
@@ -355,27 +466,14 @@ rehash (struct hash *h) {
 	for (i = 0; i < new_bucket_cnt; i++)
 		list_init (&new_buckets[i]);
 
-	/* Install new bucket info. */
+	/* Install new bucket info, keeping the old buckets until
+	   their elements have been moved. */
+	h->old_buckets = h->buckets;
+	h->old_bucket_cnt = h->bucket_cnt;
+	h->migrate_idx = 0;
 	h->buckets = new_buckets;
 	h->bucket_cnt = new_bucket_cnt;
-
-	/* Move each old element into the appropriate new bucket. */
-	for (i = 0; i < old_bucket_cnt; i++) {
-		struct list *old_bucket;
-		struct list_elem *elem, *next;
-
-		old_bucket = &old_buckets[i];
-		for (elem = list_begin (old_bucket);
-				elem != list_end (old_bucket); elem = next) {
-			struct list *new_bucket
-				= find_bucket (h, list_elem_to_hash_elem (elem));
-			next = list_next (elem);
-			list_remove (elem);
-			list_push_front (new_bucket, elem);
-		}
-	}
-
-	free (old_buckets);
+	migrate (h);
 }
 
 /* Inserts E into BUCKET (in hash table H). */
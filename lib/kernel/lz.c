@@ -0,0 +1,212 @@
+#include "lz.h"
+#include <stdint.h>
+#include <string.h>
+#include "../debug.h"
+
+/* LZ compression.  See lz.h for the format.
+
+   The compressor hashes the four bytes at each position into a
+   table that remembers the last position with the same hash,
+   and takes the table's candidate as a match if its first four
+   bytes agree, without searching any further.  After each
+   position without a match it steps ahead a little further, so
+   that data that does not compress is skipped through quickly.
+   Positions fit in 16 bits, which bounds the input size and
+   makes the table small. */
+
+/* Log2 of the number of entries in the hash table. */
+#define HASH_BITS 11
+
+/* Steps ahead one byte further after every 1 << SKIP_SHIFT
+   positions in a row without a match. */
+#define SKIP_SHIFT 5
+
+/* Lengths from this value up continue in extra bytes. */
+#define LEN_MORE 15
+
+/* Unaligned words that may alias anything. */
+typedef uint32_t lz_word32 __attribute__ ((may_alias, aligned (1)));
+typedef uint64_t lz_word64 __attribute__ ((may_alias, aligned (1)));
+
+/* Returns the hash table index for the four bytes SEQ. */
+static inline size_t
+hash_seq (uint32_t seq) {
+	return (seq * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Returns the number of extra bytes that a length of LEN needs. */
+static inline size_t
+len_bytes (size_t len) {
+	return len >= LEN_MORE ? (len - LEN_MORE) / 255 + 1 : 0;
+}
+
+/* Writes the extra bytes for a length of LEN at OP and returns
+   the end of what it wrote. */
+static uint8_t *
+put_len (uint8_t *op, size_t len) {
+	if (len >= LEN_MORE) {
+		for (len -= LEN_MORE; len >= 255; len -= 255)
+			*op++ = 255;
+		*op++ = len;
+	}
+	return op;
+}
+
+/* Appends a sequence to the output at OP, which ends at OP_END:
+   the LIT_LEN bytes at LIT, then a match of MATCH_LEN bytes that
+   starts OFFSET bytes back, or no match if MATCH_LEN is 0.
+   Returns the new end of the output, or a null pointer if the
+   sequence does not fit. */
+static uint8_t *
+put_seq (uint8_t *op, uint8_t *op_end, const uint8_t *lit, size_t lit_len,
+		size_t offset, size_t match_len) {
+	size_t m = match_len != 0 ? match_len - LZ_MIN_MATCH : 0;
+	size_t need = 1 + len_bytes (lit_len) + lit_len;
+
+	if (match_len != 0)
+		need += 2 + len_bytes (m);
+	if (need > (size_t) (op_end - op))
+		return NULL;
+
+	*op++ = (lit_len < LEN_MORE ? lit_len : LEN_MORE) << 4
+		| (m < LEN_MORE ? m : LEN_MORE);
+	op = put_len (op, lit_len);
+	memcpy (op, lit, lit_len);
+	op += lit_len;
+	if (match_len != 0) {
+		*op++ = offset;
+		*op++ = offset >> 8;
+		op = put_len (op, m);
+	}
+	return op;
+}
+
+/* Compresses the SIZE bytes at SRC, at most LZ_MAX_SIZE, into
+   the DST_SIZE bytes at DST, using the LZ_WORK_SIZE bytes at WORK
+   as scratch space.  Returns the size of the compressed data, or
+   0 if it does not fit in DST_SIZE bytes.  LZ_BOUND(SIZE) bytes
+   are always enough. */
+size_t
+lz_compress (const void *src_, size_t size, void *dst_, size_t dst_size,
+		void *work) {
+	const uint8_t *src = src_;
+	const uint8_t *end = src + size;
+	const uint8_t *ip = src;
+	const uint8_t *anchor = src;
+	uint8_t *dst = dst_;
+	uint8_t *op = dst;
+	uint8_t *op_end = dst + dst_size;
+	uint16_t *table = work;
+	size_t misses = 0;
+
+	ASSERT (size <= LZ_MAX_SIZE);
+	ASSERT ((sizeof *table << HASH_BITS) <= LZ_WORK_SIZE);
+
+	memset (table, 0, LZ_WORK_SIZE);
+	while (end - ip >= LZ_MIN_MATCH) {
+		uint32_t seq = *(const lz_word32 *) ip;
+		size_t h = hash_seq (seq);
+		const uint8_t *ref = src + table[h];
+		size_t len;
+
+		table[h] = ip - src;
+		if (ref >= ip || *(const lz_word32 *) ref != seq) {
+			ip += 1 + (misses++ >> SKIP_SHIFT);
+			continue;
+		}
+		misses = 0;
+
+		for (len = LZ_MIN_MATCH; ip + len < end && ref[len] == ip[len]; len++)
+			continue;
+		op = put_seq (op, op_end, anchor, ip - anchor, ip - ref, len);
+		if (op == NULL)
+			return 0;
+		ip += len;
+		anchor = ip;
+	}
+
+	op = put_seq (op, op_end, anchor, end - anchor, 0, 0);
+	return op != NULL ? (size_t) (op - dst) : 0;
+}
+
+/* Reads the extra bytes of a length whose token nibble was *LEN
+   from *IP, which ends at IP_END, adding them to *LEN and
+   advancing *IP.  Returns false if the input ends first. */
+static bool
+get_len (const uint8_t **ip, const uint8_t *ip_end, size_t *len) {
+	if (*len == LEN_MORE) {
+		uint8_t b;
+
+		do {
+			if (*ip == ip_end)
+				return false;
+			b = *(*ip)++;
+			*len += b;
+		} while (b == 255);
+	}
+	return true;
+}
+
+/* Copies the LEN bytes that start OFFSET bytes before OP to OP.
+   The two may overlap, in which case the copy repeats the last
+   OFFSET bytes. */
+static void
+copy_match (uint8_t *op, size_t offset, size_t len) {
+	const uint8_t *ref = op - offset;
+
+	/* A word at a time is safe if each word read lies wholly
+	   before the one written. */
+	if (offset >= sizeof (uint64_t))
+		for (; len >= sizeof (uint64_t); len -= sizeof (uint64_t)) {
+			*(lz_word64 *) op = *(const lz_word64 *) ref;
+			op += sizeof (uint64_t);
+			ref += sizeof (uint64_t);
+		}
+	while (len-- > 0)
+		*op++ = *ref++;
+}
+
+/* Decompresses the SIZE bytes at SRC into the DST_SIZE bytes at
+   DST.  Returns true if SRC decompresses to exactly DST_SIZE
+   bytes.  Never reads or writes outside either buffer, even if
+   SRC is corrupt. */
+bool
+lz_decompress (const void *src, size_t size, void *dst_, size_t dst_size) {
+	const uint8_t *ip = src;
+	const uint8_t *ip_end = ip + size;
+	uint8_t *dst = dst_;
+	uint8_t *op = dst;
+	uint8_t *op_end = dst + dst_size;
+
+	while (ip < ip_end) {
+		unsigned token = *ip++;
+		size_t len = token >> 4;
+		size_t offset;
+
+		/* Literals. */
+		if (!get_len (&ip, ip_end, &len)
+				|| len > (size_t) (ip_end - ip) || len > (size_t) (op_end - op))
+			return false;
+		memcpy (op, ip, len);
+		op += len;
+		ip += len;
+		if (ip == ip_end)
+			break;
+
+		/* Match. */
+		if (ip_end - ip < 2)
+			return false;
+		offset = ip[0] | ip[1] << 8;
+		ip += 2;
+		len = token & LEN_MORE;
+		if (!get_len (&ip, ip_end, &len))
+			return false;
+		len += LZ_MIN_MATCH;
+		if (offset == 0 || offset > (size_t) (op - dst)
+				|| len > (size_t) (op_end - op))
+			return false;
+		copy_match (op, offset, len);
+		op += len;
+	}
+	return op == op_end;
+}
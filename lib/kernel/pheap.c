@@ -0,0 +1,192 @@
+#include "pheap.h"
+#include "../debug.h"
+
+/* Pairing heap, as described by Fredman, Sedgewick, Sleator and
+   Tarjan, "The pairing heap: a new form of self-adjusting heap",
+   Algorithmica 1 (1986).
+
+   Every operation is built from meld(), which makes the greater
+   of two roots the first child of the lesser, and from
+   merge_pairs(), which turns a list of siblings back into a
+   single tree after their parent is removed. */
+
+/* Makes the greater of roots A and B, which must not have
+   siblings, the first child of the other, and returns the
+   lesser. */
+static struct pheap_elem *
+meld (struct pheap *h, struct pheap_elem *a, struct pheap_elem *b) {
+	if (h->less (b, a, h->aux)) {
+		struct pheap_elem *t = a;
+		a = b;
+		b = t;
+	}
+
+	b->next = a->child;
+	if (a->child != NULL)
+		a->child->prev = b;
+	b->prev = a;
+	a->child = b;
+	return a;
+}
+
+/* Melds the list of siblings starting at FIRST into one tree, and
+   returns its root, or a null pointer if FIRST is null.
+
+   This is the standard two-pass scheme: meld the siblings in
+   pairs from left to right, then meld the results into one from
+   right to left.  The pairing is what gives the heap its
+   O(lg n) amortized bound. */
+static struct pheap_elem *
+merge_pairs (struct pheap *h, struct pheap_elem *first) {
+	struct pheap_elem *pairs = NULL;
+	struct pheap_elem *root = NULL;
+
+	/* First pass: meld pairs, pushing each result onto PAIRS,
+	   linked through NEXT, so that PAIRS ends up in reverse
+	   order. */
+	while (first != NULL) {
+		struct pheap_elem *a = first;
+		struct pheap_elem *b = a->next;
+
+		a->next = a->prev = NULL;
+		if (b != NULL) {
+			first = b->next;
+			b->next = b->prev = NULL;
+			a = meld (h, a, b);
+		} else
+			first = NULL;
+		a->next = pairs;
+		pairs = a;
+	}
+
+	/* Second pass: meld the results right to left. */
+	while (pairs != NULL) {
+		struct pheap_elem *next = pairs->next;
+
+		pairs->next = NULL;
+		root = root != NULL ? meld (h, root, pairs) : pairs;
+		pairs = next;
+	}
+	return root;
+}
+
+/* Unlinks E, along with its children, from its parent and
+   siblings.  E must not be the root. */
+static void
+detach (struct pheap_elem *e) {
+	if (e->prev->child == e)
+		e->prev->child = e->next;
+	else
+		e->prev->next = e->next;
+	if (e->next != NULL)
+		e->next->prev = e->prev;
+	e->next = e->prev = NULL;
+}
+
+/* Initializes H as an empty heap ordered by LESS, given
+   auxiliary data AUX. */
+void
+pheap_init (struct pheap *h, pheap_less_func *less, void *aux) {
+	ASSERT (h != NULL);
+	ASSERT (less != NULL);
+
+	h->root = NULL;
+	h->size = 0;
+	h->less = less;
+	h->aux = aux;
+}
+
+/* Inserts E into H. */
+void
+pheap_push (struct pheap *h, struct pheap_elem *e) {
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+
+	e->child = e->next = e->prev = NULL;
+	h->root = h->root != NULL ? meld (h, h->root, e) : e;
+	h->size++;
+}
+
+/* Removes and returns the least element of H, which must not be
+   empty. */
+struct pheap_elem *
+pheap_pop_min (struct pheap *h) {
+	struct pheap_elem *min = h->root;
+
+	ASSERT (min != NULL);
+
+	h->root = merge_pairs (h, min->child);
+	h->size--;
+	min->child = NULL;
+	return min;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+pheap_remove (struct pheap *h, struct pheap_elem *e) {
+	struct pheap_elem *sub;
+
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+
+	if (e == h->root) {
+		pheap_pop_min (h);
+		return;
+	}
+
+	detach (e);
+	sub = merge_pairs (h, e->child);
+	e->child = NULL;
+	if (sub != NULL)
+		h->root = meld (h, h->root, sub);
+	h->size--;
+}
+
+/* Restores the heap order after the key of E, which must be in
+   H, has decreased.  (For a key that increased, remove the
+   element and push it again.) */
+void
+pheap_decrease (struct pheap *h, struct pheap_elem *e) {
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+
+	if (e == h->root)
+		return;
+	detach (e);
+	h->root = meld (h, h->root, e);
+}
+
+/* Moves all the elements of FROM into TO, leaving FROM empty.
+   The two heaps must have the same LESS function. */
+void
+pheap_merge (struct pheap *to, struct pheap *from) {
+	ASSERT (to != NULL);
+	ASSERT (from != NULL);
+	ASSERT (to->less == from->less);
+
+	if (from->root == NULL)
+		return;
+	to->root = to->root != NULL ? meld (to, to->root, from->root) : from->root;
+	to->size += from->size;
+	from->root = NULL;
+	from->size = 0;
+}
+
+/* Returns the least element of H, or a null pointer if H is
+   empty. */
+struct pheap_elem *
+pheap_min (const struct pheap *h) {
+	return h->root;
+}
+
+/* Returns the number of elements in H. */
+size_t
+pheap_size (const struct pheap *h) {
+	return h->size;
+}
+
+/* Returns true if H is empty, false otherwise. */
+bool
+pheap_empty (const struct pheap *h) {
+	return h->root == NULL;
+}
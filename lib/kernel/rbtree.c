@@ -0,0 +1,546 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+/* Red-black tree, following the algorithms in [CLRS] chapter 13,
+   with null pointers in place of the sentinel leaf.
+
+   The tree maintains these invariants:
+
+   1. The root is black.
+
+   2. A red element has no red child.
+
+   3. Every path from an element down to a null child passes
+      through the same number of black elements.
+
+   Together they keep the longest path from the root at most
+   twice as long as the shortest, so the height is O(lg n).
+
+   For augmented trees, every change to the shape of the tree
+   recomputes the augmented value of each element whose subtree
+   changed, from the bottom up: the two elements in a rotation,
+   and the path from the point of insertion or removal to the
+   root. */
+
+/* Returns true if E is red.  Null children are black. */
+static inline bool
+is_red (const struct rb_elem *e) {
+	return e != NULL && e->red;
+}
+
+/* Recomputes E's augmented value, if T is augmented. */
+static inline void
+augment (struct rb_tree *t, struct rb_elem *e) {
+	if (t->augment != NULL)
+		t->augment (e);
+}
+
+/* Recomputes the augmented values of E and all its ancestors, if
+   T is augmented. */
+static void
+augment_path (struct rb_tree *t, struct rb_elem *e) {
+	if (t->augment != NULL)
+		for (; e != NULL; e = e->parent)
+			t->augment (e);
+}
+
+/* Makes NEW take OLD's place as the child of PARENT, or as the
+   root of T if PARENT is null. */
+static void
+replace_child (struct rb_tree *t, struct rb_elem *parent,
+		struct rb_elem *old, struct rb_elem *new) {
+	if (parent == NULL)
+		t->root = new;
+	else if (parent->left == old)
+		parent->left = new;
+	else
+		parent->right = new;
+}
+
+/* Rotates X's right child up into X's place:
+
+       X              Y
+      / \            / \
+     a   Y    =>    X   c
+        / \        / \
+       b   c      a   b  */
+static void
+rotate_left (struct rb_tree *t, struct rb_elem *x) {
+	struct rb_elem *y = x->right;
+
+	x->right = y->left;
+	if (y->left != NULL)
+		y->left->parent = x;
+	y->parent = x->parent;
+	replace_child (t, x->parent, x, y);
+	y->left = x;
+	x->parent = y;
+
+	augment (t, x);
+	augment (t, y);
+}
+
+/* Rotates X's left child up into X's place; the mirror image of
+   rotate_left(). */
+static void
+rotate_right (struct rb_tree *t, struct rb_elem *x) {
+	struct rb_elem *y = x->left;
+
+	x->left = y->right;
+	if (y->right != NULL)
+		y->right->parent = x;
+	y->parent = x->parent;
+	replace_child (t, x->parent, x, y);
+	y->right = x;
+	x->parent = y;
+
+	augment (t, x);
+	augment (t, y);
+}
+
+/* Initializes T as an empty tree whose elements are ordered by
+   LESS, given auxiliary data AUX. */
+void
+rb_init (struct rb_tree *t, rb_less_func *less, void *aux) {
+	rb_init_augmented (t, less, NULL, aux);
+}
+
+/* Initializes T as an empty tree whose elements are ordered by
+   LESS, given auxiliary data AUX, and whose augmented values are
+   maintained by AUGMENT. */
+void
+rb_init_augmented (struct rb_tree *t, rb_less_func *less,
+		rb_augment_func *augment, void *aux) {
+	ASSERT (t != NULL);
+	ASSERT (less != NULL);
+
+	t->root = NULL;
+	t->size = 0;
+	t->less = less;
+	t->augment = augment;
+	t->aux = aux;
+}
+
+/* Inserts E into T, after any elements equal to it. */
+void
+rb_insert (struct rb_tree *t, struct rb_elem *e) {
+	struct rb_elem *parent = NULL;
+	struct rb_elem **link = &t->root;
+
+	ASSERT (t != NULL);
+	ASSERT (e != NULL);
+
+	while (*link != NULL) {
+		parent = *link;
+		link = t->less (e, parent, t->aux) ? &parent->left : &parent->right;
+	}
+	e->parent = parent;
+	e->left = e->right = NULL;
+	e->red = true;
+	*link = e;
+	t->size++;
+	augment_path (t, e);
+
+	/* Fix up invariant 2, moving a red-red violation up the tree
+	   until it can be removed by one or two rotations. */
+	while (is_red (e->parent)) {
+		struct rb_elem *p = e->parent;
+		struct rb_elem *g = p->parent;
+
+		if (p == g->left) {
+			struct rb_elem *uncle = g->right;
+			if (is_red (uncle)) {
+				p->red = uncle->red = false;
+				g->red = true;
+				e = g;
+				continue;
+			}
+			if (e == p->right) {
+				rotate_left (t, p);
+				e = p;
+				p = e->parent;
+			}
+			p->red = false;
+			g->red = true;
+			rotate_right (t, g);
+		} else {
+			struct rb_elem *uncle = g->left;
+			if (is_red (uncle)) {
+				p->red = uncle->red = false;
+				g->red = true;
+				e = g;
+				continue;
+			}
+			if (e == p->left) {
+				rotate_right (t, p);
+				e = p;
+				p = e->parent;
+			}
+			p->red = false;
+			g->red = true;
+			rotate_left (t, g);
+		}
+	}
+	t->root->red = false;
+}
+
+/* Puts V, which may be null, in U's place in T.  U's children
+   are left alone. */
+static void
+transplant (struct rb_tree *t, struct rb_elem *u, struct rb_elem *v) {
+	replace_child (t, u->parent, u, v);
+	if (v != NULL)
+		v->parent = u->parent;
+}
+
+/* Returns the leftmost element in the subtree rooted at E. */
+static struct rb_elem *
+subtree_min (struct rb_elem *e) {
+	while (e->left != NULL)
+		e = e->left;
+	return e;
+}
+
+/* Returns the rightmost element in the subtree rooted at E. */
+static struct rb_elem *
+subtree_max (struct rb_elem *e) {
+	while (e->right != NULL)
+		e = e->right;
+	return e;
+}
+
+/* Removes E, which must be in T, from T. */
+void
+rb_remove (struct rb_tree *t, struct rb_elem *e) {
+	struct rb_elem *x, *parent;
+	bool removed_red = e->red;
+
+	ASSERT (t != NULL);
+	ASSERT (e != NULL);
+	ASSERT (t->size > 0);
+
+	/* Unlink E, or if it has two children, its successor Y, which
+	   then takes E's place.  X is the child that moves into the
+	   unlinked element's place and PARENT is its new parent. */
+	if (e->left == NULL) {
+		x = e->right;
+		parent = e->parent;
+		transplant (t, e, x);
+	} else if (e->right == NULL) {
+		x = e->left;
+		parent = e->parent;
+		transplant (t, e, x);
+	} else {
+		struct rb_elem *y = subtree_min (e->right);
+
+		removed_red = y->red;
+		x = y->right;
+		if (y->parent == e)
+			parent = y;
+		else {
+			parent = y->parent;
+			transplant (t, y, x);
+			y->right = e->right;
+			y->right->parent = y;
+		}
+		transplant (t, e, y);
+		y->left = e->left;
+		y->left->parent = y;
+		y->red = e->red;
+	}
+	t->size--;
+	augment_path (t, parent);
+
+	if (removed_red)
+		return;
+
+	/* Removing a black element shortened the paths through X by
+	   one black element.  Fix up invariant 3. */
+	while (x != t->root && !is_red (x)) {
+		if (x == parent->left) {
+			struct rb_elem *w = parent->right;
+			if (is_red (w)) {
+				w->red = false;
+				parent->red = true;
+				rotate_left (t, parent);
+				w = parent->right;
+			}
+			if (!is_red (w->left) && !is_red (w->right)) {
+				w->red = true;
+				x = parent;
+				parent = x->parent;
+			} else {
+				if (!is_red (w->right)) {
+					w->left->red = false;
+					w->red = true;
+					rotate_right (t, w);
+					w = parent->right;
+				}
+				w->red = parent->red;
+				parent->red = false;
+				w->right->red = false;
+				rotate_left (t, parent);
+				x = t->root;
+			}
+		} else {
+			struct rb_elem *w = parent->left;
+			if (is_red (w)) {
+				w->red = false;
+				parent->red = true;
+				rotate_right (t, parent);
+				w = parent->left;
+			}
+			if (!is_red (w->left) && !is_red (w->right)) {
+				w->red = true;
+				x = parent;
+				parent = x->parent;
+			} else {
+				if (!is_red (w->left)) {
+					w->right->red = false;
+					w->red = true;
+					rotate_left (t, w);
+					w = parent->left;
+				}
+				w->red = parent->red;
+				parent->red = false;
+				w->left->red = false;
+				rotate_right (t, parent);
+				x = t->root;
+			}
+		}
+	}
+	if (x != NULL)
+		x->red = false;
+}
+
+/* Returns an element of T equal to KEY, or a null pointer if
+   there is none.  KEY need not be in T; it only has to be
+   comparable with T's elements. */
+struct rb_elem *
+rb_find (const struct rb_tree *t, const struct rb_elem *key) {
+	struct rb_elem *e = t->root;
+
+	while (e != NULL) {
+		if (t->less (key, e, t->aux))
+			e = e->left;
+		else if (t->less (e, key, t->aux))
+			e = e->right;
+		else
+			return e;
+	}
+	return NULL;
+}
+
+/* Returns the first element of T that is not less than KEY, or a
+   null pointer if there is none. */
+struct rb_elem *
+rb_lower_bound (const struct rb_tree *t, const struct rb_elem *key) {
+	struct rb_elem *e = t->root;
+	struct rb_elem *found = NULL;
+
+	while (e != NULL)
+		if (t->less (e, key, t->aux))
+			e = e->right;
+		else {
+			found = e;
+			e = e->left;
+		}
+	return found;
+}
+
+/* Returns the first element of T that is greater than KEY, or a
+   null pointer if there is none. */
+struct rb_elem *
+rb_upper_bound (const struct rb_tree *t, const struct rb_elem *key) {
+	struct rb_elem *e = t->root;
+	struct rb_elem *found = NULL;
+
+	while (e != NULL)
+		if (t->less (key, e, t->aux)) {
+			found = e;
+			e = e->left;
+		} else
+			e = e->right;
+	return found;
+}
+
+/* Returns the least element of T, or a null pointer if T is
+   empty. */
+struct rb_elem *
+rb_min (const struct rb_tree *t) {
+	return t->root != NULL ? subtree_min (t->root) : NULL;
+}
+
+/* Returns the greatest element of T, or a null pointer if T is
+   empty. */
+struct rb_elem *
+rb_max (const struct rb_tree *t) {
+	return t->root != NULL ? subtree_max (t->root) : NULL;
+}
+
+/* Returns the element after E in its tree, or a null pointer if
+   E is the last element. */
+struct rb_elem *
+rb_next (const struct rb_elem *e) {
+	ASSERT (e != NULL);
+
+	if (e->right != NULL)
+		return subtree_min (e->right);
+	while (e->parent != NULL && e == e->parent->right)
+		e = e->parent;
+	return e->parent;
+}
+
+/* Returns the element before E in its tree, or a null pointer if
+   E is the first element. */
+struct rb_elem *
+rb_prev (const struct rb_elem *e) {
+	ASSERT (e != NULL);
+
+	if (e->left != NULL)
+		return subtree_max (e->left);
+	while (e->parent != NULL && e == e->parent->left)
+		e = e->parent;
+	return e->parent;
+}
+
+/* Returns the number of elements in T. */
+size_t
+rb_size (const struct rb_tree *t) {
+	return t->size;
+}
+
+/* Returns true if T is empty, false otherwise. */
+bool
+rb_empty (const struct rb_tree *t) {
+	return t->root == NULL;
+}
+
+/* Interval tree. */
+
+#define to_interval(RB_ELEM) \
+	rb_entry (RB_ELEM, struct interval_elem, rb_elem)
+
+/* Orders intervals by start, then by end. */
+static bool
+interval_less (const struct rb_elem *a_, const struct rb_elem *b_,
+		void *aux UNUSED) {
+	const struct interval_elem *a = to_interval (a_);
+	const struct interval_elem *b = to_interval (b_);
+
+	return a->start != b->start ? a->start < b->start : a->end < b->end;
+}
+
+/* Recomputes the largest end in E's subtree. */
+static void
+interval_augment (struct rb_elem *e) {
+	struct interval_elem *i = to_interval (e);
+
+	i->max_end = i->end;
+	if (e->left != NULL && to_interval (e->left)->max_end > i->max_end)
+		i->max_end = to_interval (e->left)->max_end;
+	if (e->right != NULL && to_interval (e->right)->max_end > i->max_end)
+		i->max_end = to_interval (e->right)->max_end;
+}
+
+/* Initializes T as an empty interval tree. */
+void
+interval_tree_init (struct interval_tree *t) {
+	rb_init_augmented (&t->tree, interval_less, interval_augment, NULL);
+}
+
+/* Inserts interval I, whose START and END must be set, into T.
+   Intervals may overlap. */
+void
+interval_tree_insert (struct interval_tree *t, struct interval_elem *i) {
+	ASSERT (i->start <= i->end);
+
+	i->max_end = i->end;
+	rb_insert (&t->tree, &i->rb_elem);
+}
+
+/* Removes interval I, which must be in T, from T. */
+void
+interval_tree_remove (struct interval_tree *t, struct interval_elem *i) {
+	rb_remove (&t->tree, &i->rb_elem);
+}
+
+/* Returns true if interval I overlaps [START, END). */
+static inline bool
+overlaps (const struct interval_elem *i, uint64_t start, uint64_t end) {
+	return i->start < end && start < i->end;
+}
+
+/* Returns the first interval, in order of start, in the subtree
+   rooted at E that overlaps [START, END), or a null pointer if
+   there is none. */
+static struct interval_elem *
+subtree_first_overlap (struct rb_elem *e, uint64_t start, uint64_t end) {
+	while (e != NULL) {
+		struct interval_elem *i = to_interval (e);
+
+		/* If anything in the left subtree ends after START, go
+		   left: if none of those intervals overlap, they all
+		   start at or after END, and so does everything else in
+		   this subtree. */
+		if (e->left != NULL && to_interval (e->left)->max_end > start)
+			e = e->left;
+		else if (i->start >= end)
+			return NULL;
+		else if (i->end > start)
+			return i;
+		else if (e->right != NULL && to_interval (e->right)->max_end > start)
+			e = e->right;
+		else
+			return NULL;
+	}
+	return NULL;
+}
+
+/* Returns the first interval in T, in order of start, that
+   overlaps [START, END), or a null pointer if there is none.
+   Together with interval_tree_next(), iterates over all the
+   intervals that overlap [START, END):
+
+   for (i = interval_tree_first (t, start, end); i != NULL;
+        i = interval_tree_next (i, start, end))
+     ...
+ */
+struct interval_elem *
+interval_tree_first (struct interval_tree *t, uint64_t start, uint64_t end) {
+	return subtree_first_overlap (t->tree.root, start, end);
+}
+
+/* Returns the interval after I, in order of start, that overlaps
+   [START, END), or a null pointer if there is none. */
+struct interval_elem *
+interval_tree_next (struct interval_elem *i, uint64_t start, uint64_t end) {
+	struct rb_elem *e = &i->rb_elem;
+
+	for (;;) {
+		struct rb_elem *prev;
+		struct interval_elem *found;
+
+		/* Everything in the right subtree comes next. */
+		if (e->right != NULL && to_interval (e->right)->max_end > start) {
+			found = subtree_first_overlap (e->right, start, end);
+			if (found != NULL)
+				return found;
+		}
+
+		/* Then the first ancestor of which E is in the left
+		   subtree. */
+		do {
+			prev = e;
+			e = e->parent;
+			if (e == NULL)
+				return NULL;
+		} while (prev == e->right);
+
+		i = to_interval (e);
+		if (i->start >= end)
+			return NULL;
+		if (i->end > start)
+			return i;
+	}
+}
@@ -0,0 +1,360 @@
+/* Open-addressing hash table.
+
+   See rhash.h for basic information.
+
+   The table is an array of slots whose size is a power of 2.  An
+   element's home slot is chosen from the high bits of its hash
+   value multiplied by a large odd constant, which spreads even
+   poor hash values such as small integers over the whole table.
+   From there, the element lives in the first slot of its probe
+   sequence, home, home + 1, ..., that Robin Hood insertion gives
+   it.  Each slot records how far its element is from home.
+
+   Robin Hood insertion keeps the elements along any stretch of
+   slots ordered by home slot.  Thus a lookup can stop as soon as
+   it reaches an element closer to its home than the lookup is to
+   its own, without reaching an empty slot, and deletion can fill
+   the hole by shifting the following elements back one slot
+   instead of leaving a tombstone. */
+
+#include "rhash.h"
+#include "../debug.h"
+#include <string.h>
+#include "threads/malloc.h"
+
+/* Smallest number of slots in a table. */
+#define MIN_SLOT_CNT 8
+
+/* Load factor limits, in eighths of the slots in use. */
+#define MAX_LOAD 7      /* Load > 7/8: double the number of slots. */
+#define MIN_LOAD 1      /* Load < 1/8: halve the number of slots. */
+
+static size_t find_slot (struct rhash *, struct rhash_elem *, uint64_t hash);
+static void place (struct rhash *, struct rhash_elem *);
+static void remove_slot (struct rhash *, size_t idx);
+static bool resize (struct rhash *, size_t slot_cnt);
+static bool make_room (struct rhash *);
+
+/* Initializes hash table H to compute hash values using HASH and
+   compare hash elements using LESS, given auxiliary data AUX.
+   Returns false if memory allocation failed. */
+bool
+rhash_init (struct rhash *h,
+		rhash_hash_func *hash, rhash_less_func *less, void *aux) {
+	h->elem_cnt = 0;
+	h->slots = NULL;
+	h->hash = hash;
+	h->less = less;
+	h->aux = aux;
+	return resize (h, MIN_SLOT_CNT);
+}
+
+/* Removes all the elements from H.
+
+   If DESTRUCTOR is non-null, then it is called for each element
+   in the hash.  DESTRUCTOR may, if appropriate, deallocate the
+   memory used by the hash element.  However, modifying hash
+   table H while rhash_clear() is running, using any of the
+   functions rhash_clear(), rhash_destroy(), rhash_insert(),
+   rhash_replace(), or rhash_delete(), yields undefined behavior,
+   whether done in DESTRUCTOR or elsewhere. */
+void
+rhash_clear (struct rhash *h, rhash_action_func *destructor) {
+	if (destructor != NULL)
+		rhash_apply (h, destructor);
+	memset (h->slots, 0, sizeof *h->slots * h->slot_cnt);
+	h->elem_cnt = 0;
+}
+
+/* Destroys hash table H.
+
+   If DESTRUCTOR is non-null, then it is first called for each
+   element in the hash, as described for rhash_clear(). */
+void
+rhash_destroy (struct rhash *h, rhash_action_func *destructor) {
+	if (destructor != NULL)
+		rhash_clear (h, destructor);
+	free (h->slots);
+}
+
+/* Inserts NEW into hash table H and returns a null pointer, if
+   no equal element is already in the table.
+   If an equal element is already in the table, returns it
+   without inserting NEW.
+   Unlike hash_insert(), this can fail for lack of memory to
+   grow the table, in which case NEW itself is returned and is
+   not inserted. */
+struct rhash_elem *
+rhash_insert (struct rhash *h, struct rhash_elem *new) {
+	uint64_t hash = h->hash (new, h->aux);
+	size_t idx = find_slot (h, new, hash);
+
+	if (idx != SIZE_MAX)
+		return h->slots[idx].elem;
+	if (!make_room (h))
+		return new;
+
+	new->hash = hash;
+	place (h, new);
+	h->elem_cnt++;
+	return NULL;
+}
+
+/* Inserts NEW into hash table H, replacing any equal element
+   already in the table, which is returned.
+   As with rhash_insert(), returns NEW without inserting it if
+   the table needed to grow and could not. */
+struct rhash_elem *
+rhash_replace (struct rhash *h, struct rhash_elem *new) {
+	uint64_t hash = h->hash (new, h->aux);
+	size_t idx = find_slot (h, new, hash);
+	struct rhash_elem *old;
+
+	new->hash = hash;
+	if (idx != SIZE_MAX) {
+		old = h->slots[idx].elem;
+		h->slots[idx].elem = new;
+		return old;
+	}
+	if (!make_room (h))
+		return new;
+
+	place (h, new);
+	h->elem_cnt++;
+	return NULL;
+}
+
+/* Finds and returns an element equal to E in hash table H, or a
+   null pointer if no equal element exists in the table. */
+struct rhash_elem *
+rhash_find (struct rhash *h, struct rhash_elem *e) {
+	size_t idx = find_slot (h, e, h->hash (e, h->aux));
+	return idx != SIZE_MAX ? h->slots[idx].elem : NULL;
+}
+
+/* Finds, removes, and returns an element equal to E in hash
+   table H.  Returns a null pointer if no equal element existed
+   in the table.
+
+   If the elements of the hash table are dynamically allocated,
+   or own resources that are, then it is the caller's
+   responsibility to deallocate them. */
+struct rhash_elem *
+rhash_delete (struct rhash *h, struct rhash_elem *e) {
+	size_t idx = find_slot (h, e, h->hash (e, h->aux));
+	struct rhash_elem *found;
+
+	if (idx == SIZE_MAX)
+		return NULL;
+
+	found = h->slots[idx].elem;
+	remove_slot (h, idx);
+	h->elem_cnt--;
+
+	/* Shrinking can fail, but that only wastes memory. */
+	if (h->slot_cnt > MIN_SLOT_CNT && h->elem_cnt * 8 < h->slot_cnt * MIN_LOAD)
+		resize (h, h->slot_cnt / 2);
+	return found;
+}
+
+/* Calls ACTION for each element in hash table H in arbitrary
+   order.
+   Modifying hash table H while rhash_apply() is running, using
+   any of the functions rhash_clear(), rhash_destroy(),
+   rhash_insert(), rhash_replace(), or rhash_delete(), yields
+   undefined behavior, whether done from ACTION or elsewhere. */
+void
+rhash_apply (struct rhash *h, rhash_action_func *action) {
+	size_t i;
+
+	ASSERT (action != NULL);
+
+	for (i = 0; i < h->slot_cnt; i++)
+		if (h->slots[i].dist != 0)
+			action (h->slots[i].elem, h->aux);
+}
+
+/* Initializes I for iterating hash table H.
+
+   Iteration idiom:
+
+   struct rhash_iterator i;
+
+   rhash_first (&i, h);
+   while (rhash_next (&i))
+   {
+   struct foo *f = rhash_entry (rhash_cur (&i), struct foo, elem);
+   ...do something with f...
+   }
+
+   Modifying hash table H during iteration, using any of the
+   functions rhash_clear(), rhash_destroy(), rhash_insert(),
+   rhash_replace(), or rhash_delete(), invalidates all
+   iterators. */
+void
+rhash_first (struct rhash_iterator *i, struct rhash *h) {
+	ASSERT (i != NULL);
+	ASSERT (h != NULL);
+
+	i->hash = h;
+	i->idx = SIZE_MAX;
+	i->elem = NULL;
+}
+
+/* Advances I to the next element in the hash table and returns
+   it.  Returns a null pointer if no elements are left.  Elements
+   are returned in arbitrary order. */
+struct rhash_elem *
+rhash_next (struct rhash_iterator *i) {
+	struct rhash *h;
+
+	ASSERT (i != NULL);
+
+	h = i->hash;
+	i->elem = NULL;
+	for (i->idx++; i->idx < h->slot_cnt; i->idx++)
+		if (h->slots[i->idx].dist != 0) {
+			i->elem = h->slots[i->idx].elem;
+			break;
+		}
+	return i->elem;
+}
+
+/* Returns the current element in the hash table iteration, or a
+   null pointer at the end of the table.  Undefined behavior
+   after calling rhash_first() but before rhash_next(). */
+struct rhash_elem *
+rhash_cur (struct rhash_iterator *i) {
+	return i->elem;
+}
+
+/* Returns the number of elements in H. */
+size_t
+rhash_size (struct rhash *h) {
+	return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+rhash_empty (struct rhash *h) {
+	return h->elem_cnt == 0;
+}
+
+/* Returns the home slot in H for an element with hash value
+   HASH. */
+static inline size_t
+home_slot (const struct rhash *h, uint64_t hash) {
+	return (hash * 0x9e3779b97f4a7c15ULL) >> h->shift;
+}
+
+/* Returns the index of the slot in H that holds an element equal
+   to E, whose hash value is HASH, or SIZE_MAX if there is none. */
+static size_t
+find_slot (struct rhash *h, struct rhash_elem *e, uint64_t hash) {
+	size_t mask = h->slot_cnt - 1;
+	size_t idx = home_slot (h, hash);
+	uint32_t fingerprint = hash;
+	uint32_t dist;
+
+	/* There is always an empty slot, so this terminates. */
+	for (dist = 1; ; dist++, idx = (idx + 1) & mask) {
+		struct rhash_slot *s = &h->slots[idx];
+
+		/* An empty slot, or one whose element is closer to its
+		   home than E would be, ends E's probe sequence. */
+		if (s->dist < dist)
+			return SIZE_MAX;
+		if (s->fingerprint == fingerprint
+				&& !h->less (s->elem, e, h->aux)
+				&& !h->less (e, s->elem, h->aux))
+			return idx;
+	}
+}
+
+/* Puts E, which must not already be in H, into H's slots.
+   E->hash must be E's hash value, and H must have an empty slot.
+   Does not update H's element count. */
+static void
+place (struct rhash *h, struct rhash_elem *e) {
+	size_t mask = h->slot_cnt - 1;
+	size_t idx = home_slot (h, e->hash);
+	struct rhash_slot cur = { (uint32_t) e->hash, 1, e };
+
+	for (; ; cur.dist++, idx = (idx + 1) & mask) {
+		struct rhash_slot *s = &h->slots[idx];
+
+		if (s->dist == 0) {
+			*s = cur;
+			return;
+		}
+
+		/* Take the slot from an element closer to its home, and
+		   go on to find a slot for that element instead. */
+		if (s->dist < cur.dist) {
+			struct rhash_slot tmp = *s;
+			*s = cur;
+			cur = tmp;
+		}
+	}
+}
+
+/* Empties slot IDX in H, shifting the elements that follow it in
+   their probe sequences back by one slot.  Does not update H's
+   element count. */
+static void
+remove_slot (struct rhash *h, size_t idx) {
+	size_t mask = h->slot_cnt - 1;
+	size_t next;
+
+	for (next = (idx + 1) & mask; h->slots[next].dist > 1;
+			idx = next, next = (next + 1) & mask) {
+		h->slots[idx] = h->slots[next];
+		h->slots[idx].dist--;
+	}
+	h->slots[idx].dist = 0;
+	h->slots[idx].elem = NULL;
+}
+
+/* Changes the number of slots in H to SLOT_CNT, a power of 2
+   large enough to hold H's elements.  Returns false, leaving H
+   unchanged, if memory allocation fails. */
+static bool
+resize (struct rhash *h, size_t slot_cnt) {
+	struct rhash_slot *old_slots = h->slots;
+	size_t old_slot_cnt = old_slots != NULL ? h->slot_cnt : 0;
+	struct rhash_slot *new_slots;
+	size_t i;
+
+	ASSERT (slot_cnt >= MIN_SLOT_CNT);
+	ASSERT ((slot_cnt & (slot_cnt - 1)) == 0);
+	ASSERT (h->elem_cnt < slot_cnt);
+
+	new_slots = calloc (slot_cnt, sizeof *new_slots);
+	if (new_slots == NULL)
+		return false;
+
+	h->slots = new_slots;
+	h->slot_cnt = slot_cnt;
+	for (h->shift = 64; slot_cnt > 1; slot_cnt >>= 1)
+		h->shift--;
+
+	/* Elements keep their hash values, so there is no need to
+	   call the hash function again. */
+	for (i = 0; i < old_slot_cnt; i++)
+		if (old_slots[i].dist != 0)
+			place (h, old_slots[i].elem);
+	free (old_slots);
+	return true;
+}
+
+/* Makes sure that H has room for one more element, growing it if
+   it is getting full.  Returns false if H is out of room and
+   cannot grow. */
+static bool
+make_room (struct rhash *h) {
+	if ((h->elem_cnt + 1) * 8 > h->slot_cnt * MAX_LOAD)
+		resize (h, h->slot_cnt * 2);
+
+	/* Always keep a slot empty, so that probes terminate. */
+	return h->elem_cnt + 1 < h->slot_cnt;
+}
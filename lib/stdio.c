@@ -129,9 +129,25 @@ static const struct integer_base base_o = {8, "01234567", 0, 3};
 static const struct integer_base base_x = {16, "0123456789abcdef", 'x', 4};
 static const struct integer_base base_X = {16, "0123456789ABCDEF", 'X', 4};
 
+/* Pairs of decimal digits "00" through "99", so that decimal
+   conversion can produce two digits per division. */
+static const char digit_pairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
 static const char *parse_conversion (const char *format,
 		struct printf_conversion *,
 		va_list *);
+static char *put_digits (uintmax_t value, const struct integer_base *,
+		char *cp);
 static void format_integer (uintmax_t value, bool is_signed, bool negative,
 		const struct integer_base *,
 		const struct printf_conversion *,
@@ -467,14 +483,17 @@ format_integer (uintmax_t value, bool is_signed, bool negative,
 	   This algorithm produces digits in reverse order, so later we
 	   will output the buffer's content in reverse. */
 	cp = buf;
-	digit_cnt = 0;
-	while (value > 0) {
-		if ((c->flags & GROUP) && digit_cnt > 0 && digit_cnt % b->group == 0)
-			*cp++ = ',';
-		*cp++ = b->digits[value % b->base];
-		value /= b->base;
-		digit_cnt++;
-	}
+	if (c->flags & GROUP) {
+		digit_cnt = 0;
+		while (value > 0) {
+			if (digit_cnt > 0 && digit_cnt % b->group == 0)
+				*cp++ = ',';
+			*cp++ = b->digits[value % b->base];
+			value /= b->base;
+			digit_cnt++;
+		}
+	} else
+		cp = put_digits (value, b, cp);
 
 	/* Append enough zeros to match precision.
 	   If requested precision is 0, then a value of zero is
@@ -509,6 +528,56 @@ format_integer (uintmax_t value, bool is_signed, bool negative,
 		output_dup (' ', pad_cnt, output, aux);
 }
 
+/* Stores the digits of VALUE in base B at CP, least significant
+   digit first, and returns the end of the digits.  Stores nothing
+   if VALUE is 0.
+
+   Decimal conversion takes two digits from digit_pairs per
+   division by 100, which the compiler turns into a
+   multiplication.  Hexadecimal conversion produces a byte's two
+   digits per step and octal one digit per step, using shifts
+   instead of dividing by the base. */
+static char *
+put_digits (uintmax_t value, const struct integer_base *b, char *cp) {
+	switch (b->base) {
+		case 10:
+			while (value >= 100) {
+				uintmax_t q = value / 100;
+				const char *pair = digit_pairs + (value - q * 100) * 2;
+
+				*cp++ = pair[1];
+				*cp++ = pair[0];
+				value = q;
+			}
+			if (value >= 10) {
+				*cp++ = digit_pairs[value * 2 + 1];
+				*cp++ = digit_pairs[value * 2];
+			} else if (value > 0)
+				*cp++ = '0' + value;
+			break;
+
+		case 16:
+			for (; value > 0xf; value >>= 8) {
+				*cp++ = b->digits[value & 0xf];
+				*cp++ = b->digits[(value >> 4) & 0xf];
+			}
+			if (value > 0)
+				*cp++ = b->digits[value];
+			break;
+
+		case 8:
+			for (; value > 0; value >>= 3)
+				*cp++ = b->digits[value & 7];
+			break;
+
+		default:
+			for (; value > 0; value /= b->base)
+				*cp++ = b->digits[value % b->base];
+			break;
+	}
+	return cp;
+}
+
 /* Writes CH to OUTPUT with auxiliary data AUX, CNT times. */
 static void
 output_dup (char ch, size_t cnt, void (*output) (char, void *), void *aux) {
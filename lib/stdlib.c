@@ -1,43 +1,138 @@
 #include <ctype.h>
 #include <debug.h>
+#include <limits.h>
 #include <random.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* Converts a string representation of a signed decimal integer
    in S into an `int', which is returned. */
 int
 atoi (const char *s) 
 {
-  bool negative;
-  int value;
+  ASSERT (s != NULL);
+
+  return strtol (s, NULL, 10);
+}
+
+/* Parses the digits of an unsigned integer in BASE, which is 0
+   or between 2 and 36, from S, after any white space and sign.
+   Stores the value, clamped to ULONG_MAX, in *VALUE and a pointer
+   to the first character not parsed in *END, sets *NEGATIVE to
+   whether there was a minus sign, and returns true if the value
+   was clamped.  If there are no digits, stores the original S in
+   *END.
+
+   A BASE of 0 means base 16 if the digits start with "0x" or
+   "0X", base 8 if they start with "0", and base 10 otherwise.
+   Base 16 also accepts a "0x" or "0X" prefix. */
+static bool
+parse_ulong (const char *s, int base, unsigned long *value, char **end,
+             bool *negative)
+{
+  const char *start = s;
+  unsigned long cutoff;
+  bool overflow = false;
+  bool any = false;
+  unsigned cutlim;
 
   ASSERT (s != NULL);
+  ASSERT (base == 0 || (base >= 2 && base <= 36));
 
   /* Skip white space. */
   while (isspace ((unsigned char) *s))
     s++;
 
   /* Parse sign. */
-  negative = false;
+  *negative = false;
   if (*s == '+')
     s++;
   else if (*s == '-')
     {
-      negative = true;
+      *negative = true;
       s++;
     }
 
-  /* Parse digits.  We always initially parse the value as
-     negative, and then make it positive later, because the
-     negative range of an int is bigger than the positive range
-     on a 2's complement system. */
-  for (value = 0; isdigit (*s); s++)
-    value = value * 10 - (*s - '0');
-  if (!negative)
-    value = -value;
+  /* Parse prefix.  Skip "0x" only if a hex digit follows, so
+     that "0x" alone parses as 0 followed by "x". */
+  if ((base == 0 || base == 16) && s[0] == '0'
+      && (s[1] == 'x' || s[1] == 'X') && isxdigit ((unsigned char) s[2]))
+    {
+      s += 2;
+      base = 16;
+    }
+  else if (base == 0)
+    base = s[0] == '0' ? 8 : 10;
+
+  /* Parse digits, stopping accumulation once the next digit
+     would overflow, which is when the value exceeds CUTOFF or
+     equals it and the digit exceeds CUTLIM. */
+  cutoff = ULONG_MAX / base;
+  cutlim = ULONG_MAX % base;
+  *value = 0;
+  for (;; s++)
+    {
+      unsigned digit;
+
+      if (isdigit ((unsigned char) *s))
+        digit = *s - '0';
+      else if (isalpha ((unsigned char) *s))
+        digit = tolower ((unsigned char) *s) - 'a' + 10;
+      else
+        break;
+      if (digit >= (unsigned) base)
+        break;
 
-  return value;
+      any = true;
+      if (overflow || *value > cutoff
+          || (*value == cutoff && digit > cutlim))
+        {
+          overflow = true;
+          *value = ULONG_MAX;
+        }
+      else
+        *value = *value * base + digit;
+    }
+
+  if (end != NULL)
+    *end = (char *) (any ? s : start);
+  return overflow;
+}
+
+/* Converts the initial part of S, a signed integer in BASE, to a
+   `long', which is returned.  If END is nonnull, stores a pointer
+   to the first character after the number in *END.  BASE may be
+   0 to detect the base from a "0x" or "0" prefix, or between 2
+   and 36.  Returns LONG_MAX or LONG_MIN if the value is out of
+   range. */
+long
+strtol (const char *s, char **end, int base) 
+{
+  unsigned long value;
+  bool negative;
+
+  if (parse_ulong (s, base, &value, end, &negative))
+    return negative ? LONG_MIN : LONG_MAX;
+  if (negative)
+    return value > (unsigned long) LONG_MAX + 1 ? LONG_MIN : (long) -value;
+  else
+    return value > LONG_MAX ? LONG_MAX : (long) value;
+}
+
+/* Converts the initial part of S, an unsigned integer in BASE, to
+   an `unsigned long', which is returned.  Like strtol(), except
+   that the value is clamped to ULONG_MAX and a minus sign negates
+   the result, as in standard C. */
+unsigned long
+strtoul (const char *s, char **end, int base) 
+{
+  unsigned long value;
+  bool negative;
+
+  if (parse_ulong (s, base, &value, end, &negative))
+    return ULONG_MAX;
+  return negative ? -value : value;
 }
 
 /* Compares A and B by calling the AUX function. */
@@ -52,7 +147,7 @@ compare_thunk (const void *a, const void *b, void *aux)
    using COMPARE.  When COMPARE is passed a pair of elements A
    and B, respectively, it must return a strcmp()-type result,
    i.e. less than zero if A < B, zero if A == B, greater than
-   zero if A > B.  Runs in O(n lg n) time and O(1) space in
+   zero if A > B.  Runs in O(n lg n) time and O(lg n) space in
    CNT. */
 void
 qsort (void *array, size_t cnt, size_t size,
@@ -61,15 +156,33 @@ qsort (void *array, size_t cnt, size_t size,
   sort (array, cnt, size, compare_thunk, &compare);
 }
 
-/* Swaps elements with 1-based indexes A_IDX and B_IDX in ARRAY
-   with elements of SIZE bytes each. */
-static void
-do_swap (unsigned char *array, size_t a_idx, size_t b_idx, size_t size)
+/* A word that may alias elements of any type. */
+typedef uint64_t swap_word __attribute__ ((may_alias));
+
+/* Swaps the elements of SIZE bytes each at A and B.  Elements
+   that are a whole number of aligned words, such as pointers,
+   long integers and most structures, are swapped a word at a
+   time. */
+static inline void
+do_swap (unsigned char *a, unsigned char *b, size_t size)
 {
-  unsigned char *a = array + (a_idx - 1) * size;
-  unsigned char *b = array + (b_idx - 1) * size;
   size_t i;
 
+  if (size % sizeof (swap_word) == 0
+      && ((uintptr_t) a | (uintptr_t) b) % sizeof (swap_word) == 0)
+    {
+      swap_word *wa = (swap_word *) a;
+      swap_word *wb = (swap_word *) b;
+
+      for (i = 0; i < size / sizeof (swap_word); i++)
+        {
+          swap_word t = wa[i];
+          wa[i] = wb[i];
+          wb[i] = t;
+        }
+      return;
+    }
+
   for (i = 0; i < size; i++)
     {
       unsigned char t = a[i];
@@ -78,19 +191,7 @@ do_swap (unsigned char *array, size_t a_idx, size_t b_idx, size_t size)
     }
 }
 
-/* Compares elements with 1-based indexes A_IDX and B_IDX in
-   ARRAY with elements of SIZE bytes each, using COMPARE to
-   compare elements, passing AUX as auxiliary data, and returns a
-   strcmp()-type result. */
-static int
-do_compare (unsigned char *array, size_t a_idx, size_t b_idx, size_t size,
-            int (*compare) (const void *, const void *, void *aux),
-            void *aux) 
-{
-  return compare (array + (a_idx - 1) * size, array + (b_idx - 1) * size, aux);
-}
-
-/* "Float down" the element with 1-based index I in ARRAY of CNT
+/* "Float down" the element with 0-based index I in ARRAY of CNT
    elements of SIZE bytes each, using COMPARE to compare
    elements, passing AUX as auxiliary data. */
 static void
@@ -102,13 +203,14 @@ heapify (unsigned char *array, size_t i, size_t cnt, size_t size,
     {
       /* Set `max' to the index of the largest element among I
          and its children (if any). */
-      size_t left = 2 * i;
-      size_t right = 2 * i + 1;
+      size_t left = 2 * i + 1;
+      size_t right = 2 * i + 2;
       size_t max = i;
-      if (left <= cnt && do_compare (array, left, max, size, compare, aux) > 0)
+      if (left < cnt
+          && compare (array + left * size, array + max * size, aux) > 0)
         max = left;
-      if (right <= cnt
-          && do_compare (array, right, max, size, compare, aux) > 0) 
+      if (right < cnt
+          && compare (array + right * size, array + max * size, aux) > 0)
         max = right;
 
       /* If the maximum value is already in element I, we're
@@ -117,22 +219,22 @@ heapify (unsigned char *array, size_t i, size_t cnt, size_t size,
         break;
 
       /* Swap and continue down the heap. */
-      do_swap (array, i, max, size);
+      do_swap (array + i * size, array + max * size, size);
       i = max;
     }
 }
 
 /* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
    using COMPARE to compare elements, passing AUX as auxiliary
-   data.  When COMPARE is passed a pair of elements A and B,
-   respectively, it must return a strcmp()-type result, i.e. less
-   than zero if A < B, zero if A == B, greater than zero if A >
-   B.  Runs in O(n lg n) time and O(1) space in CNT. */
+   data, as sort() does, but by heapsort.  Runs in O(n lg n) time
+   and O(1) space in CNT, even in the worst case, but is usually
+   slower than sort(). */
 void
-sort (void *array, size_t cnt, size_t size,
-      int (*compare) (const void *, const void *, void *aux),
-      void *aux) 
+heap_sort (void *array_, size_t cnt, size_t size,
+           int (*compare) (const void *, const void *, void *aux),
+           void *aux) 
 {
+  unsigned char *array = array_;
   size_t i;
 
   ASSERT (array != NULL || cnt == 0);
@@ -140,17 +242,141 @@ sort (void *array, size_t cnt, size_t size,
   ASSERT (size > 0);
 
   /* Build a heap. */
-  for (i = cnt / 2; i > 0; i--)
+  for (i = cnt / 2; i-- > 0; )
     heapify (array, i, cnt, size, compare, aux);
 
   /* Sort the heap. */
   for (i = cnt; i > 1; i--) 
     {
-      do_swap (array, 1, i, size);
-      heapify (array, 1, i - 1, size, compare, aux); 
+      do_swap (array, array + (i - 1) * size, size);
+      heapify (array, 0, i - 1, size, compare, aux); 
     }
 }
 
+/* Partitions of at most this many elements are sorted by
+   insertion sort. */
+#define INSERTION_SORT_CNT 16
+
+/* Sorts the CNT elements of SIZE bytes each in ARRAY by insertion
+   sort, using COMPARE and AUX as for sort(). */
+static void
+insertion_sort (unsigned char *array, size_t cnt, size_t size,
+                int (*compare) (const void *, const void *, void *aux),
+                void *aux) 
+{
+  size_t i, j;
+
+  for (i = 1; i < cnt; i++)
+    for (j = i; j > 0; j--)
+      {
+        unsigned char *a = array + (j - 1) * size;
+        if (compare (a, a + size, aux) <= 0)
+          break;
+        do_swap (a, a + size, size);
+      }
+}
+
+/* Sorts the CNT elements of SIZE bytes each in ARRAY by
+   quicksort, using COMPARE and AUX as for sort(), until DEPTH
+   levels of partitioning have not sufficed, at which point it
+   switches to heapsort. */
+static void
+introsort (unsigned char *array, size_t cnt, size_t size,
+           int (*compare) (const void *, const void *, void *aux),
+           void *aux, int depth) 
+{
+  while (cnt > INSERTION_SORT_CNT) 
+    {
+      unsigned char *mid = array + cnt / 2 * size;
+      unsigned char *last = array + (cnt - 1) * size;
+      size_t i, j;
+
+      /* Too many bad pivots: fall back to heapsort, which cannot
+         go quadratic. */
+      if (depth-- == 0) 
+        {
+          heap_sort (array, cnt, size, compare, aux);
+          return;
+        }
+
+      /* Order the first, middle and last elements, then use their
+         median as the pivot, swapped into the first position.
+         The largest of the three then stops the upward scan below
+         and the pivot itself stops the downward scan. */
+      if (compare (mid, array, aux) < 0)
+        do_swap (mid, array, size);
+      if (compare (last, mid, aux) < 0) 
+        {
+          do_swap (last, mid, size);
+          if (compare (mid, array, aux) < 0)
+            do_swap (mid, array, size);
+        }
+      do_swap (array, mid, size);
+
+      /* Hoare partition.  Elements equal to the pivot stop both
+         scans, which splits runs of duplicates evenly. */
+      i = 0;
+      j = cnt;
+      for (;;) 
+        {
+          do
+            i++;
+          while (compare (array + i * size, array, aux) < 0);
+          do
+            j--;
+          while (compare (array, array + j * size, aux) < 0);
+          if (i >= j)
+            break;
+          do_swap (array + i * size, array + j * size, size);
+        }
+      do_swap (array, array + j * size, size);
+
+      /* Recurse into the smaller side and loop on the larger, so
+         that the recursion is at most lg CNT deep. */
+      if (j < cnt - j - 1) 
+        {
+          introsort (array, j, size, compare, aux, depth);
+          array += (j + 1) * size;
+          cnt -= j + 1;
+        }
+      else 
+        {
+          introsort (array + (j + 1) * size, cnt - j - 1, size,
+                     compare, aux, depth);
+          cnt = j;
+        }
+    }
+  insertion_sort (array, cnt, size, compare, aux);
+}
+
+/* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
+   using COMPARE to compare elements, passing AUX as auxiliary
+   data.  When COMPARE is passed a pair of elements A and B,
+   respectively, it must return a strcmp()-type result, i.e. less
+   than zero if A < B, zero if A == B, greater than zero if A >
+   B.  Runs in O(n lg n) time and O(lg n) space in CNT.
+
+   This is an introsort: quicksort with median-of-three pivots,
+   finishing small partitions with insertion sort, and switching
+   to heapsort if partitioning goes more than 2 lg CNT levels
+   deep, as it can on adversarial input. */
+void
+sort (void *array, size_t cnt, size_t size,
+      int (*compare) (const void *, const void *, void *aux),
+      void *aux) 
+{
+  int depth = 0;
+  size_t n;
+
+  ASSERT (array != NULL || cnt == 0);
+  ASSERT (compare != NULL);
+  ASSERT (size > 0);
+
+  for (n = cnt; n > 1; n /= 2)
+    depth += 2;
+  introsort (array, cnt, size, compare, aux, depth);
+}
+
 /* Searches ARRAY, which contains CNT elements of SIZE bytes
    each, for the given KEY.  Returns a match is found, otherwise
    a null pointer.  If there are multiple matches, returns an
@@ -1,18 +1,47 @@
 #include <string.h>
+#include <stdint.h>
 #include <debug.h>
 
+/* The kernel and user programs are built with -O0 and without
+   SSE, so byte-at-a-time loops here run at a few hundred MB/s at
+   best.  The block functions below instead move 8 bytes at a time
+   with the x86 string instructions, and the search functions test
+   8 bytes at a time with the usual bit tricks.
+
+   A `word' may alias any other type and need not be aligned,
+   which x86-64 allows at no or little cost. */
+typedef uint64_t word __attribute__ ((may_alias, aligned (1)));
+
+#define WORD_SIZE sizeof (uint64_t)
+#define ONES ((uint64_t) 0x0101010101010101)
+#define HIGHS ((uint64_t) 0x8080808080808080)
+
+/* Nonzero if any byte of X is zero. */
+#define HAS_ZERO(X) (((X) - ONES) & ~(X) & HIGHS)
+
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
 void *
 memcpy (void *dst_, const void *src_, size_t size) {
 	unsigned char *dst = dst_;
 	const unsigned char *src = src_;
+	size_t head;
 
 	ASSERT (dst != NULL || size == 0);
 	ASSERT (src != NULL || size == 0);
 
-	while (size-- > 0)
-		*dst++ = *src++;
+	/* Align DST, so that at least the stores are aligned, then
+	   move whole words, then the remaining bytes. */
+	head = size >= 64 ? -(uintptr_t) dst % WORD_SIZE : 0;
+	size -= head;
+	asm volatile ("rep movsb"
+			: "+D" (dst), "+S" (src), "+c" (head) : : "memory");
+	head = size / WORD_SIZE;
+	asm volatile ("rep movsq"
+			: "+D" (dst), "+S" (src), "+c" (head) : : "memory");
+	size %= WORD_SIZE;
+	asm volatile ("rep movsb"
+			: "+D" (dst), "+S" (src), "+c" (size) : : "memory");
 
 	return dst_;
 }
@@ -23,21 +52,30 @@ void *
 memmove (void *dst_, const void *src_, size_t size) {
 	unsigned char *dst = dst_;
 	const unsigned char *src = src_;
+	size_t tail, words;
 
 	ASSERT (dst != NULL || size == 0);
 	ASSERT (src != NULL || size == 0);
 
-	if (dst < src) {
-		while (size-- > 0)
-			*dst++ = *src++;
-	} else {
-		dst += size;
-		src += size;
-		while (size-- > 0)
-			*--dst = *--src;
-	}
+	/* A forward copy is safe unless DST starts inside SRC. */
+	if ((uintptr_t) dst - (uintptr_t) src >= size)
+		return memcpy (dst_, src_, size);
+
+	/* Copy backward, starting with the bytes past the last whole
+	   word.  The direction flag is cleared again before leaving
+	   the asm, as the ABI requires. */
+	tail = size % WORD_SIZE;
+	words = size / WORD_SIZE;
+	dst += size - 1;
+	src += size - 1;
+	asm volatile ("std; rep movsb; cld"
+			: "+D" (dst), "+S" (src), "+c" (tail) : : "memory");
+	dst -= WORD_SIZE - 1;
+	src -= WORD_SIZE - 1;
+	asm volatile ("std; rep movsq; cld"
+			: "+D" (dst), "+S" (src), "+c" (words) : : "memory");
 
-	return dst;
+	return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -52,6 +90,10 @@ memcmp (const void *a_, const void *b_, size_t size) {
 	ASSERT (a != NULL || size == 0);
 	ASSERT (b != NULL || size == 0);
 
+	/* Skip equal words, then find the differing byte. */
+	for (; size >= WORD_SIZE; a += WORD_SIZE, b += WORD_SIZE, size -= WORD_SIZE)
+		if (*(const word *) a != *(const word *) b)
+			break;
 	for (; size-- > 0; a++, b++)
 		if (*a != *b)
 			return *a > *b ? +1 : -1;
@@ -86,9 +128,16 @@ void *
 memchr (const void *block_, int ch_, size_t size) {
 	const unsigned char *block = block_;
 	unsigned char ch = ch_;
+	uint64_t pattern = ch * ONES;
 
 	ASSERT (block != NULL || size == 0);
 
+	/* Skip words that do not contain CH, then find it. */
+	for (; size >= WORD_SIZE; block += WORD_SIZE, size -= WORD_SIZE) {
+		uint64_t x = *(const word *) block ^ pattern;
+		if (HAS_ZERO (x))
+			break;
+	}
 	for (; size-- > 0; block++)
 		if (*block == ch)
 			return (void *) block;
@@ -257,11 +306,22 @@ strtok_r (char *s, const char *delimiters, char **save_ptr) {
 void *
 memset (void *dst_, int value, size_t size) {
 	unsigned char *dst = dst_;
+	uint64_t pattern = (unsigned char) value * ONES;
+	size_t head;
 
 	ASSERT (dst != NULL || size == 0);
 
-	while (size-- > 0)
-		*dst++ = value;
+	/* Same structure as memcpy(). */
+	head = size >= 64 ? -(uintptr_t) dst % WORD_SIZE : 0;
+	size -= head;
+	asm volatile ("rep stosb"
+			: "+D" (dst), "+c" (head) : "a" (pattern) : "memory");
+	head = size / WORD_SIZE;
+	asm volatile ("rep stosq"
+			: "+D" (dst), "+c" (head) : "a" (pattern) : "memory");
+	size %= WORD_SIZE;
+	asm volatile ("rep stosb"
+			: "+D" (dst), "+c" (size) : "a" (pattern) : "memory");
 
 	return dst_;
 }
@@ -273,8 +333,16 @@ strlen (const char *string) {
 
 	ASSERT (string);
 
-	for (p = string; *p != '\0'; p++)
-		continue;
+	/* Check bytes up to a word boundary, then whole aligned words.
+	   An aligned word never straddles a page boundary, so reading
+	   past the null terminator within one cannot fault. */
+	for (p = string; (uintptr_t) p % WORD_SIZE != 0; p++)
+		if (*p == '\0')
+			return p - string;
+	while (!HAS_ZERO (*(const word *) p))
+		p += WORD_SIZE;
+	while (*p != '\0')
+		p++;
 	return p - string;
 }
 
@@ -4,13 +4,15 @@
 #include <syscall-nr.h>
 
 /* The standard vprintf() function,
-   which is like printf() but uses a va_list. */
+   which is like printf() but uses a va_list.
+   Output goes through the line-buffered stdout stream. */
 int
 vprintf (const char *format, va_list args) {
-	return vhprintf (STDOUT_FILENO, format, args);
+	return vfprintf (stdout, format, args);
 }
 
-/* Like printf(), but writes output to the given HANDLE. */
+/* Like printf(), but writes output to the given HANDLE,
+   bypassing any stream buffering. */
 int
 hprintf (int handle, const char *format, ...) {
 	va_list args;
@@ -27,7 +29,7 @@ hprintf (int handle, const char *format, ...) {
    character. */
 int
 puts (const char *s) {
-	write (STDOUT_FILENO, s, strlen (s));
+	fputs (s, stdout);
 	putchar ('\n');
 
 	return 0;
@@ -36,8 +38,7 @@ puts (const char *s) {
 /* Writes C to the console. */
 int
 putchar (int c) {
-	char c2 = c;
-	write (STDOUT_FILENO, &c2, 1);
+	fputc (c, stdout);
 	return c;
 }
 
@@ -0,0 +1,395 @@
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Buffered streams.
+
+   Each stream buffers the data written to or read from one file
+   descriptor, so that a program that prints or reads a little at
+   a time still makes system calls only once per line or per
+   BUFSIZ bytes.  There is no malloc() in user programs, so the
+   streams are a fixed array: stdin, stdout, and FOPEN_MAX - 2
+   streams for fdopen().  stdout and each fdopen() stream have a
+   buffer of BUFSIZ bytes.  stdin is unbuffered and has none.
+   Every buffer adds to the size of every process, so FOPEN_MAX
+   is kept small. */
+
+/* A buffered stream. */
+struct __FILE {
+	int fd;                     /* File descriptor, or -1 if free. */
+	int mode;                   /* _IONBF, _IOLBF, or _IOFBF. */
+	bool writing;               /* Output stream?  Else input. */
+	bool eof;                   /* Reached end of file? */
+	bool error;                 /* Had a read or write error? */
+	char *buf;                  /* Buffer. */
+	size_t size;                /* Size of BUF. */
+	size_t pos;                 /* Output: bytes in BUF.
+	                               Input: next byte to return. */
+	size_t end;                 /* Input: bytes in BUF. */
+};
+
+static char stdout_buf[BUFSIZ];
+static char fdopen_bufs[FOPEN_MAX - 2][BUFSIZ];
+
+static struct __FILE streams[FOPEN_MAX] = {
+	/* The console blocks reads until it has all the bytes asked
+	   for, so stdin must not try to read ahead. */
+	{ .fd = STDIN_FILENO, .mode = _IONBF, .writing = false,
+	  .buf = NULL, .size = 0 },
+	{ .fd = STDOUT_FILENO, .mode = _IOLBF, .writing = true,
+	  .buf = stdout_buf, .size = BUFSIZ },
+	[2 ... FOPEN_MAX - 1] = { .fd = -1 },
+};
+
+FILE *stdin = &streams[0];
+FILE *stdout = &streams[1];
+
+/* Writes out the output buffered in F. */
+static bool
+flush_stream (FILE *f) {
+	size_t cnt = f->pos;
+	size_t ofs = 0;
+
+	/* Empty the buffer first: write() calls __stdio_sync(),
+	   which must find nothing left to flush. */
+	f->pos = 0;
+	while (ofs < cnt) {
+		int n = write (f->fd, f->buf + ofs, cnt - ofs);
+		if (n <= 0) {
+			f->error = true;
+			return false;
+		}
+		ofs += n;
+	}
+	return true;
+}
+
+/* Reads up to SIZE bytes from F's file descriptor into BUF and
+   returns the number read, updating F's end-of-file and error
+   indicators. */
+static size_t
+read_stream (FILE *f, void *buf, size_t size) {
+	int n;
+
+	if (f == stdin)
+		fflush (stdout);
+	n = read (f->fd, buf, size);
+	if (n < 0) {
+		f->error = true;
+		return 0;
+	}
+	if (n == 0)
+		f->eof = true;
+	return n;
+}
+
+/* Opens a stream on FD, which is already open.  MODE must begin
+   with "r" for an input stream or "w" or "a" for an output
+   stream.  Output to the console is line buffered, and all other
+   streams are fully buffered.  Returns the new stream, or a null
+   pointer if MODE is invalid or all the streams are in use. */
+FILE *
+fdopen (int fd, const char *mode) {
+	size_t i;
+
+	if (fd < 0 || (mode[0] != 'r' && mode[0] != 'w' && mode[0] != 'a'))
+		return NULL;
+
+	for (i = 2; i < FOPEN_MAX; i++) {
+		FILE *f = &streams[i];
+
+		if (f->fd < 0) {
+			f->fd = fd;
+			f->writing = mode[0] != 'r';
+			f->mode = fd == STDOUT_FILENO ? _IOLBF : _IOFBF;
+			f->eof = f->error = false;
+			f->buf = fdopen_bufs[i - 2];
+			f->size = BUFSIZ;
+			f->pos = f->end = 0;
+			return f;
+		}
+	}
+	return NULL;
+}
+
+/* Flushes F and closes it, along with its file descriptor.
+   Returns 0 if successful, EOF on error. */
+int
+fclose (FILE *f) {
+	int retval = fflush (f);
+
+	if (f->fd != STDIN_FILENO && f->fd != STDOUT_FILENO)
+		close (f->fd);
+	if (f != stdin && f != stdout)
+		f->fd = -1;
+	return retval;
+}
+
+/* Writes out any output buffered in F, or in every stream if F
+   is a null pointer.  For an input stream, discards any data
+   read ahead, seeking the file descriptor back so that its
+   position matches what was consumed.  Returns 0 if successful,
+   EOF on error. */
+int
+fflush (FILE *f) {
+	if (f == NULL) {
+		int retval = 0;
+		size_t i;
+
+		for (i = 0; i < FOPEN_MAX; i++)
+			if (streams[i].fd >= 0 && streams[i].writing
+					&& fflush (&streams[i]) != 0)
+				retval = EOF;
+		return retval;
+	}
+
+	if (f->writing)
+		return f->pos > 0 && !flush_stream (f) ? EOF : 0;
+
+	if (f->pos < f->end) {
+		seek (f->fd, tell (f->fd) - (f->end - f->pos));
+		f->pos = f->end = 0;
+	}
+	return 0;
+}
+
+/* Sets F's buffering mode to MODE, one of _IONBF, _IOLBF, or
+   _IOFBF.  If BUF is nonnull, F uses the SIZE bytes at BUF as
+   its buffer from now on.  A stream without a buffer, such as
+   stdin, needs one to be buffered.  Must be called before any
+   other operation on F.  Returns 0 if successful, nonzero on
+   error. */
+int
+setvbuf (FILE *f, char *buf, int mode, size_t size) {
+	if (mode != _IONBF && mode != _IOLBF && mode != _IOFBF)
+		return EOF;
+	if (buf != NULL && size == 0)
+		return EOF;
+	if (buf == NULL && f->size == 0 && mode != _IONBF)
+		return EOF;
+	if (fflush (f) != 0)
+		return EOF;
+
+	f->mode = mode;
+	if (buf != NULL) {
+		f->buf = buf;
+		f->size = size;
+	}
+	return 0;
+}
+
+/* Writes the CNT elements of SIZE bytes each at BUFFER to F, and
+   returns the number of elements written. */
+size_t
+fwrite (const void *buffer, size_t size, size_t cnt, FILE *f) {
+	const char *p = buffer;
+	size_t total = size * cnt;
+	size_t left = total;
+
+	if (!f->writing || total == 0)
+		return 0;
+
+	/* Writes that don't fit in the buffer go straight to the
+	   file, after whatever is buffered. */
+	if (f->mode == _IONBF || left >= f->size - f->pos) {
+		if (f->pos > 0 && !flush_stream (f))
+			return 0;
+		if (f->mode == _IONBF || left >= f->size) {
+			while (left > 0) {
+				int n = write (f->fd, p, left);
+				if (n <= 0) {
+					f->error = true;
+					break;
+				}
+				p += n;
+				left -= n;
+			}
+			return (total - left) / size;
+		}
+	}
+
+	memcpy (f->buf + f->pos, p, left);
+	f->pos += left;
+	if (f->mode == _IOLBF && memchr (p, '\n', left) != NULL
+			&& !flush_stream (f))
+		return 0;
+	return cnt;
+}
+
+/* Writes character C to F.  Returns C if successful, EOF on
+   error. */
+int
+fputc (int c, FILE *f) {
+	if (f->writing && f->mode != _IONBF && f->pos < f->size) {
+		f->buf[f->pos++] = c;
+		if ((f->mode == _IOLBF && c == '\n') || f->pos == f->size)
+			if (!flush_stream (f))
+				return EOF;
+		return (unsigned char) c;
+	} else {
+		char c2 = c;
+		return fwrite (&c2, 1, 1, f) == 1 ? (unsigned char) c : EOF;
+	}
+}
+
+/* Writes string S to F.  Returns 0 if successful, EOF on
+   error. */
+int
+fputs (const char *s, FILE *f) {
+	size_t len = strlen (s);
+
+	return fwrite (s, 1, len, f) == len ? 0 : EOF;
+}
+
+/* Reads up to CNT elements of SIZE bytes each from F into
+   BUFFER, and returns the number of whole elements read. */
+size_t
+fread (void *buffer, size_t size, size_t cnt, FILE *f) {
+	char *p = buffer;
+	size_t total = size * cnt;
+	size_t left = total;
+
+	if (f->writing || total == 0)
+		return 0;
+
+	while (left > 0) {
+		size_t n;
+
+		if (f->pos < f->end) {
+			/* Copy out buffered data. */
+			n = f->end - f->pos < left ? f->end - f->pos : left;
+			memcpy (p, f->buf + f->pos, n);
+			f->pos += n;
+		} else if (f->mode != _IOFBF || left >= f->size) {
+			/* Read large requests, and all requests on
+			   unbuffered streams, directly. */
+			n = read_stream (f, p, left);
+			if (n == 0)
+				break;
+		} else {
+			/* Refill the buffer. */
+			f->pos = 0;
+			f->end = read_stream (f, f->buf, f->size);
+			if (f->end == 0)
+				break;
+			continue;
+		}
+		p += n;
+		left -= n;
+	}
+	return (total - left) / size;
+}
+
+/* Reads a character from F and returns it as an unsigned char
+   converted to int, or EOF at end of file or on error. */
+int
+fgetc (FILE *f) {
+	unsigned char c;
+
+	if (!f->writing && f->pos < f->end)
+		return (unsigned char) f->buf[f->pos++];
+	return fread (&c, 1, 1, f) == 1 ? c : EOF;
+}
+
+/* Reads characters from F into the SIZE bytes at S, stopping
+   after a new-line or at end of file, and null-terminates them.
+   Returns S, or a null pointer if no characters could be
+   read. */
+char *
+fgets (char *s, int size, FILE *f) {
+	int i = 0;
+
+	if (size <= 0)
+		return NULL;
+	while (i < size - 1) {
+		int c = fgetc (f);
+		if (c == EOF)
+			break;
+		s[i++] = c;
+		if (c == '\n')
+			break;
+	}
+	s[i] = '\0';
+	return i > 0 ? s : NULL;
+}
+
+/* Auxiliary data for vfprintf_helper(). */
+struct vfprintf_aux {
+	FILE *f;            /* Output stream. */
+	int char_cnt;       /* Characters formatted so far. */
+};
+
+/* Writes C to the stream in AUX_. */
+static void
+vfprintf_helper (char c, void *aux_) {
+	struct vfprintf_aux *aux = aux_;
+
+	fputc (c, aux->f);
+	aux->char_cnt++;
+}
+
+/* Like printf(), but writes output to F. */
+int
+fprintf (FILE *f, const char *format, ...) {
+	va_list args;
+	int retval;
+
+	va_start (args, format);
+	retval = vfprintf (f, format, args);
+	va_end (args);
+
+	return retval;
+}
+
+/* Like vprintf(), but writes output to F.  Returns the number of
+   characters formatted. */
+int
+vfprintf (FILE *f, const char *format, va_list args) {
+	struct vfprintf_aux aux;
+	int mode = f->mode;
+
+	/* Buffer the output of an unbuffered stream until the end of
+	   the call, instead of writing it a character at a time. */
+	if (mode == _IONBF)
+		f->mode = _IOFBF;
+
+	aux.f = f;
+	aux.char_cnt = 0;
+	__vprintf (format, args, vfprintf_helper, &aux);
+
+	if (mode == _IONBF) {
+		fflush (f);
+		f->mode = mode;
+	}
+	return aux.char_cnt;
+}
+
+/* Returns the file descriptor underlying F. */
+int
+fileno (FILE *f) {
+	return f->fd;
+}
+
+/* Returns true if F has reached end of file. */
+int
+feof (FILE *f) {
+	return f->eof;
+}
+
+/* Returns true if a read or write on F has failed. */
+int
+ferror (FILE *f) {
+	return f->error;
+}
+
+/* Writes out any output buffered for FD, so that data written to
+   FD directly follows it.  Called by the write() system call
+   wrapper. */
+void
+__stdio_sync (int fd) {
+	size_t i;
+
+	for (i = 0; i < FOPEN_MAX; i++)
+		if (streams[i].fd == fd && streams[i].writing && streams[i].pos > 0)
+			flush_stream (&streams[i]);
+}
@@ -1,5 +1,6 @@
 #include <syscall.h>
 #include <stdint.h>
+#include <stdio.h>
 #include "../syscall-nr.h"
 
 __attribute__((always_inline))
@@ -70,23 +71,28 @@ static __inline int64_t syscall (uint64_t num_, uint64_t a1_, uint64_t a2_,
 			0))
 void
 halt (void) {
+	fflush (NULL);
 	syscall0 (SYS_HALT);
 	NOT_REACHED ();
 }
 
 void
 exit (int status) {
+	fflush (NULL);
 	syscall1 (SYS_EXIT, status);
 	NOT_REACHED ();
 }
 
 pid_t
 fork (const char *thread_name){
+	/* Otherwise both processes would write out what is buffered. */
+	fflush (NULL);
 	return (pid_t) syscall1 (SYS_FORK, thread_name);
 }
 
 int
 exec (const char *file) {
+	fflush (NULL);
 	return (pid_t) syscall1 (SYS_EXEC, file);
 }
 
@@ -117,11 +123,15 @@ filesize (int fd) {
 
 int
 read (int fd, void *buffer, unsigned size) {
+	if (fd == STDIN_FILENO)
+		__stdio_sync (STDOUT_FILENO);
 	return syscall3 (SYS_READ, fd, buffer, size);
 }
 
 int
 write (int fd, const void *buffer, unsigned size) {
+	/* Keep data written directly after what was buffered. */
+	__stdio_sync (fd);
 	return syscall3 (SYS_WRITE, fd, buffer, size);
 }
 
@@ -0,0 +1,248 @@
+/* Test program for lib/kernel/bitmap.c.
+
+   Checks bitmap_scan(), bitmap_scan_from_hint() and
+   bitmap_contains() against a bit-at-a-time reference on random
+   bitmaps, with and without a summary, then times first-fit and
+   next-fit allocation on a mostly full 1M-bit bitmap.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/malloc.h"
+#include "threads/test.h"
+#include "devices/timer.h"
+
+/* Largest bitmap checked against the reference. */
+#define MAX_BITS 300
+
+/* Size of the bitmap used for timing. */
+#define BENCH_BITS (1024 * 1024)
+
+/* Number of allocations timed. */
+#define BENCH_ALLOCS 2000
+
+static void test_scan (void);
+static void test_sparse (void);
+static void bench (void);
+
+/* Test the bitmap implementation. */
+void
+test (void)
+{
+  test_scan ();
+  test_sparse ();
+  bench ();
+  printf ("bitmap: PASS\n");
+}
+
+/* Returns the first group of CNT bits set to VALUE in B that
+   lies within [START, END), or BITMAP_ERROR, one bit at a time. */
+static size_t
+slow_scan (const struct bitmap *b, size_t start, size_t end, size_t cnt,
+           bool value)
+{
+  size_t i, j;
+
+  for (i = start; i + cnt <= end; i++)
+    {
+      for (j = 0; j < cnt; j++)
+        if (bitmap_test (b, i + j) != value)
+          break;
+      if (j == cnt)
+        return i;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Fills B with random runs of set and clear bits, with set bits
+   making up about DENSITY percent. */
+static void
+randomize (struct bitmap *b, int density)
+{
+  size_t i = 0;
+
+  while (i < bitmap_size (b))
+    {
+      size_t len = 1 + random_ulong () % 70;
+      bool value = (int) (random_ulong () % 100) < density;
+
+      if (len > bitmap_size (b) - i)
+        len = bitmap_size (b) - i;
+      bitmap_set_multiple (b, i, len, value);
+      i += len;
+    }
+}
+
+/* Compares the scanning functions on B against the reference. */
+static void
+check_scans (const struct bitmap *b)
+{
+  size_t size = bitmap_size (b);
+  size_t start, cnt;
+  int value;
+
+  for (value = 0; value < 2; value++)
+    for (cnt = 1; cnt <= 70 && cnt <= size + 1; cnt += 3)
+      for (start = 0; start <= size; start += 1 + start / 4)
+        {
+          size_t expect = slow_scan (b, start, size, cnt, value);
+          size_t wrap;
+
+          ASSERT (bitmap_scan (b, start, cnt, value) == expect);
+          if (start + cnt <= size)
+            {
+              ASSERT (bitmap_contains (b, start, cnt, value)
+                      == (slow_scan (b, start, start + cnt, 1, value)
+                          != BITMAP_ERROR));
+            }
+
+          wrap = expect;
+          if (wrap == BITMAP_ERROR)
+            wrap = slow_scan (b, 0, size, cnt, value);
+          ASSERT (bitmap_scan_from_hint (b, start, cnt, value) == wrap);
+        }
+}
+
+/* Returns a new bitmap of SIZE bits with a summary.  The
+   summary's storage is leaked. */
+static struct bitmap *
+create_summarized (size_t size)
+{
+  struct bitmap *b = bitmap_create (size);
+  size_t sum_size = bitmap_summary_buf_size (size);
+  void *sum = malloc (sum_size);
+
+  ASSERT (b != NULL && sum != NULL);
+  bitmap_enable_summary (b, sum, sum_size);
+  return b;
+}
+
+/* Compares the scanning functions against the reference on
+   bitmaps of every size up to MAX_BITS, with and without a
+   summary.  The summarized bitmap is kept up to date through
+   bitmap_set_multiple(), bitmap_set() and bitmap_flip() in
+   turn. */
+static void
+test_scan (void)
+{
+  size_t size, i;
+
+  printf ("testing bitmap scans:");
+  for (size = 0; size <= MAX_BITS; size += size < 70 ? 1 : 23)
+    {
+      struct bitmap *b = bitmap_create (size);
+      struct bitmap *s = create_summarized (size);
+      int repeat;
+
+      ASSERT (b != NULL);
+      printf (" %zu", size);
+      for (repeat = 0; repeat < 8; repeat++)
+        {
+          randomize (b, repeat * 14);
+          for (i = 0; i < size; i++)
+            if (repeat % 2 == 0)
+              bitmap_set (s, i, bitmap_test (b, i));
+            else if (bitmap_test (s, i) != bitmap_test (b, i))
+              bitmap_flip (s, i);
+          check_scans (b);
+          check_scans (s);
+
+          randomize (s, repeat * 14);
+          check_scans (s);
+        }
+      bitmap_destroy (b);
+      bitmap_destroy (s);
+    }
+  printf (" done\n");
+}
+
+/* Checks searches that must skip long stretches of a large
+   summarized bitmap, so that both summary levels are used. */
+static void
+test_sparse (void)
+{
+  const size_t size = 300 * 1000;
+  struct bitmap *s = create_summarized (size);
+  int round, i;
+
+  printf ("testing sparse bitmap scans...\n");
+  for (round = 0; round < 20; round++)
+    {
+      for (i = 0; i < round; i++)
+        bitmap_flip (s, random_ulong () % size);
+      for (i = 0; i < 50; i++)
+        {
+          size_t start = random_ulong () % size;
+          ASSERT (bitmap_scan (s, start, 1, true)
+                  == slow_scan (s, start, size, 1, true));
+        }
+      bitmap_set_all (s, round % 2 == 0);
+      bitmap_set_multiple (s, random_ulong () % size, 1, round % 2 != 0);
+      ASSERT (bitmap_scan (s, 0, 1, round % 2 != 0)
+              == slow_scan (s, 0, size, 1, round % 2 != 0));
+      bitmap_set_all (s, false);
+    }
+  bitmap_destroy (s);
+}
+
+/* Allocates BENCH_ALLOCS runs of CNT bits from B, first-fit if
+   NEXT_FIT is false, otherwise next-fit, and returns the number
+   of timer ticks taken.  Frees the runs again afterward. */
+static int64_t
+time_allocs (struct bitmap *b, size_t cnt, bool next_fit)
+{
+  static size_t allocated[BENCH_ALLOCS];
+  size_t hint = 0;
+  int64_t start = timer_ticks ();
+  int64_t ticks;
+  int i;
+
+  for (i = 0; i < BENCH_ALLOCS; i++)
+    {
+      size_t idx = (next_fit
+                    ? bitmap_scan_from_hint (b, hint, cnt, false)
+                    : bitmap_scan (b, 0, cnt, false));
+      ASSERT (idx != BITMAP_ERROR);
+      bitmap_set_multiple (b, idx, cnt, true);
+      allocated[i] = idx;
+      hint = idx + cnt;
+    }
+  ticks = timer_elapsed (start);
+
+  for (i = 0; i < BENCH_ALLOCS; i++)
+    bitmap_set_multiple (b, allocated[i], cnt, false);
+  return ticks;
+}
+
+/* Times allocation from a 90% full 1M-bit bitmap, with and
+   without a summary. */
+static void
+bench (void)
+{
+  int summarized;
+
+  for (summarized = 0; summarized < 2; summarized++)
+    {
+      struct bitmap *b = (summarized
+                          ? create_summarized (BENCH_BITS)
+                          : bitmap_create (BENCH_BITS));
+      size_t cnt;
+
+      ASSERT (b != NULL);
+      randomize (b, 90);
+      printf ("%zu of %d bits set, %s summary\n",
+              bitmap_count (b, 0, BENCH_BITS, true), BENCH_BITS,
+              summarized ? "with" : "without");
+      for (cnt = 1; cnt <= 16; cnt *= 4)
+        printf ("%d allocations of %zu bits: first-fit %lld ticks, "
+                "next-fit %lld ticks\n", BENCH_ALLOCS, cnt,
+                time_allocs (b, cnt, false), time_allocs (b, cnt, true));
+      bitmap_destroy (b);
+    }
+}
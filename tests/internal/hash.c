@@ -0,0 +1,320 @@
+/* Test program for lib/kernel/hash.c.
+
+   Checks the hash table against a simple membership array
+   through random insertions, replacements, lookups, deletions
+   and iterations, many of which happen while the table is in the
+   middle of an incremental resize.
+
+   Then checks that the sample hash functions spread typical keys
+   evenly over buckets and that each input bit affects about half
+   of the output bits, and times hash_bytes() against the FNV
+   hash it replaced.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <hash.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/test.h"
+#include "devices/timer.h"
+
+/* Number of distinct keys used in the random test. */
+#define KEY_CNT 5000
+
+/* A hash table element. */
+struct value
+  {
+    struct hash_elem elem;      /* Hash table element. */
+    int key;                    /* Key. */
+  };
+
+static void test_random (void);
+static void test_distribution (void);
+static void test_avalanche (void);
+static void bench (void);
+
+/* Test the hash table implementation. */
+void
+test (void)
+{
+  test_random ();
+  test_distribution ();
+  test_avalanche ();
+  bench ();
+  printf ("hash: PASS\n");
+}
+
+/* Hashes and compares elements by key. */
+static uint64_t
+value_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct value, elem)->key);
+}
+
+static bool
+value_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct value, elem)->key
+          < hash_entry (b, struct value, elem)->key);
+}
+
+/* Counts the elements visited by iteration over H and by
+   hash_apply(). */
+static size_t apply_cnt;
+
+static void
+count_apply (struct hash_elem *e UNUSED, void *aux UNUSED)
+{
+  apply_cnt++;
+}
+
+static size_t
+count_iterated (struct hash *h)
+{
+  struct hash_iterator i;
+  size_t cnt = 0;
+
+  hash_first (&i, h);
+  while (hash_next (&i))
+    cnt++;
+
+  apply_cnt = 0;
+  hash_apply (h, count_apply);
+  ASSERT (apply_cnt == cnt);
+  return cnt;
+}
+
+/* Applies random operations to a table, checking each result
+   against IN_TABLE, which records each key's current element.
+   The table grows to KEY_CNT elements and shrinks again three
+   times, so that it goes through many resizes. */
+static void
+test_random (void)
+{
+  static struct value values[2][KEY_CNT];
+  static struct value *in_table[KEY_CNT];
+  size_t cnt = 0, resizing_ops = 0;
+  struct hash h;
+  int op;
+
+  printf ("testing random operations...\n");
+  ASSERT (hash_init (&h, value_hash, value_less, NULL));
+  for (op = 0; op < 300000; op++)
+    {
+      int key = random_ulong () % KEY_CNT;
+      struct value *v = &values[random_ulong () % 2][key];
+      struct value *old = in_table[key];
+      bool growing = op % 100000 < 50000;
+      struct hash_elem *e;
+
+      v->key = key;
+      switch (random_ulong () % (growing ? 3 : 6))
+        {
+        case 0:
+          e = hash_insert (&h, &v->elem);
+          if (old == NULL)
+            {
+              ASSERT (e == NULL);
+              in_table[key] = v;
+              cnt++;
+            }
+          else
+            ASSERT (e == &old->elem);
+          break;
+
+        case 1:
+          e = hash_replace (&h, &v->elem);
+          ASSERT (old != NULL ? e == &old->elem : e == NULL);
+          if (old == NULL)
+            cnt++;
+          in_table[key] = v;
+          break;
+
+        case 2:
+          e = hash_find (&h, &v->elem);
+          ASSERT (old != NULL ? e == &old->elem : e == NULL);
+          break;
+
+        default:
+          e = hash_delete (&h, &v->elem);
+          ASSERT (old != NULL ? e == &old->elem : e == NULL);
+          if (old != NULL)
+            cnt--;
+          in_table[key] = NULL;
+          break;
+        }
+      ASSERT (hash_size (&h) == cnt);
+
+      if (h.old_buckets != NULL)
+        {
+          resizing_ops++;
+          if (resizing_ops % 100 == 0)
+            {
+              ASSERT (count_iterated (&h) == cnt);
+            }
+        }
+    }
+  printf ("%zu operations during resizes\n", resizing_ops);
+  ASSERT (resizing_ops > 0);
+  ASSERT (count_iterated (&h) == cnt);
+
+  hash_clear (&h, NULL);
+  ASSERT (hash_empty (&h));
+  ASSERT (count_iterated (&h) == 0);
+  hash_destroy (&h, NULL);
+}
+
+/* Number of buckets and keys for the distribution test. */
+#define BUCKET_CNT 1024
+#define DIST_KEY_CNT (BUCKET_CNT * 64)
+
+/* Kinds of keys for the distribution test. */
+enum key_kind
+  {
+    KEY_INT,                    /* 0, 1, 2, ... */
+    KEY_PAGE,                   /* Page-aligned user addresses. */
+    KEY_NAME,                   /* File names "file0", "file1", ... */
+    KEY_KIND_CNT
+  };
+
+/* Returns the hash of the Ith key of kind KIND. */
+static uint64_t
+hash_key (enum key_kind kind, int i)
+{
+  char name[16];
+
+  switch (kind)
+    {
+    case KEY_INT:
+      return hash_int (i);
+    case KEY_PAGE:
+      return hash_ptr ((void *) (0x400000 + (uintptr_t) i * 4096));
+    default:
+      snprintf (name, sizeof name, "file%d", i);
+      return hash_string (name);
+    }
+}
+
+/* Checks that the low bits of the hashes of each kind of key,
+   which is what struct hash uses to pick a bucket, are close to
+   uniformly distributed.  The sum of the squared bucket counts
+   for a uniform hash is about N * N / B + N for N keys in B
+   buckets; a poor hash has a much larger sum. */
+static void
+test_distribution (void)
+{
+  static unsigned counts[BUCKET_CNT];
+  uint64_t expect = (uint64_t) DIST_KEY_CNT * DIST_KEY_CNT / BUCKET_CNT
+                    + DIST_KEY_CNT;
+  enum key_kind kind;
+
+  printf ("testing hash distribution...\n");
+  for (kind = 0; kind < KEY_KIND_CNT; kind++)
+    {
+      uint64_t sum = 0;
+      int i;
+
+      memset (counts, 0, sizeof counts);
+      for (i = 0; i < DIST_KEY_CNT; i++)
+        counts[hash_key (kind, i) % BUCKET_CNT]++;
+      for (i = 0; i < BUCKET_CNT; i++)
+        sum += (uint64_t) counts[i] * counts[i];
+      printf ("key kind %d: sum of squares %llu, uniform %llu\n",
+              kind, sum, expect);
+      ASSERT (sum * 100 < expect * 105);
+    }
+}
+
+/* Returns the number of bits set in X. */
+static int
+popcount (uint64_t x)
+{
+  int cnt = 0;
+
+  for (; x != 0; x &= x - 1)
+    cnt++;
+  return cnt;
+}
+
+/* Flips each bit of random 16-byte inputs and checks that about
+   half of the bits of hash_bytes()'s output change on average,
+   and that no input bit is ignored. */
+static void
+test_avalanche (void)
+{
+  int bit;
+
+  printf ("testing hash avalanche...\n");
+  for (bit = 0; bit < 128; bit++)
+    {
+      int total = 0;
+      int trial;
+
+      for (trial = 0; trial < 100; trial++)
+        {
+          unsigned char buf[16];
+          uint64_t before, after;
+
+          random_bytes (buf, sizeof buf);
+          before = hash_bytes (buf, sizeof buf);
+          buf[bit / 8] ^= 1 << (bit % 8);
+          after = hash_bytes (buf, sizeof buf);
+          ASSERT (before != after);
+          total += popcount (before ^ after);
+        }
+
+      /* 100 trials average 3200 changed bits. */
+      ASSERT (total > 2900 && total < 3500);
+    }
+}
+
+/* The byte-at-a-time FNV-1 hash that hash_bytes() used to be. */
+static uint64_t
+fnv_bytes (const void *buf_, size_t size)
+{
+  const unsigned char *buf = buf_;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+
+  while (size-- > 0)
+    hash = (hash * 0x00000100000001B3ULL) ^ *buf++;
+  return hash;
+}
+
+/* Times hashing a 4 kB buffer and short names. */
+static void
+bench (void)
+{
+  static unsigned char page[4096];
+  uint64_t sink = 0;
+  int64_t start, fnv, fast;
+  int i;
+
+  random_bytes (page, sizeof page);
+
+  start = timer_ticks ();
+  for (i = 0; i < 5000; i++)
+    sink += fnv_bytes (page, sizeof page);
+  fnv = timer_elapsed (start);
+  start = timer_ticks ();
+  for (i = 0; i < 5000; i++)
+    sink += hash_bytes (page, sizeof page);
+  fast = timer_elapsed (start);
+  printf ("5000 x 4 kB: hash_bytes %lld ticks, FNV %lld ticks\n", fast, fnv);
+
+  start = timer_ticks ();
+  for (i = 0; i < 500000; i++)
+    sink += fnv_bytes ("a-file-name", 11);
+  fnv = timer_elapsed (start);
+  start = timer_ticks ();
+  for (i = 0; i < 500000; i++)
+    sink += hash_string ("a-file-name");
+  fast = timer_elapsed (start);
+  printf ("500000 names: hash_string %lld ticks, FNV %lld ticks (%llu)\n",
+          fast, fnv, sink % 10);
+}
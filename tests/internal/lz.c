@@ -0,0 +1,175 @@
+/* Test program for lib/kernel/lz.c.
+
+   Compresses and decompresses buffers of random sizes holding
+   zeros, random bytes, short repeating patterns and text-like
+   data, checking that each comes back unchanged, that the output
+   never exceeds LZ_BOUND and that a smaller output buffer is
+   refused.  Then checks that corrupt input never makes
+   lz_decompress() write outside its buffer, and times both
+   directions on a page of text-like data.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <lz.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/test.h"
+#include "devices/timer.h"
+
+/* Largest buffer we will test. */
+#define MAX_SIZE 16384
+
+/* Bytes past the end of the output checked for overruns. */
+#define GUARD 64
+
+/* Kinds of data. */
+enum kind
+  {
+    KIND_ZERO,                  /* All zeros. */
+    KIND_RANDOM,                /* Random bytes. */
+    KIND_PATTERN,               /* A short random pattern, repeated. */
+    KIND_TEXT,                  /* Mostly a few letters, some noise. */
+    KIND_CNT
+  };
+
+static uint8_t src[MAX_SIZE];
+static uint8_t comp[LZ_BOUND (MAX_SIZE)];
+static uint8_t out[MAX_SIZE + GUARD];
+static uint8_t work[LZ_WORK_SIZE];
+
+static void fill (enum kind, size_t size);
+static void test_round_trip (void);
+static void test_corrupt (void);
+static void bench (void);
+
+/* Test the LZ codec. */
+void
+test (void)
+{
+  test_round_trip ();
+  test_corrupt ();
+  bench ();
+  printf ("lz: PASS\n");
+}
+
+/* Fills the first SIZE bytes of SRC with data of kind KIND. */
+static void
+fill (enum kind kind, size_t size)
+{
+  size_t period = random_ulong () % 16 + 1;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    switch (kind)
+      {
+      case KIND_ZERO:
+        src[i] = 0;
+        break;
+      case KIND_RANDOM:
+        src[i] = random_ulong ();
+        break;
+      case KIND_PATTERN:
+        src[i] = i < period ? random_ulong () : src[i - period];
+        break;
+      default:
+        src[i] = random_ulong () % 8 ? 'a' + random_ulong () % 4
+                                     : random_ulong ();
+        break;
+      }
+}
+
+/* Compresses and decompresses buffers of each kind. */
+static void
+test_round_trip (void)
+{
+  size_t raw[KIND_CNT] = { 0 }, packed[KIND_CNT] = { 0 };
+  int round;
+  int kind;
+
+  printf ("testing round trips...\n");
+  for (round = 0; round < 2000; round++)
+    {
+      size_t size = random_ulong () % (MAX_SIZE + 1);
+      size_t n;
+
+      kind = round % KIND_CNT;
+      fill (kind, size);
+      n = lz_compress (src, size, comp, sizeof comp, work);
+      ASSERT (n > 0 && n <= LZ_BOUND (size));
+      ASSERT (lz_compress (src, size, comp, n - 1, work) == 0);
+
+      n = lz_compress (src, size, comp, n, work);
+      memset (out, 0xcc, sizeof out);
+      ASSERT (lz_decompress (comp, n, out, size));
+      ASSERT (!memcmp (out, src, size));
+      ASSERT (out[size] == 0xcc);
+
+      /* The wrong output size is an error. */
+      if (size > 0)
+        {
+          ASSERT (!lz_decompress (comp, n, out, size - 1));
+        }
+      raw[kind] += size;
+      packed[kind] += n;
+    }
+
+  for (kind = 0; kind < KIND_CNT; kind++)
+    printf ("kind %d: %zu bytes compressed to %zu\n",
+            kind, raw[kind], packed[kind]);
+  ASSERT (packed[KIND_ZERO] * 100 < raw[KIND_ZERO]);
+  ASSERT (packed[KIND_PATTERN] * 10 < raw[KIND_PATTERN]);
+  ASSERT (packed[KIND_TEXT] < raw[KIND_TEXT]);
+}
+
+/* Flips random bits of compressed data and checks that
+   decompressing it stays inside the output buffer. */
+static void
+test_corrupt (void)
+{
+  int round;
+
+  printf ("testing corrupt input...\n");
+  for (round = 0; round < 2000; round++)
+    {
+      size_t size = random_ulong () % 4096 + 1;
+      size_t n, i;
+
+      fill (round % KIND_CNT, size);
+      n = lz_compress (src, size, comp, sizeof comp, work);
+      for (i = 0; i < 3; i++)
+        comp[random_ulong () % n] ^= 1 << random_ulong () % 8;
+      memset (out + size, 0xcc, GUARD);
+      lz_decompress (comp, n, out, size);
+      for (i = 0; i < GUARD; i++)
+        ASSERT (out[size + i] == 0xcc);
+    }
+}
+
+/* Times compressing and decompressing a text-like page. */
+static void
+bench (void)
+{
+  int64_t start, comp_ticks, decomp_ticks;
+  size_t n = 0;
+  int i;
+
+  fill (KIND_TEXT, 4096);
+
+  start = timer_ticks ();
+  for (i = 0; i < 2000; i++)
+    n = lz_compress (src, 4096, comp, sizeof comp, work);
+  comp_ticks = timer_elapsed (start);
+
+  start = timer_ticks ();
+  for (i = 0; i < 2000; i++)
+    lz_decompress (comp, n, out, 4096);
+  decomp_ticks = timer_elapsed (start);
+
+  printf ("2000 x 4 kB to %zu bytes: compress %lld ticks, "
+          "decompress %lld ticks\n", n, comp_ticks, decomp_ticks);
+}
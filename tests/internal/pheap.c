@@ -0,0 +1,117 @@
+/* Test program for lib/kernel/pheap.c.
+
+   Pushes, pops, removes and reprioritizes elements of a pairing
+   heap in random order, checking that elements come out sorted.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <pheap.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Maximum number of elements in a heap that we will test. */
+#define MAX_SIZE 512
+
+/* A heap element. */
+struct value
+  {
+    struct pheap_elem elem;     /* Heap element. */
+    int value;                  /* Item value. */
+    bool in_heap;               /* Currently in the heap? */
+  };
+
+static bool value_less (const struct pheap_elem *, const struct pheap_elem *,
+                        void *);
+static int pop_value (struct pheap *);
+
+/* Test the pairing heap implementation. */
+void
+test (void)
+{
+  static struct value values[MAX_SIZE];
+  struct pheap heap, other;
+  int round;
+
+  printf ("testing pairing heap:");
+  for (round = 0; round < 40; round++)
+    {
+      int size = random_ulong () % MAX_SIZE;
+      int i, last, popped;
+
+      printf (" %d", size);
+      pheap_init (&heap, value_less, NULL);
+      pheap_init (&other, value_less, NULL);
+
+      /* Push random values into two heaps, then merge them. */
+      for (i = 0; i < size; i++)
+        {
+          values[i].value = random_ulong () % 1000;
+          values[i].in_heap = true;
+          pheap_push (i % 2 ? &heap : &other, &values[i].elem);
+        }
+      pheap_merge (&heap, &other);
+      ASSERT (pheap_empty (&other));
+      ASSERT (pheap_size (&heap) == (size_t) size);
+
+      /* Decrease some values, and remove some others. */
+      for (i = 0; i < size; i++)
+        switch (random_ulong () % 4)
+          {
+          case 0:
+            values[i].value -= random_ulong () % 500;
+            pheap_decrease (&heap, &values[i].elem);
+            break;
+          case 1:
+            pheap_remove (&heap, &values[i].elem);
+            values[i].in_heap = false;
+            break;
+          }
+
+      /* Pop everything, checking the order and the count. */
+      last = -1000;
+      popped = 0;
+      while (!pheap_empty (&heap))
+        {
+          int v = pop_value (&heap);
+          ASSERT (v >= last);
+          last = v;
+          popped++;
+        }
+      for (i = 0; i < size; i++)
+        if (values[i].in_heap)
+          popped--;
+      ASSERT (popped == 0);
+      ASSERT (pheap_size (&heap) == 0);
+    }
+  printf (" done\n");
+  printf ("pheap: PASS\n");
+}
+
+/* Pops the least element of HEAP and returns its value, checking
+   that pheap_min() agrees. */
+static int
+pop_value (struct pheap *heap)
+{
+  struct pheap_elem *min = pheap_min (heap);
+  struct pheap_elem *e = pheap_pop_min (heap);
+
+  ASSERT (e == min);
+  return pheap_entry (e, struct value, elem)->value;
+}
+
+/* Returns true if value A is less than value B, false
+   otherwise. */
+static bool
+value_less (const struct pheap_elem *a_, const struct pheap_elem *b_,
+            void *aux UNUSED)
+{
+  const struct value *a = pheap_entry (a_, struct value, elem);
+  const struct value *b = pheap_entry (b_, struct value, elem);
+
+  return a->value < b->value;
+}
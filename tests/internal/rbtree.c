@@ -0,0 +1,308 @@
+/* Test program for lib/kernel/rbtree.c.
+
+   Inserts and removes elements in random order, checking the
+   red-black invariants and the order of the elements after each
+   step, then checks interval tree queries against a brute-force
+   search.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <rbtree.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Maximum number of elements in a tree that we will test. */
+#define MAX_SIZE 256
+
+/* A tree element. */
+struct value
+  {
+    struct rb_elem elem;        /* Tree element. */
+    int value;                  /* Item value. */
+  };
+
+/* An interval tree element. */
+struct range
+  {
+    struct interval_elem elem;  /* Interval tree element. */
+    bool in_tree;               /* Currently inserted? */
+  };
+
+static void test_tree (void);
+static void test_intervals (void);
+static void shuffle (struct value[], size_t);
+static void shuffle_ints (int[], size_t);
+static bool value_less (const struct rb_elem *, const struct rb_elem *,
+                        void *);
+static int check_subtree (const struct rb_elem *);
+static void verify_tree (struct rb_tree *, int size);
+
+/* Test the red-black and interval tree implementations. */
+void
+test (void)
+{
+  test_tree ();
+  test_intervals ();
+  printf ("rbtree: PASS\n");
+}
+
+/* Inserts and removes the values 0...SIZE-1 in random orders,
+   with duplicates. */
+static void
+test_tree (void)
+{
+  int size;
+
+  printf ("testing various size trees:");
+  for (size = 0; size < MAX_SIZE; size = size * 3 / 2 + 1)
+    {
+      static struct value values[MAX_SIZE * 2];
+      static int order[MAX_SIZE * 2];
+      int repeat;
+
+      printf (" %d", size);
+      for (repeat = 0; repeat < 10; repeat++)
+        {
+          struct rb_tree tree;
+          struct rb_elem *e;
+          struct value key;
+          int i;
+
+          rb_init (&tree, value_less, NULL);
+
+          /* Insert each value twice, in random order. */
+          for (i = 0; i < size * 2; i++)
+            values[i].value = i / 2;
+          shuffle (values, size * 2);
+          for (i = 0; i < size * 2; i++)
+            {
+              rb_insert (&tree, &values[i].elem);
+              if (i % 16 == 0)
+                verify_tree (&tree, i + 1);
+            }
+          verify_tree (&tree, size * 2);
+
+          /* Check lookups. */
+          for (i = -1; i <= size; i++)
+            {
+              key.value = i;
+              e = rb_find (&tree, &key.elem);
+              ASSERT ((e != NULL) == (i >= 0 && i < size));
+              if (e != NULL)
+                {
+                  ASSERT (rb_entry (e, struct value, elem)->value == i);
+                }
+
+              e = rb_lower_bound (&tree, &key.elem);
+              if (i < 0)
+                {
+                  ASSERT (e == rb_min (&tree));
+                }
+              else if (i < size)
+                {
+                  ASSERT (rb_entry (e, struct value, elem)->value == i
+                          && (rb_prev (e) == NULL
+                              || rb_entry (rb_prev (e), struct value,
+                                           elem)->value < i));
+                }
+              else
+                {
+                  ASSERT (e == NULL);
+                }
+
+              e = rb_upper_bound (&tree, &key.elem);
+              if (i + 1 < size)
+                {
+                  ASSERT (rb_entry (e, struct value, elem)->value == i + 1);
+                }
+              else
+                {
+                  ASSERT (e == NULL);
+                }
+            }
+
+          /* Remove the elements in another random order. */
+          for (i = 0; i < size * 2; i++)
+            order[i] = i;
+          shuffle_ints (order, size * 2);
+          for (i = 0; i < size * 2; i++)
+            {
+              rb_remove (&tree, &values[order[i]].elem);
+              if (i % 16 == 0)
+                check_subtree (tree.root);
+            }
+          ASSERT (rb_empty (&tree));
+          ASSERT (rb_size (&tree) == 0);
+        }
+    }
+  printf (" done\n");
+}
+
+/* Shuffles the CNT elements in ARRAY into random order. */
+static void
+shuffle (struct value *array, size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      size_t j = i + random_ulong () % (cnt - i);
+      struct value t = array[j];
+      array[j] = array[i];
+      array[i] = t;
+    }
+}
+
+/* Shuffles the CNT elements in ARRAY into random order. */
+static void
+shuffle_ints (int *array, size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      size_t j = i + random_ulong () % (cnt - i);
+      int t = array[j];
+      array[j] = array[i];
+      array[i] = t;
+    }
+}
+
+/* Returns true if value A is less than value B, false
+   otherwise. */
+static bool
+value_less (const struct rb_elem *a_, const struct rb_elem *b_,
+            void *aux UNUSED)
+{
+  const struct value *a = rb_entry (a_, struct value, elem);
+  const struct value *b = rb_entry (b_, struct value, elem);
+
+  return a->value < b->value;
+}
+
+/* Checks the parent links and red-black invariants of the
+   subtree rooted at E and returns its black height. */
+static int
+check_subtree (const struct rb_elem *e)
+{
+  int left, right;
+
+  if (e == NULL)
+    return 1;
+  ASSERT (e->left == NULL || e->left->parent == e);
+  ASSERT (e->right == NULL || e->right->parent == e);
+  ASSERT (!e->red
+          || ((e->left == NULL || !e->left->red)
+              && (e->right == NULL || !e->right->red)));
+
+  left = check_subtree (e->left);
+  right = check_subtree (e->right);
+  ASSERT (left == right);
+  return left + !e->red;
+}
+
+/* Verifies that TREE is a valid red-black tree that contains
+   SIZE elements in nondecreasing order, both forward and
+   backward. */
+static void
+verify_tree (struct rb_tree *tree, int size)
+{
+  struct rb_elem *e;
+  int i;
+
+  ASSERT (tree->root == NULL || !tree->root->red);
+  ASSERT (tree->root == NULL || tree->root->parent == NULL);
+  check_subtree (tree->root);
+  ASSERT (rb_size (tree) == (size_t) size);
+
+  for (i = 0, e = rb_min (tree); e != NULL; e = rb_next (e), i++)
+    ASSERT (rb_next (e) == NULL || !value_less (rb_next (e), e, NULL));
+  ASSERT (i == size);
+
+  for (i = 0, e = rb_max (tree); e != NULL; e = rb_prev (e), i++)
+    continue;
+  ASSERT (i == size);
+}
+
+/* Checks that the augmented values in the subtree rooted at E
+   are correct. */
+static uint64_t
+check_max_end (const struct rb_elem *e)
+{
+  const struct interval_elem *i;
+  uint64_t max_end, child;
+
+  if (e == NULL)
+    return 0;
+  i = rb_entry (e, struct interval_elem, rb_elem);
+  max_end = i->end;
+  child = check_max_end (e->left);
+  if (child > max_end)
+    max_end = child;
+  child = check_max_end (e->right);
+  if (child > max_end)
+    max_end = child;
+  ASSERT (i->max_end == max_end);
+  return max_end;
+}
+
+/* Inserts and removes random intervals, comparing the intervals
+   reported to overlap random ranges against a brute-force
+   search. */
+static void
+test_intervals (void)
+{
+  static struct range ranges[MAX_SIZE];
+  struct interval_tree tree;
+  int op, i;
+
+  printf ("testing interval tree...\n");
+  interval_tree_init (&tree);
+  for (i = 0; i < MAX_SIZE; i++)
+    ranges[i].in_tree = false;
+
+  for (op = 0; op < 20000; op++)
+    {
+      struct range *r = &ranges[random_ulong () % MAX_SIZE];
+      struct interval_elem *found;
+      uint64_t start, end, last_start;
+      int cnt, expect;
+
+      if (r->in_tree)
+        interval_tree_remove (&tree, &r->elem);
+      else
+        {
+          r->elem.start = random_ulong () % 1000;
+          r->elem.end = r->elem.start + random_ulong () % 50;
+          interval_tree_insert (&tree, &r->elem);
+        }
+      r->in_tree = !r->in_tree;
+      check_max_end (tree.tree.root);
+      check_subtree (tree.tree.root);
+
+      start = random_ulong () % 1000;
+      end = start + 1 + random_ulong () % 100;
+      expect = 0;
+      for (i = 0; i < MAX_SIZE; i++)
+        if (ranges[i].in_tree && ranges[i].elem.start < end
+            && start < ranges[i].elem.end)
+          expect++;
+
+      cnt = 0;
+      last_start = 0;
+      for (found = interval_tree_first (&tree, start, end); found != NULL;
+           found = interval_tree_next (found, start, end))
+        {
+          ASSERT (found->start < end && start < found->end);
+          ASSERT (found->start >= last_start);
+          last_start = found->start;
+          cnt++;
+        }
+      ASSERT (cnt == expect);
+    }
+}
@@ -0,0 +1,211 @@
+/* Test program for lib/kernel/rhash.c.
+
+   Checks the open-addressing hash table against a simple
+   membership array through random insertions, replacements,
+   lookups and deletions, then times it against the chained hash
+   table in lib/kernel/hash.c.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <hash.h>
+#include <random.h>
+#include <rhash.h>
+#include <stdio.h>
+#include "threads/malloc.h"
+#include "threads/test.h"
+#include "devices/timer.h"
+
+/* Number of distinct keys used in the random test. */
+#define KEY_CNT 2000
+
+/* Number of elements used for timing. */
+#define BENCH_CNT 100000
+
+/* An element that can be in either kind of table. */
+struct value
+  {
+    struct rhash_elem relem;    /* Open-addressing table element. */
+    struct hash_elem helem;     /* Chained table element. */
+    int key;                    /* Key. */
+  };
+
+static void test_random (void);
+static void bench (void);
+
+/* Test the open-addressing hash table. */
+void
+test (void)
+{
+  test_random ();
+  bench ();
+  printf ("rhash: PASS\n");
+}
+
+/* Hash and comparison functions for both tables.  Keys are
+   hashed with the identity function, to check that the table
+   copes with poorly distributed hash values. */
+static uint64_t
+value_rhash (const struct rhash_elem *e, void *aux UNUSED)
+{
+  return rhash_entry (e, struct value, relem)->key;
+}
+
+static bool
+value_rless (const struct rhash_elem *a, const struct rhash_elem *b,
+             void *aux UNUSED)
+{
+  return (rhash_entry (a, struct value, relem)->key
+          < rhash_entry (b, struct value, relem)->key);
+}
+
+static uint64_t
+value_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct value, helem)->key);
+}
+
+static bool
+value_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct value, helem)->key
+          < hash_entry (b, struct value, helem)->key);
+}
+
+/* Counts the elements visited by iteration over H. */
+static size_t
+count_iterated (struct rhash *h)
+{
+  struct rhash_iterator i;
+  size_t cnt = 0;
+
+  rhash_first (&i, h);
+  while (rhash_next (&i))
+    cnt++;
+  return cnt;
+}
+
+/* Applies random operations to a table, checking each result
+   against IN_TABLE, which records each key's current element. */
+static void
+test_random (void)
+{
+  static struct value values[2][KEY_CNT];
+  static struct value *in_table[KEY_CNT];
+  struct rhash h;
+  size_t cnt = 0;
+  int op;
+
+  printf ("testing random operations...\n");
+  ASSERT (rhash_init (&h, value_rhash, value_rless, NULL));
+  for (op = 0; op < 200000; op++)
+    {
+      int key = random_ulong () % KEY_CNT;
+      struct value *v = &values[random_ulong () % 2][key];
+      struct value *old = in_table[key];
+      struct rhash_elem *e;
+
+      /* Grow for the first half, then mostly shrink. */
+      v->key = key;
+      switch (random_ulong () % (op < 100000 ? 3 : 6))
+        {
+        case 0:
+          e = rhash_insert (&h, &v->relem);
+          if (old == NULL)
+            {
+              ASSERT (e == NULL);
+              in_table[key] = v;
+              cnt++;
+            }
+          else
+            ASSERT (e == &old->relem);
+          break;
+
+        case 1:
+          e = rhash_replace (&h, &v->relem);
+          ASSERT (old != NULL ? e == &old->relem : e == NULL);
+          if (old == NULL)
+            cnt++;
+          in_table[key] = v;
+          break;
+
+        case 2:
+          e = rhash_find (&h, &v->relem);
+          ASSERT (old != NULL ? e == &old->relem : e == NULL);
+          break;
+
+        default:
+          e = rhash_delete (&h, &v->relem);
+          ASSERT (old != NULL ? e == &old->relem : e == NULL);
+          if (old != NULL)
+            cnt--;
+          in_table[key] = NULL;
+          break;
+        }
+      ASSERT (rhash_size (&h) == cnt);
+      if (op % 10000 == 0)
+        {
+          ASSERT (count_iterated (&h) == cnt);
+        }
+    }
+  ASSERT (count_iterated (&h) == cnt);
+  rhash_clear (&h, NULL);
+  ASSERT (rhash_empty (&h));
+  rhash_destroy (&h, NULL);
+}
+
+/* Times inserting, finding and deleting BENCH_CNT elements in
+   each kind of table. */
+static void
+bench (void)
+{
+  struct value *values = malloc (sizeof *values * BENCH_CNT);
+  struct rhash rh;
+  struct hash h;
+  int64_t start, insert, find, delete;
+  int i;
+
+  ASSERT (values != NULL);
+  for (i = 0; i < BENCH_CNT; i++)
+    values[i].key = i * 4096;
+
+  ASSERT (hash_init (&h, value_hash, value_less, NULL));
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_CNT; i++)
+    hash_insert (&h, &values[i].helem);
+  insert = timer_elapsed (start);
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_CNT; i++)
+    ASSERT (hash_find (&h, &values[i].helem) != NULL);
+  find = timer_elapsed (start);
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_CNT; i++)
+    hash_delete (&h, &values[i].helem);
+  delete = timer_elapsed (start);
+  hash_destroy (&h, NULL);
+  printf ("hash:  %d elements: insert %lld, find %lld, delete %lld ticks\n",
+          BENCH_CNT, insert, find, delete);
+
+  ASSERT (rhash_init (&rh, value_rhash, value_rless, NULL));
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_CNT; i++)
+    rhash_insert (&rh, &values[i].relem);
+  insert = timer_elapsed (start);
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_CNT; i++)
+    ASSERT (rhash_find (&rh, &values[i].relem) != NULL);
+  find = timer_elapsed (start);
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_CNT; i++)
+    rhash_delete (&rh, &values[i].relem);
+  delete = timer_elapsed (start);
+  rhash_destroy (&rh, NULL);
+  printf ("rhash: %d elements: insert %lld, find %lld, delete %lld ticks\n",
+          BENCH_CNT, insert, find, delete);
+
+  free (values);
+}
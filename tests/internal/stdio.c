@@ -1,7 +1,10 @@
-/* Test program for printf() in lib/stdio.c.
+/* Test program for printf() in lib/stdio.c and strtol() in
+   lib/stdlib.c.
 
    Attempts to test printf() functionality that is not
-   sufficiently tested elsewhere in Pintos.
+   sufficiently tested elsewhere in Pintos, checks integer
+   conversions in both directions against simple reference
+   implementations, and times them.
 
    This is not a test we will run on your submitted projects.
    It is here for completeness.
@@ -9,12 +12,14 @@
 
 #undef NDEBUG
 #include <limits.h>
+#include <random.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/test.h"
+#include "devices/timer.h"
 
 /* Number of failures so far. */
 static int failure_cnt;
@@ -40,10 +45,201 @@ checkf (const char *expect, const char *format, ...)
     printf ("okay\n");
 }
 
+/* Checks that strtol() parses S in BASE as EXPECT, stopping
+   after END_OFS characters. */
+static void
+check_strtol (const char *s, int base, long expect, int end_ofs)
+{
+  char *end;
+  long value = strtol (s, &end, base);
+
+  if (value != expect || end != s + end_ofs)
+    {
+      printf ("\nFAIL: strtol (\"%s\", %d) returned %ld, %d chars, "
+              "expected %ld, %d chars\n",
+              s, base, value, (int) (end - s), expect, end_ofs);
+      failure_cnt++;
+    }
+}
+
+/* Checks that strtoul() parses S in BASE as EXPECT, stopping
+   after END_OFS characters. */
+static void
+check_strtoul (const char *s, int base, unsigned long expect, int end_ofs)
+{
+  char *end;
+  unsigned long value = strtoul (s, &end, base);
+
+  if (value != expect || end != s + end_ofs)
+    {
+      printf ("\nFAIL: strtoul (\"%s\", %d) returned %lu, %d chars, "
+              "expected %lu, %d chars\n",
+              s, base, value, (int) (end - s), expect, end_ofs);
+      failure_cnt++;
+    }
+}
+
+/* Test strtol() and strtoul(). */
+static void
+test_strtol (void)
+{
+  printf ("Testing strtol:");
+
+  check_strtol ("0", 10, 0, 1);
+  check_strtol ("  42xyz", 10, 42, 4);
+  check_strtol ("-42", 10, -42, 3);
+  check_strtol ("+42", 10, 42, 3);
+  check_strtol ("", 10, 0, 0);
+  check_strtol ("   ", 10, 0, 0);
+  check_strtol ("-", 10, 0, 0);
+  check_strtol ("x", 0, 0, 0);
+
+  /* Base detection. */
+  check_strtol ("0x1f", 0, 31, 4);
+  check_strtol ("0X1F", 0, 31, 4);
+  check_strtol ("0x1f", 16, 31, 4);
+  check_strtol ("1f", 16, 31, 2);
+  check_strtol ("017", 0, 15, 3);
+  check_strtol ("089", 0, 0, 1);
+  check_strtol ("17", 0, 17, 2);
+  check_strtol ("0x", 0, 0, 1);
+  check_strtol ("0xg", 16, 0, 1);
+  check_strtol ("0x1f", 10, 0, 1);
+  check_strtol ("zz", 36, 35 * 36 + 35, 2);
+  check_strtol ("102", 2, 2, 2);
+
+  /* Limits and overflow. */
+  check_strtol ("9223372036854775807", 10, LONG_MAX, 19);
+  check_strtol ("9223372036854775808", 10, LONG_MAX, 19);
+  check_strtol ("-9223372036854775808", 10, LONG_MIN, 20);
+  check_strtol ("-9223372036854775809", 10, LONG_MIN, 20);
+  check_strtol ("99999999999999999999999", 10, LONG_MAX, 23);
+  check_strtoul ("18446744073709551615", 10, ULONG_MAX, 20);
+  check_strtoul ("18446744073709551616", 10, ULONG_MAX, 20);
+  check_strtoul ("0xffffffffffffffff", 0, ULONG_MAX, 18);
+  check_strtoul ("0x10000000000000000", 0, ULONG_MAX, 19);
+  check_strtoul ("-1", 10, ULONG_MAX, 2);
+
+  if (atoi ("  -123abc") != -123)
+    {
+      printf ("\nFAIL: atoi\n");
+      failure_cnt++;
+    }
+  printf (" done\n");
+}
+
+/* Stores VALUE in base BASE as a null-terminated string in BUF,
+   one digit at a time, as printf() used to. */
+static void
+reference_format (unsigned long long value, int base, char *buf)
+{
+  char tmp[72];
+  char *cp = tmp;
+
+  do
+    {
+      *cp++ = "0123456789abcdef"[value % base];
+      value /= base;
+    }
+  while (value > 0);
+  while (cp > tmp)
+    *buf++ = *--cp;
+  *buf = '\0';
+}
+
+/* Returns a random value with a random number of significant
+   bits, so that all lengths of numbers are tested. */
+static unsigned long long
+random_value (void)
+{
+  unsigned long long value = random_ulong ();
+  int bits = random_ulong () % 65;
+
+  return bits < 64 ? value & ((1ULL << bits) - 1) : value;
+}
+
+/* Checks conversion of random numbers to strings and back. */
+static void
+test_random (void)
+{
+  static const struct
+    {
+      const char *format;
+      int base;
+    }
+  formats[] = {{"%llu", 10}, {"%llx", 16}, {"%llo", 8}};
+  int i;
+
+  printf ("Testing random integer conversions:");
+  for (i = 0; i < 30000; i++)
+    {
+      unsigned long long value = random_value ();
+      int f = i % 3;
+      char expect[72], actual[72];
+
+      reference_format (value, formats[f].base, expect);
+      snprintf (actual, sizeof actual, formats[f].format, value);
+      if (strcmp (expect, actual)
+          || strtoul (actual, NULL, formats[f].base) != value)
+        {
+          printf ("\nFAIL: \"%s\" of %llu gave \"%s\"\n",
+                  formats[f].format, value, actual);
+          failure_cnt++;
+        }
+    }
+  printf (" done\n");
+}
+
+/* Number of conversions timed by bench(). */
+#define BENCH_CNT 500000
+
+/* Times integer formatting and parsing. */
+static void
+bench (void)
+{
+  static unsigned long long values[1024];
+  char buf[32];
+  unsigned long sink = 0;
+  int64_t start, ref, dec, hex, parse;
+  int i;
+
+  for (i = 0; i < 1024; i++)
+    values[i] = random_value ();
+
+  /* Grouping with ' still converts a digit at a time. */
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_CNT; i++)
+    sink += snprintf (buf, sizeof buf, "%'llu", values[i % 1024]);
+  ref = timer_elapsed (start);
+
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_CNT; i++)
+    sink += snprintf (buf, sizeof buf, "%llu", values[i % 1024]);
+  dec = timer_elapsed (start);
+
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_CNT; i++)
+    sink += snprintf (buf, sizeof buf, "%llx", values[i % 1024]);
+  hex = timer_elapsed (start);
+
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_CNT; i++)
+    sink += strtoul ("18446744073709551615", NULL, 10);
+  parse = timer_elapsed (start);
+
+  printf ("%d conversions: %%'llu %lld ticks, %%llu %lld ticks, "
+          "%%llx %lld ticks, strtoul %lld ticks (%lu)\n",
+          BENCH_CNT, ref, dec, hex, parse, sink % 10);
+}
+
 /* Test printf() implementation. */
 void
 test (void) 
 {
+  test_strtol ();
+  test_random ();
+  bench ();
+
   printf ("Testing formats:");
 
   /* Check that commas show up in the right places, for positive
@@ -1,7 +1,8 @@
 /* Test program for sorting and searching in lib/stdlib.c.
 
    Attempts to test the sorting and searching functionality that
-   is not sufficiently tested elsewhere in Pintos.
+   is not sufficiently tested elsewhere in Pintos, and compares
+   the speed of qsort() and heap_sort() on a large array.
 
    This is not a test we will run on your submitted projects.
    It is here for completeness.
@@ -13,15 +14,22 @@
 #include <random.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
 #include "threads/test.h"
+#include "devices/timer.h"
 
 /* Maximum number of elements in an array that we will test. */
 #define MAX_CNT 4096
 
 static void shuffle (int[], size_t);
 static int compare_ints (const void *, const void *);
+static int compare_ints_aux (const void *, const void *, void *);
 static void verify_order (const int[], size_t);
 static void verify_bsearch (const int[], size_t);
+static void test_patterns (void);
+static void test_sizes (void);
+static void bench (void);
 
 /* Test sorting and searching implementations. */
 void
@@ -49,10 +57,18 @@ test (void)
           qsort (values, cnt, sizeof *values, compare_ints);
           verify_order (values, cnt);
           verify_bsearch (values, cnt);
+
+          /* Same with heapsort. */
+          shuffle (values, cnt);
+          heap_sort (values, cnt, sizeof *values, compare_ints_aux, NULL);
+          verify_order (values, cnt);
         }
     }
   
   printf (" done\n");
+  test_patterns ();
+  test_sizes ();
+  bench ();
   printf ("stdlib: PASS\n");
 }
 
@@ -83,6 +99,13 @@ compare_ints (const void *a_, const void *b_)
   return *a < *b ? -1 : *a > *b;
 }
 
+/* compare_ints() for sort() and heap_sort(). */
+static int
+compare_ints_aux (const void *a, const void *b, void *aux UNUSED)
+{
+  return compare_ints (a, b);
+}
+
 /* Verifies that ARRAY contains the CNT ints 0...CNT-1. */
 static void
 verify_order (const int *array, size_t cnt) 
@@ -112,3 +135,136 @@ verify_bsearch (const int *array, size_t cnt)
     ASSERT (bsearch (&not_in_array[i], array, cnt, sizeof *array, compare_ints)
             == NULL);
 }
+
+/* Verifies that the CNT ints in ARRAY are in nondecreasing
+   order. */
+static void
+verify_sorted (const int *array, size_t cnt)
+{
+  size_t i;
+
+  for (i = 1; i < cnt; i++)
+    ASSERT (array[i - 1] <= array[i]);
+}
+
+/* Sorts inputs that defeat naive quicksorts: sorted, reversed,
+   all equal, few distinct values, and "organ pipe". */
+static void
+test_patterns (void)
+{
+  static int values[MAX_CNT];
+  int pattern;
+
+  printf ("testing input patterns...\n");
+  for (pattern = 0; pattern < 5; pattern++)
+    {
+      int i;
+
+      for (i = 0; i < MAX_CNT; i++)
+        switch (pattern)
+          {
+          case 0: values[i] = i; break;
+          case 1: values[i] = MAX_CNT - i; break;
+          case 2: values[i] = 7; break;
+          case 3: values[i] = random_ulong () % 3; break;
+          default: values[i] = i < MAX_CNT / 2 ? i : MAX_CNT - i; break;
+          }
+      qsort (values, MAX_CNT, sizeof *values, compare_ints);
+      verify_sorted (values, MAX_CNT);
+    }
+}
+
+/* A 12-byte element, which cannot be swapped a word at a time. */
+struct triple
+  {
+    int key, a, b;
+  };
+
+/* A 16-byte element, which can. */
+struct pair
+  {
+    long key, check;
+  };
+
+static int
+compare_triples (const void *a_, const void *b_)
+{
+  const struct triple *a = a_, *b = b_;
+  return a->key < b->key ? -1 : a->key > b->key;
+}
+
+static int
+compare_pairs (const void *a_, const void *b_)
+{
+  const struct pair *a = a_, *b = b_;
+  return a->key < b->key ? -1 : a->key > b->key;
+}
+
+/* Sorts elements of other sizes and checks that every element
+   stays intact. */
+static void
+test_sizes (void)
+{
+  static struct triple triples[MAX_CNT];
+  static struct pair pairs[MAX_CNT];
+  int i;
+
+  printf ("testing element sizes...\n");
+  for (i = 0; i < MAX_CNT; i++)
+    {
+      triples[i].key = random_ulong () % 1000;
+      triples[i].a = triples[i].key * 3;
+      triples[i].b = ~triples[i].key;
+      pairs[i].key = random_ulong () % 1000;
+      pairs[i].check = -pairs[i].key;
+    }
+  qsort (triples, MAX_CNT, sizeof *triples, compare_triples);
+  qsort (pairs, MAX_CNT, sizeof *pairs, compare_pairs);
+  for (i = 0; i < MAX_CNT; i++)
+    {
+      ASSERT (i == 0 || triples[i - 1].key <= triples[i].key);
+      ASSERT (triples[i].a == triples[i].key * 3);
+      ASSERT (triples[i].b == ~triples[i].key);
+      ASSERT (i == 0 || pairs[i - 1].key <= pairs[i].key);
+      ASSERT (pairs[i].check == -pairs[i].key);
+    }
+}
+
+/* Number of elements sorted by the benchmark. */
+#define BENCH_CNT (1024 * 1024)
+
+/* Times qsort() and heap_sort() on the same random 1M-element
+   array. */
+static void
+bench (void)
+{
+  int *values = malloc (sizeof *values * BENCH_CNT);
+  int64_t start, quick, heap;
+  int i;
+
+  if (values == NULL)
+    {
+      printf ("not enough memory for the benchmark, skipping\n");
+      return;
+    }
+
+  random_init (1);
+  for (i = 0; i < BENCH_CNT; i++)
+    values[i] = random_ulong ();
+  start = timer_ticks ();
+  qsort (values, BENCH_CNT, sizeof *values, compare_ints);
+  quick = timer_elapsed (start);
+  verify_sorted (values, BENCH_CNT);
+
+  random_init (1);
+  for (i = 0; i < BENCH_CNT; i++)
+    values[i] = random_ulong ();
+  start = timer_ticks ();
+  heap_sort (values, BENCH_CNT, sizeof *values, compare_ints_aux, NULL);
+  heap = timer_elapsed (start);
+  verify_sorted (values, BENCH_CNT);
+
+  printf ("sorting %d ints: introsort %lld ticks, heapsort %lld ticks\n",
+          BENCH_CNT, quick, heap);
+  free (values);
+}
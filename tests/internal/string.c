@@ -0,0 +1,260 @@
+/* Test program for the block and search functions in
+   lib/string.c.
+
+   Checks memcpy(), memmove(), memset(), memcmp(), memchr() and
+   strlen() against simple byte-at-a-time versions for every
+   combination of small sizes and misalignments, then times the
+   two against each other on page-sized blocks.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/test.h"
+#include "devices/timer.h"
+
+/* Largest block size checked exhaustively. */
+#define MAX_SIZE 80
+
+/* Largest misalignment checked. */
+#define MAX_OFS 8
+
+/* Size of the blocks used for timing, and repetitions. */
+#define BENCH_SIZE 4096
+#define BENCH_REPS 20000
+
+static void test_copy (void);
+static void test_move (void);
+static void test_set (void);
+static void test_cmp (void);
+static void test_chr (void);
+static void test_strlen (void);
+static void bench (void);
+
+static unsigned char src[MAX_SIZE + 2 * MAX_OFS];
+static unsigned char dst[MAX_SIZE + 2 * MAX_OFS];
+static unsigned char ref[MAX_SIZE + 2 * MAX_OFS];
+
+/* Test the string functions. */
+void
+test (void)
+{
+  test_copy ();
+  test_move ();
+  test_set ();
+  test_cmp ();
+  test_chr ();
+  test_strlen ();
+  bench ();
+  printf ("string: PASS\n");
+}
+
+/* Fills the CNT bytes at P with random bytes. */
+static void
+randomize (unsigned char *p, size_t cnt)
+{
+  random_bytes (p, cnt);
+}
+
+/* Reference memmove(), one byte at a time. */
+static void
+slow_move (unsigned char *d, const unsigned char *s, size_t size)
+{
+  if (d < s)
+    while (size-- > 0)
+      *d++ = *s++;
+  else
+    {
+      d += size;
+      s += size;
+      while (size-- > 0)
+        *--d = *--s;
+    }
+}
+
+/* Reference memcmp(), returning -1, 0 or +1. */
+static int
+slow_cmp (const unsigned char *a, const unsigned char *b, size_t size)
+{
+  for (; size-- > 0; a++, b++)
+    if (*a != *b)
+      return *a > *b ? +1 : -1;
+  return 0;
+}
+
+/* Checks memcpy() for each size and pair of misalignments, and
+   that it writes nothing outside the destination. */
+static void
+test_copy (void)
+{
+  size_t size, so, d_o;
+
+  printf ("testing memcpy...\n");
+  for (size = 0; size <= MAX_SIZE; size++)
+    for (so = 0; so < MAX_OFS; so++)
+      for (d_o = 0; d_o < MAX_OFS; d_o++)
+        {
+          randomize (src, sizeof src);
+          randomize (dst, sizeof dst);
+          slow_move (ref, dst, sizeof ref);
+          slow_move (ref + d_o, src + so, size);
+          ASSERT (memcpy (dst + d_o, src + so, size) == dst + d_o);
+          ASSERT (slow_cmp (dst, ref, sizeof dst) == 0);
+        }
+}
+
+/* Checks memmove() for each size and overlap in both
+   directions. */
+static void
+test_move (void)
+{
+  size_t size, from, to;
+
+  printf ("testing memmove...\n");
+  for (size = 0; size <= MAX_SIZE; size++)
+    for (from = 0; from < 2 * MAX_OFS; from++)
+      for (to = 0; to < 2 * MAX_OFS; to++)
+        {
+          randomize (dst, sizeof dst);
+          slow_move (ref, dst, sizeof ref);
+          slow_move (ref + to, ref + from, size);
+          ASSERT (memmove (dst + to, dst + from, size) == dst + to);
+          ASSERT (slow_cmp (dst, ref, sizeof dst) == 0);
+        }
+}
+
+/* Checks memset() for each size and misalignment. */
+static void
+test_set (void)
+{
+  size_t size, ofs, i;
+
+  printf ("testing memset...\n");
+  for (size = 0; size <= MAX_SIZE; size++)
+    for (ofs = 0; ofs < MAX_OFS; ofs++)
+      {
+        int value = random_ulong () % 256;
+        randomize (dst, sizeof dst);
+        slow_move (ref, dst, sizeof ref);
+        for (i = 0; i < size; i++)
+          ref[ofs + i] = value;
+        ASSERT (memset (dst + ofs, value, size) == dst + ofs);
+        ASSERT (slow_cmp (dst, ref, sizeof dst) == 0);
+      }
+}
+
+/* Checks memcmp() with a single differing byte at each
+   position, both ways round. */
+static void
+test_cmp (void)
+{
+  size_t size, ofs, diff;
+
+  printf ("testing memcmp...\n");
+  for (size = 0; size <= MAX_SIZE; size++)
+    for (ofs = 0; ofs < MAX_OFS; ofs++)
+      {
+        randomize (src, sizeof src);
+        slow_move (dst, src, sizeof dst);
+        ASSERT (memcmp (dst + ofs, src, size)
+                == slow_cmp (dst + ofs, src, size));
+        ASSERT (memcmp (dst + ofs, src + ofs, size) == 0);
+        for (diff = 0; diff < size; diff++)
+          {
+            unsigned char *p = dst + ofs + diff;
+            unsigned char old = *p;
+            *p = old ^ (1 + random_ulong () % 255);
+            ASSERT (memcmp (dst + ofs, src + ofs, size)
+                    == slow_cmp (dst + ofs, src + ofs, size));
+            ASSERT (memcmp (src + ofs, dst + ofs, size)
+                    == -slow_cmp (dst + ofs, src + ofs, size));
+            *p = old;
+          }
+      }
+}
+
+/* Checks memchr() with the target byte at each position, and
+   absent. */
+static void
+test_chr (void)
+{
+  size_t size, ofs, pos;
+
+  printf ("testing memchr...\n");
+  for (size = 0; size <= MAX_SIZE; size++)
+    for (ofs = 0; ofs < MAX_OFS; ofs++)
+      {
+        memset (src, 'a', sizeof src);
+        ASSERT (memchr (src + ofs, 'b', size) == NULL);
+        for (pos = 0; pos < size; pos++)
+          {
+            src[ofs + pos] = 'b';
+            src[ofs + size] = 'b';
+            ASSERT (memchr (src + ofs, 'b', size) == src + ofs + pos);
+            src[ofs + pos] = 'a';
+            src[ofs + size] = 'a';
+          }
+        /* A match just past the end must not be found. */
+        src[ofs + size] = 'b';
+        ASSERT (memchr (src + ofs, 'b', size) == NULL);
+      }
+}
+
+/* Checks strlen() for each length and misalignment. */
+static void
+test_strlen (void)
+{
+  size_t len, ofs;
+
+  printf ("testing strlen...\n");
+  for (len = 0; len < MAX_SIZE; len++)
+    for (ofs = 0; ofs < MAX_OFS; ofs++)
+      {
+        memset (src, 0x80, sizeof src);
+        src[ofs + len] = '\0';
+        ASSERT (strlen ((char *) src + ofs) == len);
+      }
+}
+
+/* Runs FUNC on page-sized blocks BENCH_REPS times and returns
+   the number of timer ticks taken. */
+static int64_t
+time_copy (void *(*func) (void *, const void *, size_t),
+           void *d, const void *s)
+{
+  int64_t start = timer_ticks ();
+  int i;
+
+  for (i = 0; i < BENCH_REPS; i++)
+    func (d, s, BENCH_SIZE);
+  return timer_elapsed (start);
+}
+
+/* Byte-at-a-time memcpy() for comparison. */
+static void *
+byte_copy (void *d, const void *s, size_t size)
+{
+  slow_move (d, s, size);
+  return d;
+}
+
+/* Compares the speed of memcpy() and a byte copy. */
+static void
+bench (void)
+{
+  static unsigned char a[BENCH_SIZE], b[BENCH_SIZE];
+  int64_t fast, slow;
+
+  randomize (a, sizeof a);
+  slow = time_copy (byte_copy, b, a);
+  fast = time_copy (memcpy, b, a);
+  printf ("memcpy of %d x %d bytes: %lld ticks, byte loop %lld ticks\n",
+          BENCH_REPS, BENCH_SIZE, fast, slow);
+  ASSERT (memcmp (a, b, sizeof a) == 0);
+}
@@ -0,0 +1,344 @@
+/* Drives copy-on-write sharing and swapping of anonymous pages
+   from inside the kernel, so that it does not depend on the
+   system call layer.  It is not part of the graded tests.  It
+   needs a kernel with virtual memory and a swap disk; run it from
+   the vm build directory with
+   `pintos --swap-disk=4 -- -threads-tests -ul=256 -q run cow-swap',
+   and once more with -zswap=0 to send every page to the disk.
+
+   Two kernel threads stand in for a parent and a child process,
+   each with a page map and a supplemental page table of its own.
+   The parent fills SHARED_PAGES anonymous pages and the child
+   copies its table with supplemental_page_table_copy(), as fork()
+   does.  Then:
+
+   - The child writes a shared page, which must give it a copy of
+     the frame and leave the parent's contents alone.
+   - The parent writes the same page, which must reuse its frame,
+     since the child no longer shares it.
+   - The child writes more pages than there are frames, which must
+     evict shared frames, both sharers at once.
+   - The child reads the shared pages back in and rewrites one of
+     them, and then forces it out again.  The parent must still
+     find the old contents, so the child must not have written
+     over the swap slot they shared.
+
+   Finally both threads exit, which frees their pages and swap
+   slots through the usual process exit path. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
+
+#ifdef VM
+
+/* Pages shared between parent and child, and the user address
+   they start at. */
+#define SHARED_PAGES 8
+#define SHARED_BASE ((uint8_t *) 0x10000000)
+
+/* Where the child puts the pages that push the shared ones
+   out. */
+#define PRESSURE_BASE ((uint8_t *) 0x20000000)
+
+/* Extra pages written beyond the number of frames. */
+#define PRESSURE_EXTRA 64
+
+/* A kernel thread that runs steps of the test in an address space
+   of its own, as a process would. */
+struct proc
+  {
+    struct thread *thread;      /* The thread. */
+    void (*step) (void);        /* Next step to run, or null to exit. */
+    struct semaphore go;        /* Upped to run STEP. */
+    struct semaphore done;      /* Upped when STEP has run. */
+  };
+
+static struct proc parent, child;
+static size_t pressure_cnt;     /* Pages the child writes to evict. */
+static size_t evicted;          /* Index of a shared page evicted. */
+
+static thread_func proc_thread;
+static void start_proc (struct proc *, const char *name);
+static void run (struct proc *, void (*step) (void));
+static void fill (uint8_t *, int value);
+static void check (const uint8_t *, int value, const char *who);
+static void *frame_of (struct proc *, const uint8_t *);
+
+static void parent_fill (void);
+static void child_fork (void);
+static void child_write (void);
+static void parent_write (void);
+static void child_pressure (void);
+static void child_swap_in (void);
+static void parent_check (void);
+static void child_check (void);
+
+void
+test_cow_swap (void)
+{
+  void *base;
+  size_t page_cnt, free_cnt;
+
+  palloc_user_pool (&base, &page_cnt, &free_cnt);
+  pressure_cnt = page_cnt + PRESSURE_EXTRA;
+
+  start_proc (&parent, "parent");
+  start_proc (&child, "child");
+
+  run (&parent, parent_fill);
+  run (&child, child_fork);
+  run (&child, child_write);
+  run (&parent, parent_write);
+  run (&child, child_pressure);
+  run (&child, child_swap_in);
+  run (&child, child_pressure);
+  run (&parent, parent_check);
+  run (&child, child_check);
+
+  run (&child, NULL);
+  run (&parent, NULL);
+}
+
+/* Value that shared page I is filled with at first. */
+static int
+shared_value (size_t i)
+{
+  return 0x10 + i;
+}
+
+/* Allocates and fills the shared pages. */
+static void
+parent_fill (void)
+{
+  size_t i;
+
+  for (i = 0; i < SHARED_PAGES; i++)
+    {
+      uint8_t *va = SHARED_BASE + i * PGSIZE;
+
+      if (!vm_alloc_page (VM_ANON, va, true))
+        fail ("parent: vm_alloc_page failed");
+      fill (va, shared_value (i));
+    }
+  msg ("parent: filled %d pages", SHARED_PAGES);
+}
+
+/* Copies the parent's pages, which must then share frames. */
+static void
+child_fork (void)
+{
+  size_t i;
+
+  if (!supplemental_page_table_copy (&thread_current ()->spt,
+                                     &parent.thread->spt))
+    fail ("child: supplemental_page_table_copy failed");
+  for (i = 0; i < SHARED_PAGES; i++)
+    {
+      uint8_t *va = SHARED_BASE + i * PGSIZE;
+
+      if (frame_of (&child, va) == NULL
+          || frame_of (&child, va) != frame_of (&parent, va))
+        fail ("child: page %zu does not share the parent's frame", i);
+      check (va, shared_value (i), "child");
+    }
+  msg ("child: shares %d frames with parent", SHARED_PAGES);
+}
+
+/* Writes shared page 0, which must copy the frame. */
+static void
+child_write (void)
+{
+  void *frame = frame_of (&child, SHARED_BASE);
+
+  fill (SHARED_BASE, 0x80);
+  if (frame_of (&child, SHARED_BASE) == frame)
+    fail ("child: write did not copy the shared frame");
+  if (frame_of (&parent, SHARED_BASE) != frame)
+    fail ("child: write moved the parent's frame");
+  msg ("child: write fault copied the frame");
+}
+
+/* Writes page 0, which the child no longer shares, so the frame
+   must be reused rather than copied. */
+static void
+parent_write (void)
+{
+  void *frame = frame_of (&parent, SHARED_BASE);
+
+  check (SHARED_BASE, shared_value (0), "parent");
+  fill (SHARED_BASE, 0x90);
+  if (frame_of (&parent, SHARED_BASE) != frame)
+    fail ("parent: write copied a frame it no longer shares");
+  msg ("parent: write fault reused the frame");
+}
+
+/* Writes more pages than there are frames, then finds a shared
+   page that was evicted from both address spaces. */
+static void
+child_pressure (void)
+{
+  size_t i;
+
+  for (i = 0; i < pressure_cnt; i++)
+    {
+      uint8_t *va = PRESSURE_BASE + i * PGSIZE;
+
+      if (spt_find_page (&thread_current ()->spt, va) == NULL
+          && !vm_alloc_page (VM_ANON, va, true))
+        fail ("child: vm_alloc_page failed");
+      fill (va, i & 0xff);
+    }
+
+  if (evicted != 0)
+    {
+      if (frame_of (&child, SHARED_BASE + evicted * PGSIZE) != NULL)
+        fail ("child: rewritten page %zu was not evicted", evicted);
+      msg ("child: evicted the rewritten page again");
+      return;
+    }
+  for (i = 1; i < SHARED_PAGES; i++)
+    {
+      uint8_t *va = SHARED_BASE + i * PGSIZE;
+
+      if (frame_of (&parent, va) == NULL && frame_of (&child, va) == NULL)
+        {
+          evicted = i;
+          msg ("child: evicted shared pages from both processes");
+          return;
+        }
+    }
+  fail ("child: no shared page was evicted");
+}
+
+/* Reads the shared pages back in and rewrites the evicted one. */
+static void
+child_swap_in (void)
+{
+  size_t i;
+
+  for (i = 1; i < SHARED_PAGES; i++)
+    check (SHARED_BASE + i * PGSIZE, shared_value (i), "child");
+  fill (SHARED_BASE + evicted * PGSIZE, 0xa0);
+  msg ("child: swapped in shared pages and rewrote one");
+}
+
+/* Checks that the parent's pages kept its own contents. */
+static void
+parent_check (void)
+{
+  size_t i;
+
+  check (SHARED_BASE, 0x90, "parent");
+  for (i = 1; i < SHARED_PAGES; i++)
+    check (SHARED_BASE + i * PGSIZE, shared_value (i), "parent");
+  msg ("parent: contents intact");
+}
+
+/* Checks that the child's pages kept its own contents. */
+static void
+child_check (void)
+{
+  size_t i;
+
+  check (SHARED_BASE, 0x80, "child");
+  for (i = 1; i < SHARED_PAGES; i++)
+    check (SHARED_BASE + i * PGSIZE, i == evicted ? 0xa0 : shared_value (i),
+           "child");
+  msg ("child: contents intact");
+}
+
+/* Starts P as a thread named NAME and waits until it is ready. */
+static void
+start_proc (struct proc *p, const char *name)
+{
+  sema_init (&p->go, 0);
+  sema_init (&p->done, 0);
+  thread_create (name, PRI_DEFAULT, proc_thread, p);
+  sema_down (&p->done);
+}
+
+/* Has P run STEP, or exit if STEP is null, and waits for it. */
+static void
+run (struct proc *p, void (*step) (void))
+{
+  p->step = step;
+  sema_up (&p->go);
+  sema_down (&p->done);
+}
+
+static void
+proc_thread (void *p_)
+{
+  struct proc *p = p_;
+  struct thread *t = thread_current ();
+
+  t->pml4 = pml4_create ();
+  if (t->pml4 == NULL)
+    fail ("%s: out of memory", thread_name ());
+  supplemental_page_table_init (&t->spt);
+  pml4_activate (t->pml4);
+  p->thread = t;
+  sema_up (&p->done);
+
+  for (;;)
+    {
+      sema_down (&p->go);
+      if (p->step == NULL)
+        break;
+      p->step ();
+      sema_up (&p->done);
+    }
+
+  /* thread_exit() frees the pages and the page map, as for a
+     process. */
+  sema_up (&p->done);
+}
+
+/* Fills the page at VA with VALUE, faulting it in as needed. */
+static void
+fill (uint8_t *va, int value)
+{
+  memset (va, value, PGSIZE);
+}
+
+/* Fails, naming WHO, unless every byte of the page at VA is
+   VALUE. */
+static void
+check (const uint8_t *va, int value, const char *who)
+{
+  size_t i;
+
+  for (i = 0; i < PGSIZE; i++)
+    if (va[i] != value)
+      fail ("%s: byte %zu of %p is %#x, not %#x",
+            who, i, va, va[i], value);
+}
+
+/* Returns the kernel address of the frame that VA maps to in P,
+   or a null pointer if it is not resident. */
+static void *
+frame_of (struct proc *p, const uint8_t *va)
+{
+  return pml4_get_page (p->thread->pml4, va);
+}
+
+#else /* !VM */
+
+void
+test_cow_swap (void)
+{
+  msg ("this kernel has no virtual memory; "
+       "run cow-swap from the vm build");
+}
+
+#endif /* !VM */
@@ -0,0 +1,131 @@
+/* Maps a region of anonymous user pages with a 2 MB page and
+   changes one of its pages, from inside the kernel.  It is not
+   part of the graded tests.  It needs a kernel with virtual
+   memory; run it from the vm build directory with
+   `pintos -- -threads-tests -huge -q run huge-page'.
+
+   A kernel thread stands in for a process, with a page map and a
+   supplemental page table of its own.  It allocates HPG_PAGE_CNT
+   zeroed anonymous pages that fill an aligned 2 MB region and
+   reads one of them, which must map the whole region with a huge
+   page backed by contiguous frames.  It fills the pages and then
+   frees one, which must split the huge page and leave the others
+   mapped to the same frames with the same contents.  Exiting
+   frees the rest through the usual process exit path. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
+
+#ifdef VM
+
+/* Start of the region, which is 2 MB aligned. */
+#define HUGE_BASE ((uint8_t *) 0x40000000)
+
+/* Page freed to split the huge page. */
+#define FREED_PAGE 100
+
+static thread_func huge_thread;
+static bool is_huge (uint64_t *pml4);
+
+void
+test_huge_page (void)
+{
+  struct semaphore done;
+
+  if (!vm_huge_pages)
+    {
+      msg ("huge pages are off; run with -huge");
+      return;
+    }
+
+  sema_init (&done, 0);
+  thread_create ("huge", PRI_DEFAULT, huge_thread, &done);
+  sema_down (&done);
+}
+
+static void
+huge_thread (void *done_)
+{
+  struct semaphore *done = done_;
+  struct thread *t = thread_current ();
+  uint8_t *kva;
+  size_t i;
+
+  t->pml4 = pml4_create ();
+  if (t->pml4 == NULL)
+    fail ("out of memory");
+  supplemental_page_table_init (&t->spt);
+  pml4_activate (t->pml4);
+
+  for (i = 0; i < HPG_PAGE_CNT; i++)
+    if (!vm_alloc_page (VM_ANON, HUGE_BASE + i * PGSIZE, true))
+      fail ("vm_alloc_page failed");
+
+  /* One read fault maps the whole region. */
+  if (*(volatile uint8_t *) (HUGE_BASE + 5 * PGSIZE) != 0)
+    fail ("new page is not zeroed");
+  if (!is_huge (t->pml4))
+    fail ("region is not mapped with a huge page");
+  kva = pml4_get_page (t->pml4, HUGE_BASE);
+  for (i = 0; i < HPG_PAGE_CNT; i++)
+    if (pml4_get_page (t->pml4, HUGE_BASE + i * PGSIZE) != kva + i * PGSIZE)
+      fail ("page %zu is not in the huge page's frames", i);
+  msg ("read fault mapped a huge page");
+
+  for (i = 0; i < HPG_PAGE_CNT; i++)
+    memset (HUGE_BASE + i * PGSIZE, i & 0xff, PGSIZE);
+
+  /* Freeing one page splits the huge page. */
+  spt_remove_page (&t->spt,
+                   spt_find_page (&t->spt, HUGE_BASE + FREED_PAGE * PGSIZE));
+  if (is_huge (t->pml4))
+    fail ("huge page was not split");
+  if (pml4_get_page (t->pml4, HUGE_BASE + FREED_PAGE * PGSIZE) != NULL)
+    fail ("freed page is still mapped");
+  for (i = 0; i < HPG_PAGE_CNT; i++)
+    {
+      uint8_t *va = HUGE_BASE + i * PGSIZE;
+
+      if (i == FREED_PAGE)
+        continue;
+      if (pml4_get_page (t->pml4, va) != kva + i * PGSIZE)
+        fail ("page %zu moved when the huge page was split", i);
+      if (va[0] != (i & 0xff) || va[PGSIZE - 1] != (i & 0xff))
+        fail ("page %zu lost its contents when the huge page was split",
+              i);
+    }
+  msg ("freeing a page split the huge page");
+
+  /* thread_exit() frees the pages and the page map, as for a
+     process. */
+  sema_up (done);
+}
+
+/* Returns true if HUGE_BASE is mapped with a huge page in PML4. */
+static bool
+is_huge (uint64_t *pml4)
+{
+  uint64_t *pte = pml4e_walk (pml4, (uint64_t) HUGE_BASE, 0);
+
+  return pte != NULL && (*pte & PTE_P) && is_huge_pte (pte);
+}
+
+#else /* !VM */
+
+void
+test_huge_page (void)
+{
+  msg ("this kernel has no virtual memory; "
+       "run huge-page from the vm build");
+}
+
+#endif /* !VM */
@@ -0,0 +1,187 @@
+/* Benchmark for switching between two threads that run on
+   different page maps, as two processes do.  It is not part of
+   the graded tests.  It needs a kernel with user programs; run it
+   with `pintos -- -threads-tests -q run pcid-switch' from the
+   userprog or vm build directory.
+
+   Two kernel threads each get a page map of their own, with
+   TOUCH_PAGES user pages mapped in it, and hand the CPU back and
+   forth ROUNDS times.  On every turn a thread reads a byte from
+   each of its pages, so TLB entries that survive a switch show up
+   as saved cycles.  The handoffs are timed with the TSC and
+   reported in cycles per switch for three setups: both threads
+   on one page map, so that no CR3 load happens; separate page
+   maps without PCIDs; and separate page maps with PCIDs, if the
+   CPU supports them.  Each setup hands off once by blocking on
+   semaphores and once with thread_yield(). */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+#ifdef USERPROG
+
+/* Number of turns each thread takes. */
+#define ROUNDS 10000
+
+/* Number of user pages each thread reads on each turn, and the
+   user address they are mapped at. */
+#define TOUCH_PAGES 16
+#define TOUCH_BASE ((uint8_t *) 0x10000000)
+
+/* One of the two threads. */
+struct player
+  {
+    uint64_t *pml4;             /* Page map to run on. */
+    struct semaphore turn;      /* Upped when it may run. */
+    struct player *other;       /* The other thread. */
+    bool yield;                 /* Hand off with thread_yield()? */
+    struct semaphore *done;     /* Upped when it has finished. */
+  };
+
+static thread_func player_thread;
+static uint64_t *make_pml4 (void);
+static long long play (uint64_t *pml4_a, uint64_t *pml4_b, bool yield);
+static void report (const char *setup, uint64_t *pml4_a, uint64_t *pml4_b);
+
+void
+test_pcid_switch (void)
+{
+  uint64_t *shared = make_pml4 ();
+  uint64_t *pml4_a = make_pml4 ();
+  uint64_t *pml4_b = make_pml4 ();
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  report ("one page map", shared, shared);
+  pcid_set_enabled (false);
+  report ("two page maps, no PCIDs", pml4_a, pml4_b);
+  if (pcid_set_enabled (true))
+    report ("two page maps, PCIDs", pml4_a, pml4_b);
+  else
+    msg ("two page maps, PCIDs: not supported by this CPU");
+
+  pml4_destroy (shared);
+  pml4_destroy (pml4_a);
+  pml4_destroy (pml4_b);
+}
+
+/* Times both kinds of handoff between threads on PML4_A and
+   PML4_B and prints the cycles per switch under SETUP. */
+static void
+report (const char *setup, uint64_t *pml4_a, uint64_t *pml4_b)
+{
+  long long sema = play (pml4_a, pml4_b, false);
+  long long yield = play (pml4_a, pml4_b, true);
+
+  msg ("%s: %lld cycles per switch with semaphores, "
+       "%lld with thread_yield()", setup, sema, yield);
+}
+
+/* Runs two threads on PML4_A and PML4_B for ROUNDS turns each,
+   handing off with thread_yield() if YIELD is true or through
+   semaphores otherwise.  Returns the cycles per switch. */
+static long long
+play (uint64_t *pml4_a, uint64_t *pml4_b, bool yield)
+{
+  struct player a, b;
+  struct semaphore done;
+  uint64_t start;
+
+  sema_init (&done, 0);
+  a.pml4 = pml4_a;
+  b.pml4 = pml4_b;
+  a.other = &b;
+  b.other = &a;
+  sema_init (&a.turn, 0);
+  sema_init (&b.turn, 0);
+  a.yield = b.yield = yield;
+  a.done = b.done = &done;
+  thread_create ("player a", PRI_DEFAULT, player_thread, &a);
+  thread_create ("player b", PRI_DEFAULT, player_thread, &b);
+
+  /* With semaphores, A goes first and lets B go.  With
+     thread_yield(), both run from the start. */
+  start = rdtsc ();
+  sema_up (&a.turn);
+  if (yield)
+    sema_up (&b.turn);
+  sema_down (&done);
+  sema_down (&done);
+  return (rdtsc () - start) / (2 * ROUNDS);
+}
+
+static void
+player_thread (void *p_)
+{
+  struct player *p = p_;
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+  int i, j;
+
+  /* Run on P's page map from now on, as a process would. */
+  t->pml4 = p->pml4;
+  pml4_activate (p->pml4);
+
+  sema_down (&p->turn);
+  for (i = 0; i < ROUNDS; i++)
+    {
+      for (j = 0; j < TOUCH_PAGES; j++)
+        (void) *(volatile uint8_t *) (TOUCH_BASE + j * PGSIZE);
+
+      if (p->yield)
+        thread_yield ();
+      else
+        {
+          sema_up (&p->other->turn);
+          if (i + 1 < ROUNDS)
+            sema_down (&p->turn);
+        }
+    }
+
+  /* Exit as a kernel thread, so that thread_exit() does not tear
+     down the page map, which the main thread destroys. */
+  old_level = intr_disable ();
+  t->pml4 = NULL;
+  intr_set_level (old_level);
+  sema_up (p->done);
+}
+
+/* Returns a new page map with TOUCH_PAGES zeroed pages mapped
+   read-only at TOUCH_BASE.  pml4_destroy() frees the pages. */
+static uint64_t *
+make_pml4 (void)
+{
+  uint64_t *pml4 = pml4_create ();
+  int i;
+
+  if (pml4 == NULL)
+    fail ("out of memory");
+  for (i = 0; i < TOUCH_PAGES; i++)
+    {
+      void *kpage = palloc_get_page (PAL_ZERO);
+      if (kpage == NULL
+          || !pml4_set_page (pml4, TOUCH_BASE + i * PGSIZE, kpage, false))
+        fail ("out of memory");
+    }
+  return pml4;
+}
+
+#else /* !USERPROG */
+
+void
+test_pcid_switch (void)
+{
+  msg ("this kernel has no user page maps; "
+       "run pcid-switch from the userprog or vm build");
+}
+
+#endif /* !USERPROG */
@@ -38,6 +38,9 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"pcid-switch", test_pcid_switch},
+    {"cow-swap", test_cow_swap},
+    {"huge-page", test_huge_page},
   };
 
 static const char *test_name;
@@ -32,6 +32,9 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_pcid_switch;
+extern test_func test_cow_swap;
+extern test_func test_huge_page;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
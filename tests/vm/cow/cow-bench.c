@@ -0,0 +1,65 @@
+/* Benchmark for fork().  It is not part of the graded tests; run
+   it with `pintos -p tests/vm/cow/cow-bench:cow-bench -- -q -f
+   run cow-bench' and compare the cycle counts it prints, for
+   example with and without copy-on-write.
+
+   Times fork() at several resident set sizes, checking each time
+   that the child sees the parent's data and that a write by the
+   child is not seen by the parent.  With copy-on-write, fork()
+   shares the parent's frames instead of copying them, so its cost
+   should grow far more slowly than the resident set. */
+
+#include <syscall.h>
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define MAX_PAGES 512
+
+static char buf[MAX_PAGES * PAGE_SIZE];
+
+/* Returns the processor's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+void
+test_main (void)
+{
+  static const int sizes[] = {1, 16, 64, 256, MAX_PAGES};
+  size_t i;
+
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      int pages = sizes[i];
+      uint64_t start, cycles;
+      pid_t child;
+      int j;
+
+      /* Bring the pages in, dirty. */
+      for (j = 0; j < pages; j++)
+        buf[j * PAGE_SIZE] = i + j;
+
+      start = rdtsc ();
+      child = fork ("child");
+      if (child == 0)
+        {
+          for (j = 0; j < pages; j++)
+            if (buf[j * PAGE_SIZE] != (char) (i + j))
+              exit (1);
+          buf[0] = '@';
+          exit (0);
+        }
+      cycles = rdtsc () - start;
+
+      CHECK (wait (child) == 0, "child saw parent's data");
+      CHECK (buf[0] == (char) i, "parent did not see child's write");
+      msg ("fork with %d resident pages: %llu cycles", pages, cycles);
+    }
+}
@@ -8,6 +8,7 @@
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/memtag.h"
 #include "threads/mmu.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
@@ -31,6 +32,7 @@
 #include "tests/threads/tests.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/zswap.h"
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
@@ -160,19 +162,35 @@ static void paging_init(uint64_t mem_end) {
     extern char start, _end_kernel_text;
     // Maps physical address [0 ~ mem_end] to
     //   [LOADER_KERN_BASE ~ LOADER_KERN_BASE + mem_end].
-    for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
+    // Every 2 MB region that lies entirely within memory and does not
+    // hold kernel text is mapped with a single huge page, which saves
+    // page tables and TLB entries.  The rest is mapped with 4 kB pages,
+    // so that the kernel text can stay read-only.
+    for (uint64_t pa = 0; pa < mem_end;) {
         uint64_t va = (uint64_t)ptov(pa);
 
+        if ((pa & HPGMASK) == 0 && pa + HPGSIZE <= mem_end &&
+            (va + HPGSIZE <= (uint64_t)&start || va >= (uint64_t)&_end_kernel_text)) {
+            if ((pte = pml4e_walk_huge(pml4, va, 1)) != NULL)
+                *pte = pa | PTE_P | PTE_W | PTE_PS;
+            pa += HPGSIZE;
+            continue;
+        }
+
         perm = PTE_P | PTE_W;
         if ((uint64_t)&start <= va && va < (uint64_t)&_end_kernel_text)
             perm &= ~PTE_W;
 
         if ((pte = pml4e_walk(pml4, va, 1)) != NULL)
             *pte = pa | perm;
+        pa += PGSIZE;
     }
 
     // reload cr3
     pml4_activate(0);
+
+    // Tag TLB entries with PCIDs, if the CPU supports them.
+    pcid_init();
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -227,11 +245,23 @@ static char **parse_options(char **argv) {
             random_init(atoi(value));
         else if (!strcmp(name, "-mlfqs"))
             thread_mlfqs = true;
+        else if (!strcmp(name, "-memtag"))
+            memtag_enabled = true;
 #ifdef USERPROG
         else if (!strcmp(name, "-ul"))
             user_page_limit = atoi(value);
         else if (!strcmp(name, "-threads-tests"))
             thread_tests = true;
+#endif
+#ifdef VM
+        else if (!strcmp(name, "-fault-around"))
+            vm_fault_around_pages = atoi(value);
+        else if (!strcmp(name, "-zswap"))
+            zswap_pool_pages = atoi(value);
+        else if (!strcmp(name, "-dirty-ratio"))
+            vm_dirty_ratio = atoi(value);
+        else if (!strcmp(name, "-huge"))
+            vm_huge_pages = true;
 #endif
         else
             PANIC("unknown option `%s' (use -h for help)", name);
@@ -325,8 +355,15 @@ static void usage(void) {
            "  -f                 Format file system disk during startup.\n"
            "  -rs=SEED           Set random number seed to SEED.\n"
            "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+           "  -memtag            Account kernel memory by allocation site.\n"
 #ifdef USERPROG
            "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+           "  -fault-around=N    Map up to N pages around a file page fault.\n"
+           "  -zswap=N           Keep up to N pages of compressed swap in memory.\n"
+           "  -dirty-ratio=N     Write back mapped pages above N%% of frames dirty.\n"
+           "  -huge              Map large zeroed user regions with 2 MB pages.\n"
 #endif
     );
     power_off();
@@ -356,7 +393,13 @@ static void print_stats(void) {
 #endif
     console_print_stats();
     kbd_print_stats();
+    mmu_print_stats();
+    memtag_print_stats();
 #ifdef USERPROG
     exception_print_stats();
+    process_print_stats();
+#endif
+#ifdef VM
+    vm_print_stats();
 #endif
 }
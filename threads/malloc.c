@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/memtag.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -32,7 +33,12 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   With -memtag, each block is preceded by a small header that
+   remembers the memory accounting tag charged for the block and
+   the size the caller asked for, so that free() can credit the
+   same tag.  See memtag.h. */
 
 /* Descriptor. */
 struct desc {
@@ -57,12 +63,23 @@ struct block {
 	struct list_elem free_elem; /* Free list element. */
 };
 
+/* Memory accounting header, present only with -memtag.
+   Its size keeps blocks 16-byte aligned. */
+struct tag_header {
+	size_t size;                /* Requested size in bytes. */
+	uint16_t tag;               /* Tag charged for the block. */
+	uint8_t pad[6];             /* Padding to 16 bytes. */
+};
+
 /* Our set of descriptors. */
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static void *malloc_raw (size_t size);
+static void free_raw (void *p);
+static void *malloc_tagged (size_t size, const void *site);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -83,6 +100,34 @@ malloc_init (void) {
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) {
+	return malloc_tagged (size, __builtin_return_address (0));
+}
+
+/* Like malloc(), but charges the block to call site SITE if
+   memory accounting is enabled. */
+static void *
+malloc_tagged (size_t size, const void *site) {
+	struct tag_header *h;
+
+	if (!memtag_enabled)
+		return malloc_raw (size);
+
+	/* A null pointer satisfies a request for 0 bytes. */
+	if (size == 0)
+		return NULL;
+
+	h = malloc_raw (size + sizeof *h);
+	if (h == NULL)
+		return NULL;
+	h->size = size;
+	h->tag = memtag_alloc (MEMTAG_MALLOC, site, size);
+	return h + 1;
+}
+
+/* Obtains a new block of at least SIZE bytes, without memory
+   accounting. */
+static void *
+malloc_raw (size_t size) {
 	struct desc *d;
 	struct block *b;
 	struct arena *a;
@@ -156,7 +201,7 @@ calloc (size_t a, size_t b) {
 		return NULL;
 
 	/* Allocate and zero memory. */
-	p = malloc (size);
+	p = malloc_tagged (size, __builtin_return_address (0));
 	if (p != NULL)
 		memset (p, 0, size);
 
@@ -167,9 +212,14 @@ calloc (size_t a, size_t b) {
 static size_t
 block_size (void *block) {
 	struct block *b = block;
-	struct arena *a = block_to_arena (b);
-	struct desc *d = a->desc;
+	struct arena *a;
+	struct desc *d;
 
+	if (memtag_enabled)
+		return ((struct tag_header *) block - 1)->size;
+
+	a = block_to_arena (b);
+	d = a->desc;
 	return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
 
@@ -185,7 +235,8 @@ realloc (void *old_block, size_t new_size) {
 		free (old_block);
 		return NULL;
 	} else {
-		void *new_block = malloc (new_size);
+		void *new_block = malloc_tagged (new_size,
+				__builtin_return_address (0));
 		if (old_block != NULL && new_block != NULL) {
 			size_t old_size = block_size (old_block);
 			size_t min_size = new_size < old_size ? new_size : old_size;
@@ -200,6 +251,18 @@ realloc (void *old_block, size_t new_size) {
    malloc(), calloc(), or realloc(). */
 void
 free (void *p) {
+	if (p != NULL && memtag_enabled) {
+		struct tag_header *h = (struct tag_header *) p - 1;
+		memtag_free (h->tag, h->size);
+		p = h;
+	}
+	free_raw (p);
+}
+
+/* Frees block P, which must have been obtained from
+   malloc_raw(). */
+static void
+free_raw (void *p) {
 	if (p != NULL) {
 		struct block *b = p;
 		struct arena *a = block_to_arena (b);
@@ -0,0 +1,201 @@
+#include "threads/memtag.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+
+/* Kernel memory accounting by call site.
+
+   Tags live in a fixed-size open-addressing table keyed by the
+   return address of the allocating call.  The table is static
+   because it is updated from inside malloc() and palloc, so it
+   must not allocate memory itself.  Once the table fills up,
+   further call sites are charged to the catch-all tag 0.
+
+   The table is updated with interrupts disabled, which is cheap
+   compared to the allocation itself and safe from every context
+   that may allocate or free memory, including the scheduler
+   freeing dying threads. */
+
+/* Number of distinct call sites we can track. */
+#define MEMTAG_CNT 512
+
+/* A tag whose live count grew across this many consecutive
+   process lifetimes is reported as a possible leak. */
+#define MEMTAG_LEAK_STREAK 4
+
+/* Per-call-site statistics. */
+struct memtag {
+	const void *site;           /* Call site, null if slot unused. */
+	enum memtag_kind kind;      /* Allocator that was called. */
+	size_t live_bytes;          /* Bytes currently allocated. */
+	size_t peak_bytes;          /* Maximum of LIVE_BYTES. */
+	size_t live_cnt;            /* Allocations not yet freed. */
+	size_t alloc_cnt;           /* Allocations ever made. */
+	size_t last_live_cnt;       /* LIVE_CNT at previous checkpoint. */
+	unsigned grow_streak;       /* Consecutive checkpoints of growth. */
+};
+
+/* -memtag: Account kernel allocations by call site? */
+bool memtag_enabled;
+
+/* Tag 0 collects untracked call sites; tags 1...MEMTAG_CNT
+   are the hash table proper. */
+static struct memtag tags[MEMTAG_CNT + 1];
+static size_t tag_cnt;          /* Number of used slots. */
+static size_t checkpoint_cnt;   /* Number of memtag_checkpoint() calls. */
+
+static void charge (struct memtag *, size_t bytes);
+
+/* Returns the tag for SITE, creating it if necessary. */
+static uint16_t
+lookup (enum memtag_kind kind, const void *site) {
+	uint64_t h = (uint64_t) site * 0x9e3779b97f4a7c15ULL;
+	size_t idx = (h >> 32) % MEMTAG_CNT;
+	size_t i;
+
+	for (i = 0; i < MEMTAG_CNT; i++) {
+		struct memtag *t = &tags[idx + 1];
+		if (t->site == site && t->kind == kind)
+			return idx + 1;
+		if (t->site == NULL) {
+			/* Keep a quarter of the table free so that probe
+			   sequences stay short. */
+			if (tag_cnt >= MEMTAG_CNT * 3 / 4)
+				break;
+			t->site = site;
+			t->kind = kind;
+			tag_cnt++;
+			return idx + 1;
+		}
+		idx = (idx + 1) % MEMTAG_CNT;
+	}
+	return 0;
+}
+
+/* Charges an allocation of BYTES bytes made through allocator
+   KIND at call site SITE.  Returns the tag that the caller must
+   later pass to memtag_free(). */
+uint16_t
+memtag_alloc (enum memtag_kind kind, const void *site, size_t bytes) {
+	enum intr_level old_level;
+	uint16_t tag;
+
+	if (!memtag_enabled)
+		return 0;
+
+	old_level = intr_disable ();
+	tag = lookup (kind, site);
+	charge (&tags[tag], bytes);
+	intr_set_level (old_level);
+	return tag;
+}
+
+/* Credits BYTES bytes back to TAG. */
+void
+memtag_free (uint16_t tag, size_t bytes) {
+	enum intr_level old_level;
+	struct memtag *t;
+
+	if (!memtag_enabled)
+		return;
+	ASSERT (tag <= MEMTAG_CNT);
+
+	old_level = intr_disable ();
+	t = &tags[tag];
+	/* Pages may be freed in smaller runs than they were
+	   allocated in, so don't let the counts wrap around. */
+	t->live_bytes -= bytes < t->live_bytes ? bytes : t->live_bytes;
+	if (t->live_cnt > 0)
+		t->live_cnt--;
+	intr_set_level (old_level);
+}
+
+/* Marks the end of a process lifetime.  Tags whose live count
+   keeps growing from one checkpoint to the next are reported as
+   possible leaks. */
+void
+memtag_checkpoint (void) {
+	enum intr_level old_level;
+	size_t i;
+
+	if (!memtag_enabled)
+		return;
+
+	old_level = intr_disable ();
+	for (i = 0; i <= MEMTAG_CNT; i++) {
+		struct memtag *t = &tags[i];
+		if (t->live_cnt > t->last_live_cnt)
+			t->grow_streak++;
+		else
+			t->grow_streak = 0;
+		t->last_live_cnt = t->live_cnt;
+	}
+	checkpoint_cnt++;
+	intr_set_level (old_level);
+}
+
+/* Prints a single tag. */
+static void
+print_tag (const struct memtag *t) {
+	printf ("  %18p %-6s %10zu B live (%zu), %10zu B peak, %zu allocs\n",
+			t->site, t->kind == MEMTAG_MALLOC ? "malloc" : "palloc",
+			t->live_bytes, t->live_cnt, t->peak_bytes, t->alloc_cnt);
+}
+
+/* Prints the TOP_CNT tags holding the most live memory, followed
+   by the tags that look like they leak across process
+   lifetimes.  Call sites are printed as addresses; the
+   `backtrace' program translates them into function names. */
+void
+memtag_dump (size_t top_cnt) {
+	static uint16_t order[MEMTAG_CNT + 1];
+	size_t order_cnt = 0;
+	size_t live_bytes = 0;
+	size_t i, j;
+
+	if (!memtag_enabled)
+		return;
+
+	/* Sort used tags by live bytes, largest first.  The table is
+	   small, so insertion sort is fine. */
+	for (i = 0; i <= MEMTAG_CNT; i++) {
+		struct memtag *t = &tags[i];
+		if (t->alloc_cnt == 0)
+			continue;
+		live_bytes += t->live_bytes;
+		for (j = order_cnt++; j > 0
+				&& tags[order[j - 1]].live_bytes < t->live_bytes; j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
+
+	printf ("Memtag: %zu call sites, %zu bytes live, %zu checkpoints\n",
+			order_cnt, live_bytes, checkpoint_cnt);
+	for (i = 0; i < order_cnt && i < top_cnt; i++)
+		print_tag (&tags[order[i]]);
+
+	for (i = 0; i < order_cnt; i++) {
+		struct memtag *t = &tags[order[i]];
+		if (t->grow_streak >= MEMTAG_LEAK_STREAK) {
+			printf ("Memtag: possible leak, growing for %u checkpoints:\n",
+					t->grow_streak);
+			print_tag (t);
+		}
+	}
+}
+
+/* Prints memory accounting statistics at shutdown. */
+void
+memtag_print_stats (void) {
+	memtag_dump (10);
+}
+
+/* Adds an allocation of BYTES bytes to T. */
+static void
+charge (struct memtag *t, size_t bytes) {
+	t->live_bytes += bytes;
+	t->live_cnt++;
+	t->alloc_cnt++;
+	if (t->live_bytes > t->peak_bytes)
+		t->peak_bytes = t->live_bytes;
+}
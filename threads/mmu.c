@@ -1,18 +1,105 @@
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Process-context identifiers (PCIDs).
+ *
+ * Without PCIDs, every load of CR3 flushes the whole TLB, so each
+ * switch between processes starts with a cold TLB.  With PCIDs,
+ * TLB entries are tagged with the PCID in the low 12 bits of CR3,
+ * and loading CR3 with CR3_NOFLUSH set keeps the entries of every
+ * PCID.
+ *
+ * PCID 0 belongs to base_pml4, whose kernel-only mappings never
+ * change.  Processes share the PCIDs in pcid_slots[].  Activating
+ * a page map stamps its slot with a new generation number.  When a
+ * page map without a slot is activated, the slot with the oldest
+ * generation is recycled, and the CR3 load flushes the entries
+ * left behind by its previous owner.
+ *
+ * A PCID holds on to the entries of its page map while the page
+ * map is not active, where invlpg cannot reach them.  So changing
+ * a page map that is not active takes its slot away (see
+ * invalidate()), and its next activation flushes. */
+
+#define CR4_PCIDE (1UL << 17)           /* CR4: enable PCIDs. */
+#define CR3_NOFLUSH (1UL << 63)         /* CR3 load: keep the TLB. */
+#define CPUID_1_ECX_PCID (1U << 17)     /* CPUID leaf 1: PCIDs supported. */
+#define PCID_SLOT_CNT 16                /* PCIDs 1...16 for processes. */
+
+/* A PCID that may be in use by a process. */
+struct pcid_slot {
+	uint64_t *pml4;             /* Owning page map, or null. */
+	uint64_t gen;               /* Generation of the last activation. */
+};
+
+static bool pcid_enabled;
+static struct pcid_slot pcid_slots[PCID_SLOT_CNT];
+static uint64_t pcid_gen;       /* Last generation handed out. */
+
+/* Statistics. */
+static long long cr3_flush_cnt;     /* CR3 loads that flushed. */
+static long long cr3_noflush_cnt;   /* CR3 loads that kept the TLB. */
+static long long cr3_skip_cnt;      /* Switches without a CR3 load. */
+static long long pcid_recycle_cnt;  /* Slots taken from another page map. */
+static long long tlb_invlpg_cnt;    /* Single-page invalidations. */
+static long long tlb_full_flush_cnt; /* Batches flushed by a CR3 reload. */
+static long long huge_map_cnt;      /* Huge user pages mapped. */
+static long long huge_split_cnt;    /* ...of those, split into 4 kB pages. */
+
+/* Huge user pages.
+ *
+ * pml4_set_huge_page() maps 2 MB of user memory with a single
+ * page directory entry.  The pages in it can still be changed one
+ * at a time: the first change to one of them other than to its
+ * accessed or dirty bit, including unmapping it, splits the huge
+ * page into a page table of 4 kB pages with the same flags.  The
+ * accessed and dirty bits of a huge page stay shared by all of its
+ * pages.
+ *
+ * Splitting never fails, because each huge user page mapped holds
+ * a page table in reserve for it.  The reserve is a list linked
+ * through the first entry of each table, with interrupts off for
+ * mutual exclusion. */
+static uint64_t *pt_reserve;
+
+/* Adds PT to the reserve. */
+static void
+pt_reserve_push (uint64_t *pt) {
+	enum intr_level old_level = intr_disable ();
+	pt[0] = (uint64_t) pt_reserve;
+	pt_reserve = pt;
+	intr_set_level (old_level);
+}
+
+/* Takes a page table from the reserve, which must not be empty. */
+static uint64_t *
+pt_reserve_pop (void) {
+	enum intr_level old_level = intr_disable ();
+	uint64_t *pt = pt_reserve;
+
+	ASSERT (pt != NULL);
+	pt_reserve = (uint64_t *) pt[0];
+	intr_set_level (old_level);
+	return pt;
+}
+
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
 	if (pdp) {
 		uint64_t *pte = (uint64_t *) pdp[idx];
+		/* A huge page has no page table: its PDE is the PTE. */
+		if (((uint64_t) pte & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS))
+			return &pdp[idx];
 		if (!((uint64_t) pte & PTE_P)) {
 			if (create) {
 				uint64_t *new_page = palloc_get_page (PAL_ZERO);
@@ -60,7 +147,9 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
  * If PML4E does not have a page table for VADDR, behavior depends
  * on CREATE.  If CREATE is true, then a new page table is
  * created and a pointer into it is returned.  Otherwise, a null
- * pointer is returned. */
+ * pointer is returned.
+ * If VADDR lies in a huge page, the returned entry is the page
+ * directory entry that maps it, which has PTE_PS set. */
 uint64_t *
 pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	uint64_t *pte = NULL;
@@ -88,6 +177,157 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	return pte;
 }
 
+/* Returns the address of the page directory entry for virtual
+ * address VA in PML4, which maps VA's 2 MB region either to a
+ * page table or, with PTE_PS, to a huge page.  If the upper
+ * level tables do not exist, they are created if CREATE is true;
+ * otherwise, or if memory allocation fails, returns a null
+ * pointer. */
+uint64_t *
+pml4e_walk_huge (uint64_t *pml4, const uint64_t va, int create) {
+	uint64_t *table = pml4;
+	const int idx[2] = { PML4 (va), PDPE (va) };
+
+	for (int level = 0; level < 2; level++) {
+		uint64_t *e = &table[idx[level]];
+		if (!(*e & PTE_P)) {
+			uint64_t *new_page;
+			if (!create)
+				return NULL;
+			new_page = palloc_get_page (PAL_ZERO);
+			if (new_page == NULL)
+				return NULL;
+			*e = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+		}
+		table = ptov (PTE_ADDR (*e));
+	}
+	return &table[PDX (va)];
+}
+
+/* Returns true if PML4 is the page map the CPU is using. */
+static bool
+is_active (uint64_t *pml4) {
+	return PTE_ADDR (rcr3 ()) == vtop (pml4);
+}
+
+/* Gives up the PCID slot of PML4, if it has one, so that its TLB
+ * entries are flushed on its next activation. */
+static void
+pcid_forget (uint64_t *pml4) {
+	enum intr_level old_level;
+
+	if (!pcid_enabled)
+		return;
+
+	old_level = intr_disable ();
+	for (struct pcid_slot *slot = pcid_slots;
+			slot < pcid_slots + PCID_SLOT_CNT; slot++)
+		if (slot->pml4 == pml4) {
+			slot->pml4 = NULL;
+			slot->gen = 0;
+		}
+	intr_set_level (old_level);
+}
+
+/* Loads PML4 into CR3 under its PCID, assigning one if needed.
+ * Interrupts must be off. */
+static void
+pcid_load (uint64_t *pml4) {
+	struct pcid_slot *slot, *victim = pcid_slots;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (slot = pcid_slots; slot < pcid_slots + PCID_SLOT_CNT; slot++) {
+		if (slot->pml4 == pml4) {
+			slot->gen = ++pcid_gen;
+			lcr3 (vtop (pml4) | (slot - pcid_slots + 1) | CR3_NOFLUSH);
+			cr3_noflush_cnt++;
+			return;
+		}
+		if (slot->gen < victim->gen)
+			victim = slot;
+	}
+
+	/* Recycle the least recently activated PCID.  Loading CR3
+	 * without CR3_NOFLUSH drops whatever it still caches. */
+	if (victim->pml4 != NULL)
+		pcid_recycle_cnt++;
+	victim->pml4 = pml4;
+	victim->gen = ++pcid_gen;
+	lcr3 (vtop (pml4) | (victim - pcid_slots + 1));
+	cr3_flush_cnt++;
+}
+
+/* Invalidates the TLB entry for VA in PML4 after its page table
+ * entry changed. */
+static void
+invalidate (uint64_t *pml4, uint64_t va) {
+	/* Don't let a context switch change CR3 between the check and
+	 * the invlpg. */
+	enum intr_level old_level = intr_disable ();
+	if (is_active (pml4)) {
+		invlpg (va);
+		tlb_invlpg_cnt++;
+	} else
+		pcid_forget (pml4);
+	intr_set_level (old_level);
+}
+
+/* Enables PCIDs, if the CPU supports them.  Must be called while
+ * base_pml4 is active, which uses PCID 0. */
+void
+pcid_init (void) {
+	if (!(cpuid_ecx (1) & CPUID_1_ECX_PCID))
+		return;
+
+	ASSERT (is_active (base_pml4) && (rcr3 () & PGMASK) == 0);
+	lcr4 (rcr4 () | CR4_PCIDE);
+	pcid_enabled = true;
+}
+
+/* Turns PCIDs on or off at run time, so that a benchmark can
+ * compare the two.  Loads base_pml4, so it must be called from a
+ * kernel thread.  Every slot is forgotten, because a CR4.PCIDE
+ * change flushes the TLB anyway.  Returns whether PCIDs are now
+ * on, which they cannot be if the CPU does not support them. */
+bool
+pcid_set_enabled (bool enable) {
+	enum intr_level old_level;
+
+	if (enable && !(cpuid_ecx (1) & CPUID_1_ECX_PCID))
+		enable = false;
+
+	old_level = intr_disable ();
+	/* CR4.PCIDE may only be set while CR3 holds PCID 0. */
+	lcr3 (vtop (base_pml4));
+	cr3_flush_cnt++;
+	for (struct pcid_slot *slot = pcid_slots;
+			slot < pcid_slots + PCID_SLOT_CNT; slot++) {
+		slot->pml4 = NULL;
+		slot->gen = 0;
+	}
+	if (enable)
+		lcr4 (rcr4 () | CR4_PCIDE);
+	else
+		lcr4 (rcr4 () & ~CR4_PCIDE);
+	pcid_enabled = enable;
+	intr_set_level (old_level);
+	return enable;
+}
+
+/* Prints TLB statistics. */
+void
+mmu_print_stats (void) {
+	printf ("TLB: %lld flushing CR3 loads, %lld non-flushing, "
+			"%lld skipped, %lld PCID recycles (PCIDs %s)\n",
+			cr3_flush_cnt, cr3_noflush_cnt, cr3_skip_cnt, pcid_recycle_cnt,
+			pcid_enabled ? "on" : "off");
+	printf ("TLB: %lld invlpgs, %lld batched full flushes\n",
+			tlb_invlpg_cnt, tlb_full_flush_cnt);
+	printf ("TLB: %lld huge user pages mapped, %lld split\n",
+			huge_map_cnt, huge_split_cnt);
+}
+
 /* Creates a new page map level 4 (pml4) has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
  * Returns the new page directory, or a null pointer if memory
@@ -122,10 +362,17 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
-					pml4_index, pdp_index, i))
+		if (!(((uint64_t) pte) & PTE_P))
+			continue;
+		if (((uint64_t) pte) & PTE_PS) {
+			void *va = (void *) (((uint64_t) pml4_index << PML4SHIFT) |
+								 ((uint64_t) pdp_index << PDPESHIFT) |
+								 ((uint64_t) i << PDXSHIFT));
+			if (!func (&pdp[i], va, aux))
 				return false;
+		} else if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
+					pml4_index, pdp_index, i))
+			return false;
 	}
 	return true;
 }
@@ -143,7 +390,9 @@ pdp_for_each (uint64_t *pdp,
 	return true;
 }
 
-/* Apply FUNC to each available pte entries including kernel's. */
+/* Apply FUNC to each available pte entries including kernel's.
+ * A huge page is visited once, through its page directory entry,
+ * with the address of the start of the huge page. */
 bool
 pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
@@ -169,7 +418,13 @@ static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if (!(((uint64_t) pte) & PTE_P))
+			continue;
+		/* The frames of a huge page belong to whoever mapped it.
+		 * Only the page table reserved for it goes. */
+		if (((uint64_t) pte) & PTE_PS)
+			palloc_free_page (pt_reserve_pop ());
+		else
 			pt_destroy (PTE_ADDR (pte));
 	}
 	palloc_free_page ((void *) pdp);
@@ -192,6 +447,12 @@ pml4_destroy (uint64_t *pml4) {
 		return;
 	ASSERT (pml4 != base_pml4);
 
+	/* Never free the page map the CPU is using, even when only a
+	 * kernel thread is running on it (see pml4_switch()). */
+	if (is_active (pml4))
+		pml4_activate (NULL);
+	pcid_forget (pml4);
+
 	/* if PML4 (vaddr) >= 1, it's kernel space by define. */
 	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
 	if (((uint64_t) pdpe) & PTE_P)
@@ -203,7 +464,37 @@ pml4_destroy (uint64_t *pml4) {
  * register. */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	enum intr_level old_level;
+
+	if (pml4 == NULL)
+		pml4 = base_pml4;
+
+	old_level = intr_disable ();
+	if (is_active (pml4))
+		cr3_skip_cnt++;
+	else if (!pcid_enabled) {
+		lcr3 (vtop (pml4));
+		cr3_flush_cnt++;
+	} else if (pml4 == base_pml4) {
+		lcr3 (vtop (pml4) | CR3_NOFLUSH);
+		cr3_noflush_cnt++;
+	} else
+		pcid_load (pml4);
+	intr_set_level (old_level);
+}
+
+/* Activates PML4 on a context switch to a thread that uses it.
+ * A null PML4 means a kernel thread.  Kernel threads never touch
+ * user memory, and the kernel part of every page map is the same,
+ * so a kernel thread keeps running on the page map already loaded
+ * (lazy TLB).  That avoids a CR3 load on the way in and, when the
+ * same process runs next, on the way out as well. */
+void
+pml4_switch (uint64_t *pml4) {
+	if (pml4 != NULL)
+		pml4_activate (pml4);
+	else
+		cr3_skip_cnt++;
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -216,11 +507,93 @@ pml4_get_page (uint64_t *pml4, const void *uaddr) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
 
-	if (pte && (*pte & PTE_P))
+	if (pte && (*pte & PTE_P)) {
+		if (*pte & PTE_PS)
+			return ptov (HPTE_ADDR (*pte)) + ((uint64_t) uaddr & HPGMASK);
 		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
+	}
 	return NULL;
 }
 
+/* Returns true if page table PT maps no pages. */
+static bool
+pt_is_empty (const uint64_t *pt) {
+	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+		if (pt[i] & PTE_P)
+			return false;
+	return true;
+}
+
+/* Adds a mapping in PML4 from the 2 MB of user virtual memory at
+ * UPAGE to the 2 MB of physical memory at kernel virtual address
+ * KPAGE.  Both must be 2 MB aligned; KPAGE should probably be
+ * obtained with palloc_get_huge_page().  No page in the region may
+ * be mapped already.  If WRITABLE is true, the new page is
+ * read/write; otherwise it is read-only.
+ * Returns true if successful, false if some page in the region is
+ * mapped or if memory allocation failed. */
+bool
+pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
+	ASSERT (((uint64_t) upage & HPGMASK) == 0);
+	ASSERT ((vtop (kpage) & HPGMASK) == 0);
+	ASSERT (is_user_vaddr (upage));
+	ASSERT (is_user_vaddr ((uint8_t *) upage + HPGSIZE - 1));
+	ASSERT (pml4 != base_pml4);
+
+	uint64_t *pde = pml4e_walk_huge (pml4, (uint64_t) upage, 1);
+	uint64_t *pt;
+	bool was_present;
+
+	if (pde == NULL)
+		return false;
+	was_present = (*pde & PTE_P) != 0;
+	if (was_present) {
+		/* 4 kB pages mapped here before may have left an empty
+		 * page table behind.  It becomes the reserve. */
+		pt = ptov (PTE_ADDR (*pde));
+		if ((*pde & PTE_PS) || !pt_is_empty (pt))
+			return false;
+	} else {
+		pt = palloc_get_page (0);
+		if (pt == NULL)
+			return false;
+	}
+	pt_reserve_push (pt);
+	*pde = vtop (kpage) | PTE_P | PTE_PS | (rw ? PTE_W : 0) | PTE_U;
+	if (was_present)
+		invalidate (pml4, (uint64_t) upage);
+	huge_map_cnt++;
+	return true;
+}
+
+/* Replaces PDE, the entry of PML4 that maps VA with a huge page,
+ * by a page table of 4 kB pages that map the same memory with the
+ * same flags. */
+static void
+split_huge_page (uint64_t *pml4, uint64_t *pde, uint64_t va) {
+	uint64_t *pt = pt_reserve_pop ();
+	uint64_t flags = *pde & (PTE_P | PTE_W | PTE_U | PTE_A | PTE_D);
+
+	ASSERT (is_user_vaddr ((void *) va));
+
+	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+		pt[i] = (HPTE_ADDR (*pde) + i * PGSIZE) | flags;
+	*pde = vtop (pt) | PTE_U | PTE_W | PTE_P;
+	invalidate (pml4, va & ~HPGMASK);
+	huge_split_cnt++;
+}
+
+/* Like pml4e_walk(), but if VA lies in a huge page, splits it
+ * first, so that the entry returned maps VA alone. */
+static uint64_t *
+walk_split (uint64_t *pml4, const void *va, int create) {
+	uint64_t *pde = pml4e_walk_huge (pml4, (uint64_t) va, 0);
+
+	if (pde != NULL && (*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS))
+		split_huge_page (pml4, pde, (uint64_t) va);
+	return pml4e_walk (pml4, (uint64_t) va, create);
+}
+
 /* Adds a mapping in page map level 4 PML4 from user virtual page
  * UPAGE to the physical frame identified by kernel virtual address KPAGE.
  * UPAGE must not already be mapped. KPAGE should probably be a page obtained
@@ -236,36 +609,72 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 	ASSERT (is_user_vaddr (upage));
 	ASSERT (pml4 != base_pml4);
 
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) upage, 1);
+	uint64_t *pte = walk_split (pml4, upage, 1);
 
-	if (pte)
+	if (pte) {
+		bool was_present = (*pte & PTE_P) != 0;
 		*pte = vtop (kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+		if (was_present)
+			invalidate (pml4, (uint64_t) upage);
+	}
 	return pte != NULL;
 }
 
-/* Marks user virtual page UPAGE "not present" in page
- * directory PD.  Later accesses to the page will fault.  Other
- * bits in the page table entry are preserved.
- * UPAGE need not be mapped. */
-void
-pml4_clear_page (uint64_t *pml4, void *upage) {
+/* Clears PTE_P in the PTE for UPAGE in PML4.  Returns true if the
+ * PTE changed and so needs to be invalidated. */
+static bool
+clear_page (uint64_t *pml4, void *upage) {
 	uint64_t *pte;
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (is_user_vaddr (upage));
 
-	pte = pml4e_walk (pml4, (uint64_t) upage, false);
+	pte = walk_split (pml4, upage, false);
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
+		return true;
 	}
+	return false;
+}
+
+/* Sets FLAG in the PTE for VPAGE in PML4 if VALUE is true,
+ * otherwise clears it.  Returns true if the PTE changed and so
+ * needs to be invalidated.  The accessed and dirty bits of a huge
+ * page are changed for the whole of it; any other flag splits it. */
+static bool
+update_flag (uint64_t *pml4, const void *vpage, uint64_t flag, bool value) {
+	uint64_t *pte = flag & (PTE_A | PTE_D)
+		? pml4e_walk (pml4, (uint64_t) vpage, false)
+		: walk_split (pml4, vpage, false);
+	uint64_t old;
+
+	if (pte == NULL)
+		return false;
+	old = *pte;
+	if (value)
+		*pte |= flag;
+	else
+		*pte &= ~flag;
+	return *pte != old;
+}
+
+/* Marks user virtual page UPAGE "not present" in page
+ * directory PD.  Later accesses to the page will fault.  Other
+ * bits in the page table entry are preserved.
+ * UPAGE need not be mapped.  If UPAGE lies in a huge page, the
+ * huge page is split first, and the rest of it stays mapped. */
+void
+pml4_clear_page (uint64_t *pml4, void *upage) {
+	if (clear_page (pml4, upage))
+		invalidate (pml4, (uint64_t) upage);
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PML4 is dirty,
  * that is, if the page has been modified since the PTE was
  * installed.
- * Returns false if PML4 contains no PTE for VPAGE. */
+ * Returns false if PML4 contains no PTE for VPAGE.
+ * This and the accessed/dirty helpers below work on huge pages
+ * too, through the page directory entry that maps them. */
 bool
 pml4_is_dirty (uint64_t *pml4, const void *vpage) {
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
@@ -276,16 +685,8 @@ pml4_is_dirty (uint64_t *pml4, const void *vpage) {
  * in PML4. */
 void
 pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
-	if (pte) {
-		if (dirty)
-			*pte |= PTE_D;
-		else
-			*pte &= ~(uint32_t) PTE_D;
-
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
-	}
+	if (update_flag (pml4, vpage, PTE_D, dirty))
+		invalidate (pml4, (uint64_t) vpage);
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PML4 has been
@@ -302,14 +703,104 @@ pml4_is_accessed (uint64_t *pml4, const void *vpage) {
    VPAGE in PD. */
 void
 pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
-	if (pte) {
-		if (accessed)
-			*pte |= PTE_A;
-		else
-			*pte &= ~(uint32_t) PTE_A;
+	if (update_flag (pml4, vpage, PTE_A, accessed))
+		invalidate (pml4, (uint64_t) vpage);
+}
+
+/* Batched TLB invalidation.
+ *
+ * Each of the functions above invalidates the TLB entry of the
+ * page it changed right away, which costs an invlpg per page.
+ * Code that changes many pages of one page map at once, such as
+ * munmap, process exit, and eviction scans, instead queues the
+ * pages in a struct tlb_gather and flushes them together with
+ * tlb_gather_flush():
+ *
+ *   struct tlb_gather tlb;
+ *   tlb_gather_init (&tlb, pml4);
+ *   for (...)
+ *     pml4_clear_page_gather (&tlb, upage);
+ *   tlb_gather_flush (&tlb);
+ *
+ * Up to TLB_GATHER_MAX pages are flushed one invlpg at a time;
+ * beyond that, reloading CR3 flushes the whole TLB at once, which
+ * is cheaper than that many invlpgs.  If the page map is not
+ * active, a single flush on its next activation covers them all.
+ * Until the batch is flushed, the CPU may still use the old
+ * translations, so the caller must not reuse the frames behind
+ * cleared pages before then. */
+
+/* Prepares TLB to gather invalidations for PML4. */
+void
+tlb_gather_init (struct tlb_gather *tlb, uint64_t *pml4) {
+	tlb->pml4 = pml4;
+	tlb->cnt = 0;
+}
+
+/* Queues the TLB entry for VA in TLB's page map. */
+static void
+tlb_gather_add (struct tlb_gather *tlb, const void *va) {
+	if (tlb->cnt < TLB_GATHER_MAX)
+		tlb->va[tlb->cnt] = (uint64_t) va;
+	if (tlb->cnt <= TLB_GATHER_MAX)
+		tlb->cnt++;
+}
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+/* Invalidates the TLB entries queued in TLB, and empties TLB so
+ * that it can be reused. */
+void
+tlb_gather_flush (struct tlb_gather *tlb) {
+	enum intr_level old_level;
+
+	if (tlb->cnt == 0)
+		return;
+
+	old_level = intr_disable ();
+	if (!is_active (tlb->pml4))
+		pcid_forget (tlb->pml4);
+	else if (tlb->cnt > TLB_GATHER_MAX) {
+		/* Reloading CR3 without CR3_NOFLUSH flushes the current
+		 * PCID, or the whole TLB without PCIDs. */
+		lcr3 (rcr3 ());
+		tlb_full_flush_cnt++;
+	} else {
+		for (size_t i = 0; i < tlb->cnt; i++)
+			invlpg (tlb->va[i]);
+		tlb_invlpg_cnt += tlb->cnt;
 	}
+	intr_set_level (old_level);
+	tlb->cnt = 0;
+}
+
+/* Like pml4_clear_page(), but queues the invalidation in TLB. */
+void
+pml4_clear_page_gather (struct tlb_gather *tlb, void *upage) {
+	if (clear_page (tlb->pml4, upage))
+		tlb_gather_add (tlb, upage);
+}
+
+/* Like pml4_set_dirty(), but queues the invalidation in TLB. */
+void
+pml4_set_dirty_gather (struct tlb_gather *tlb, const void *vpage,
+		bool dirty) {
+	if (update_flag (tlb->pml4, vpage, PTE_D, dirty))
+		tlb_gather_add (tlb, vpage);
+}
+
+/* Like pml4_set_accessed(), but queues the invalidation in TLB. */
+void
+pml4_set_accessed_gather (struct tlb_gather *tlb, const void *vpage,
+		bool accessed) {
+	if (update_flag (tlb->pml4, vpage, PTE_A, accessed))
+		tlb_gather_add (tlb, vpage);
+}
+
+/* Makes the PTE for VPAGE in TLB's page map writable if WRITABLE
+ * is true, read-only otherwise, and queues the invalidation in
+ * TLB.  Does nothing if there is no PTE for VPAGE. */
+void
+pml4_set_writable_gather (struct tlb_gather *tlb, const void *vpage,
+		bool writable) {
+	if (update_flag (tlb->pml4, vpage, PTE_W, writable))
+		tlb_gather_add (tlb, vpage);
 }
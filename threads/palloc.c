@@ -9,6 +9,8 @@
 #include <string.h>
 #include "threads/init.h"
 #include "threads/loader.h"
+#include "threads/memtag.h"
+#include "threads/pte.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -31,6 +33,7 @@ struct pool {
 	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+	uint16_t *tags;                 /* Memtag of each page, with -memtag. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -42,6 +45,8 @@ static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static void *get_multiple (enum palloc_flags, size_t page_cnt,
+		const void *site);
 
 /* multiboot info */
 struct multiboot_info {
@@ -261,6 +266,13 @@ palloc_init (void) {
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
+	return get_multiple (flags, page_cnt, __builtin_return_address (0));
+}
+
+/* Implements palloc_get_multiple(), charging the pages to call
+   site SITE if memory accounting is enabled. */
+static void *
+get_multiple (enum palloc_flags flags, size_t page_cnt, const void *site) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
 
 	lock_acquire (&pool->lock);
@@ -274,6 +286,9 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 		pages = NULL;
 
 	if (pages) {
+		if (pool->tags != NULL)
+			pool->tags[page_idx] =
+				memtag_alloc (MEMTAG_PALLOC, site, PGSIZE * page_cnt);
 		if (flags & PAL_ZERO)
 			memset (pages, 0, PGSIZE * page_cnt);
 	} else {
@@ -292,7 +307,48 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
    발생시킵니다. */
 void *
 palloc_get_page (enum palloc_flags flags) {
-	return palloc_get_multiple (flags, 1);
+	return get_multiple (flags, 1, __builtin_return_address (0));
+}
+
+/* Obtains a 2 MB huge page: HPG_PAGE_CNT contiguous free pages
+   whose physical address is 2 MB aligned, so that they can be
+   mapped with pml4_set_huge_page().  FLAGS are interpreted as by
+   palloc_get_multiple().  Each of the pages is charged on its
+   own, because the frame table frees them one at a time with
+   palloc_free_page(). */
+void *
+palloc_get_huge_page (enum palloc_flags flags) {
+	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	size_t page_cnt = bitmap_size (pool->used_map);
+	size_t page_idx;
+	void *pages = NULL;
+
+	/* Index of the first page in the pool that starts a 2 MB
+	   aligned physical region. */
+	page_idx = (HPGSIZE - (vtop (pool->base) & HPGMASK)) % HPGSIZE / PGSIZE;
+
+	lock_acquire (&pool->lock);
+	for (; page_idx + HPG_PAGE_CNT <= page_cnt; page_idx += HPG_PAGE_CNT)
+		if (bitmap_none (pool->used_map, page_idx, HPG_PAGE_CNT)) {
+			bitmap_set_multiple (pool->used_map, page_idx, HPG_PAGE_CNT, true);
+			pages = pool->base + PGSIZE * page_idx;
+			break;
+		}
+	lock_release (&pool->lock);
+
+	if (pages) {
+		if (pool->tags != NULL)
+			for (size_t i = 0; i < HPG_PAGE_CNT; i++)
+				pool->tags[page_idx + i] = memtag_alloc (MEMTAG_PALLOC,
+						__builtin_return_address (0), PGSIZE);
+		if (flags & PAL_ZERO)
+			memset (pages, 0, HPGSIZE);
+	} else {
+		if (flags & PAL_ASSERT)
+			PANIC ("palloc_get_huge_page: out of pages");
+	}
+
+	return pages;
 }
 
 /* Frees the PAGE_CNT pages starting at PAGES. */
@@ -313,6 +369,8 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 		NOT_REACHED ();
 
 	page_idx = pg_no (pages) - pg_no (pool->base);
+	if (pool->tags != NULL)
+		memtag_free (pool->tags[page_idx], PGSIZE * page_cnt);
 
 #ifndef NDEBUG
 	memset (pages, 0xcc, PGSIZE * page_cnt);
@@ -327,6 +385,19 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Stores the address of the first page of the user pool in
+   *BASE, the number of pages in it in *PAGE_CNT, and the number
+   of those that are free in *FREE_CNT.  Every page that
+   palloc_get_page (PAL_USER) returns is in that range. */
+void
+palloc_user_pool (void **base, size_t *page_cnt, size_t *free_cnt) {
+	lock_acquire (&user_pool.lock);
+	*base = user_pool.base;
+	*page_cnt = bitmap_size (user_pool.used_map);
+	*free_cnt = bitmap_count (user_pool.used_map, 0, *page_cnt, false);
+	lock_release (&user_pool.lock);
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
@@ -334,16 +405,31 @@ init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
      Calculate the space needed for the bitmap
      and subtract it from the pool's size. */
 	uint64_t pgcnt = (end - start) / PGSIZE;
-	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
+	size_t bm_size = ROUND_UP (bitmap_buf_size (pgcnt), sizeof (long));
+	size_t sum_size = bitmap_summary_buf_size (pgcnt);
+	size_t bm_pages = DIV_ROUND_UP (bm_size + sum_size, PGSIZE) * PGSIZE;
 
 	lock_init(&p->lock);
-	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
+	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_size);
 	p->base = (void *) start;
 
+	// Summarize the bitmap, so that finding a free page takes
+	// constant time even when the pool is nearly full.
+	bitmap_enable_summary (p->used_map, *bm_base + bm_size, sum_size);
+
 	// Mark all to unusable.
 	bitmap_set_all(p->used_map, true);
 
 	*bm_base += bm_pages;
+
+	// With -memtag, keep a tag for each page after the bitmap.
+	p->tags = NULL;
+	if (memtag_enabled) {
+		size_t tag_pages = DIV_ROUND_UP (pgcnt * sizeof *p->tags, PGSIZE);
+		p->tags = *bm_base;
+		memset (p->tags, 0, tag_pages * PGSIZE);
+		*bm_base += tag_pages * PGSIZE;
+	}
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -13,6 +13,8 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/memtag.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
@@ -27,6 +29,18 @@ static bool load (const char *file_name, struct intr_frame *if_);
 static void initd (void *f_name);
 static void __do_fork (void *);
 
+/* Statistics. */
+static long long exec_cnt;       /* Programs started. */
+static uint64_t exec_cycles;     /* Total cycles from exec to user mode. */
+
+/* Prints process statistics. */
+void
+process_print_stats (void) {
+	printf ("Exec: %lld programs started, %llu cycles each from exec to "
+			"first instruction\n", exec_cnt,
+			exec_cnt ? exec_cycles / exec_cnt : 0);
+}
+
 /* General process initializer for initd and other process. */
 static void
 process_init (void) {
@@ -163,6 +177,7 @@ error:
 int
 process_exec (void *f_name) {
 	char *file_name = f_name;
+	uint64_t start = rdtsc ();
 	bool success;
 
 	/* We cannot use the intr_frame in the thread structure.
@@ -185,6 +200,8 @@ process_exec (void *f_name) {
 		return -1;
 
 	/* Start switched process. */
+	exec_cycles += rdtsc () - start;
+	exec_cnt++;
 	do_iret (&_if);
 	NOT_REACHED ();
 }
@@ -216,7 +233,14 @@ process_exit (void) {
 	 * TODO: project2/process_termination.html).
 	 * TODO: We recommend you to implement process resource cleanup here. */
 
+	bool was_process = curr->pml4 != NULL;
+
 	process_cleanup ();
+
+	/* Allocations that keep growing from one process lifetime to
+	 * the next are likely leaks. */
+	if (was_process)
+		memtag_checkpoint ();
 }
 
 /* Free the current process's resources. */
@@ -250,8 +274,9 @@ process_cleanup (void) {
  * This function is called on every context switch. */
 void
 process_activate (struct thread *next) {
-	/* Activate thread's page tables. */
-	pml4_activate (next->pml4);
+	/* Activate thread's page tables.  A kernel thread keeps the page
+	 * tables that are already loaded (see pml4_switch()). */
+	pml4_switch (next->pml4);
 
 	/* Set thread's kernel stack for use in processing interrupts. */
 	tss_update (next);
@@ -574,13 +599,6 @@ install_page (void *upage, void *kpage, bool writable) {
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
-static bool
-lazy_load_segment (struct page *page, void *aux) {
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
-}
-
 /* Loads a segment starting at offset OFS in FILE at address
  * UPAGE.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
  * memory are initialized, as follows:
@@ -598,29 +616,22 @@ lazy_load_segment (struct page *page, void *aux) {
 static bool
 load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		uint32_t read_bytes, uint32_t zero_bytes, bool writable) {
+	struct segment *seg;
+	bool success;
+
 	ASSERT ((read_bytes + zero_bytes) % PGSIZE == 0);
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
-	while (read_bytes > 0 || zero_bytes > 0) {
-		/* Do calculate how to fill this page.
-		 * We will read PAGE_READ_BYTES bytes from FILE
-		 * and zero the final PAGE_ZERO_BYTES bytes. */
-		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = NULL;
-		if (!vm_alloc_page_with_initializer (VM_ANON, upage,
-					writable, lazy_load_segment, aux))
-			return false;
-
-		/* Advance. */
-		read_bytes -= page_read_bytes;
-		zero_bytes -= page_zero_bytes;
-		upage += PGSIZE;
-	}
-	return true;
+	/* The pages share one description of where their data is, and read it
+	 * in when first touched.  Writes to a writable segment stay private to
+	 * the process, so its pages are anonymous. */
+	seg = segment_create (file, ofs, upage, read_bytes, zero_bytes);
+	if (seg == NULL)
+		return false;
+	success = vm_alloc_segment (seg, writable ? VM_ANON : VM_FILE, writable);
+	segment_put (seg);
+	return success;
 }
 
 /* Create a PAGE of stack at the USER_STACK. Return true on success. */
@@ -629,11 +640,11 @@ setup_stack (struct intr_frame *if_) {
 	bool success = false;
 	void *stack_bottom = (void *) (((uint8_t *) USER_STACK) - PGSIZE);
 
-	/* TODO: Map the stack on stack_bottom and claim the page immediately.
-	 * TODO: If success, set the rsp accordingly.
-	 * TODO: You should mark the page is stack. */
-	/* TODO: Your code goes here */
-
+	if (vm_alloc_page (VM_ANON | VM_STACK, stack_bottom, true)
+			&& vm_claim_page (stack_bottom)) {
+		if_->rsp = USER_STACK;
+		success = true;
+	}
 	return success;
 }
 #endif /* VM */
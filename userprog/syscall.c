@@ -40,6 +40,11 @@ syscall_init (void) {
 /* The main system call interface */
 void
 syscall_handler (struct intr_frame *f UNUSED) {
+#ifdef VM
+	/* A fault on the user stack while serving the call can only tell a
+	 * stack access by the user's stack pointer. */
+	thread_current ()->user_rsp = f->rsp;
+#endif
 	// TODO: Your implementation goes here.
 	printf ("system call!\n");
 	thread_exit ();
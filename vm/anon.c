@@ -1,7 +1,15 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
+#include <bitmap.h>
+#include <stdio.h>
+#include <string.h>
 #include "vm/vm.h"
+#include "vm/zswap.h"
 #include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -17,11 +25,194 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+/* Swap space.
+
+   The swap disk is divided into page-sized slots of SLOT_SECTORS
+   sectors.  An anonymous page keeps its slot after it is read back
+   in, so that if it is evicted again before it is written to, which
+   its dirty bit tells, it need not be written out again.  Likewise a
+   page of a program's data keeps its segment until it is first
+   written out, and is just dropped if it has not changed.  After a
+   fork, parent and child share their slots, so a slot has a reference
+   count, and a page only rewrites a slot that it alone refers to.
+
+   Eviction writes the victim together with the virtually following
+   pages that would need writing anyway into a run of adjacent slots,
+   in a single disk command.  A fault reads the following pages that
+   were written that way back in with the same command, if they are
+   still out and there are frames to spare.
+
+   The compressed cache in zswap.c, if enabled, sits between the slots
+   and the disk: writing a slot stores it there if it can, and reading
+   a slot takes it from there if it is there. */
+
+#define SLOT_SECTORS (PGSIZE / DISK_SECTOR_SIZE)
+#define SLOT_NONE BITMAP_ERROR          /* No slot. */
+#define CLUSTER_MAX 8                   /* Most pages written at once. */
+#define READAHEAD_MAX 8                 /* Most pages read at once. */
+
+static struct bitmap *swap_map;         /* Slots in use. */
+static uint32_t *slot_refs;             /* Pages referring to each slot. */
+static struct lock swap_lock;           /* Protects the above, swap_hint. */
+static size_t swap_hint;                /* Where to look for free slots. */
+
+/* Statistics. */
+static size_t slots_used, slots_peak;   /* Slots in use, most in use. */
+static long long write_cnt;             /* Pages written to disk. */
+static long long write_cmd_cnt;         /* Write commands issued. */
+static long long clean_cnt;             /* Evictions that wrote nothing. */
+static long long read_cnt;              /* Pages read from disk. */
+static long long read_cmd_cnt;          /* Read commands issued. */
+static long long cluster_cnt[CLUSTER_MAX + 1];  /* Writes by cluster size. */
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	size_t slot_cnt;
+	size_t sum_size;
+	void *sum;
+
+	swap_disk = disk_get (1, 1);
+	if (swap_disk == NULL)
+		return;
+
+	slot_cnt = disk_size (swap_disk) / SLOT_SECTORS;
+	swap_map = bitmap_create (slot_cnt);
+	slot_refs = calloc (slot_cnt, sizeof *slot_refs);
+	sum_size = bitmap_summary_buf_size (slot_cnt);
+	sum = malloc (sum_size);
+	if (swap_map == NULL || slot_refs == NULL || sum == NULL)
+		PANIC ("vm_anon_init: out of memory");
+	bitmap_enable_summary (swap_map, sum, sum_size);
+	lock_init (&swap_lock);
+	zswap_init (swap_disk, slot_cnt);
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void) {
+	if (swap_map == NULL)
+		return;
+
+	printf ("Swap: %zu of %zu slots used, at most %zu\n",
+			slots_used, bitmap_size (swap_map), slots_peak);
+	printf ("Swap: %lld pages written in %lld commands, %lld evictions "
+			"clean\n", write_cnt, write_cmd_cnt, clean_cnt);
+	printf ("Swap: %lld pages read in %lld commands\n",
+			read_cnt, read_cmd_cnt);
+	printf ("Swap: clusters written:");
+	for (int i = 1; i <= CLUSTER_MAX; i++)
+		if (cluster_cnt[i] != 0)
+			printf (" %dx%lld", i, cluster_cnt[i]);
+	printf ("\n");
+	zswap_print_stats ();
+}
+
+/* Allocates CNT adjacent swap slots, each with one reference, and returns
+ * the first, or SLOT_NONE if there is no such run free. */
+static size_t
+slot_alloc (size_t cnt) {
+	size_t slot;
+
+	lock_acquire (&swap_lock);
+	slot = bitmap_scan_from_hint (swap_map, swap_hint, cnt, false);
+	if (slot != BITMAP_ERROR) {
+		bitmap_set_multiple (swap_map, slot, cnt, true);
+		for (size_t i = 0; i < cnt; i++)
+			slot_refs[slot + i] = 1;
+		swap_hint = slot + cnt;
+		slots_used += cnt;
+		if (slots_used > slots_peak)
+			slots_peak = slots_used;
+	}
+	lock_release (&swap_lock);
+	return slot;
+}
+
+/* Adds a reference to swap slot SLOT. */
+static void
+slot_dup (size_t slot) {
+	lock_acquire (&swap_lock);
+	ASSERT (slot_refs[slot] > 0);
+	slot_refs[slot]++;
+	lock_release (&swap_lock);
+}
+
+/* Drops a reference to swap slot SLOT, freeing it if it was the last. */
+static void
+slot_put (size_t slot) {
+	lock_acquire (&swap_lock);
+	ASSERT (bitmap_test (swap_map, slot) && slot_refs[slot] > 0);
+	if (--slot_refs[slot] == 0) {
+		bitmap_reset (swap_map, slot);
+		slots_used--;
+		zswap_invalidate (slot);
+	}
+	lock_release (&swap_lock);
+}
+
+/* Returns true if SLOT is referred to by one page only. */
+static bool
+slot_is_private (size_t slot) {
+	return slot_refs[slot] == 1;
+}
+
+/* Reads slots SLOT through SLOT + CNT - 1 into the pages at KVAS,
+ * taking each from the compressed cache if it is there, and reading the
+ * others from the disk, one command per run of adjacent slots. */
+static void
+swap_read (size_t slot, void *const kvas[], size_t cnt) {
+	void *buffers[READAHEAD_MAX * SLOT_SECTORS];
+	size_t run = 0;
+
+	ASSERT (cnt <= READAHEAD_MAX);
+
+	for (size_t i = 0; i <= cnt; i++) {
+		if (i < cnt && !zswap_load (slot + i, kvas[i])) {
+			for (size_t j = 0; j < SLOT_SECTORS; j++)
+				buffers[run * SLOT_SECTORS + j] =
+					(uint8_t *) kvas[i] + j * DISK_SECTOR_SIZE;
+			run++;
+		} else if (run > 0) {
+			disk_readv (swap_disk, (slot + i - run) * SLOT_SECTORS, buffers,
+					run * SLOT_SECTORS);
+			read_cnt += run;
+			read_cmd_cnt++;
+			run = 0;
+		}
+	}
+}
+
+/* Writes the pages at KVAS to slots SLOT through SLOT + CNT - 1, storing
+ * each in the compressed cache if it can, and writing the others to the
+ * disk, one command per run of adjacent slots. */
+static void
+swap_write (size_t slot, void *const kvas[], size_t cnt) {
+	const void *buffers[CLUSTER_MAX * SLOT_SECTORS];
+	size_t run = 0;
+
+	ASSERT (cnt <= CLUSTER_MAX);
+
+	for (size_t i = 0; i <= cnt; i++) {
+		if (i < cnt && !zswap_store (slot + i, kvas[i])) {
+			for (size_t j = 0; j < SLOT_SECTORS; j++)
+				buffers[run * SLOT_SECTORS + j] =
+					(uint8_t *) kvas[i] + j * DISK_SECTOR_SIZE;
+			run++;
+		} else if (run > 0) {
+			disk_writev (swap_disk, (slot + i - run) * SLOT_SECTORS, buffers,
+					run * SLOT_SECTORS);
+			write_cnt += run;
+			write_cmd_cnt++;
+			run = 0;
+		}
+	}
+}
+
+/* Returns true if PAGE is an anonymous page. */
+static bool
+is_anon (const struct page *page) {
+	return page->operations == &anon_ops;
 }
 
 /* Initialize the file mapping */
@@ -31,22 +222,230 @@ anon_initializer (struct page *page, enum vm_type type, void *kva) {
 	page->operations = &anon_ops;
 
 	struct anon_page *anon_page = &page->anon;
+	anon_page->slot = SLOT_NONE;
+	anon_page->seg = NULL;
+	return true;
+}
+
+/* Makes PAGE, which is not yet in use, an anonymous page whose contents
+ * start out as its part of SEG. */
+void
+anon_init_segment (struct page *page, struct segment *seg) {
+	page->operations = &anon_ops;
+	page->anon.slot = SLOT_NONE;
+	page->anon.seg = segment_get (seg);
+}
+
+/* Drops the segment of the anonymous page A, which now has a slot. */
+static void
+drop_segment (struct anon_page *a) {
+	if (a->seg != NULL) {
+		segment_put (a->seg);
+		a->seg = NULL;
+	}
 }
 
 /* Swap in the page by read contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+	struct page *pages[READAHEAD_MAX];
+	struct frame *frames[READAHEAD_MAX];
+	void *kvas[READAHEAD_MAX];
+	size_t cnt, i;
+
+	/* A page that has never been written out starts out as its part of its
+	 * segment, if any, or else zeroed. */
+	if (anon_page->slot == SLOT_NONE) {
+		if (anon_page->seg != NULL)
+			return segment_read (anon_page->seg, page, kva);
+		memset (kva, 0, PGSIZE);
+		return true;
+	}
+
+	/* Read ahead the following pages that were written out along with this
+	 * one and are still out, as long as frames are plentiful. */
+	pages[0] = page;
+	frames[0] = NULL;
+	kvas[0] = kva;
+	for (cnt = 1; cnt < READAHEAD_MAX; cnt++) {
+		struct page *next = spt_find_page (&page->owner->spt,
+				(uint8_t *) page->va + cnt * PGSIZE);
+
+		if (next == NULL || !is_anon (next) || next->frame != NULL
+				|| next->anon.slot != anon_page->slot + cnt)
+			break;
+		frames[cnt] = vm_frame_get_spare ();
+		if (frames[cnt] == NULL)
+			break;
+		pages[cnt] = next;
+		kvas[cnt] = frames[cnt]->kva;
+	}
+	swap_read (anon_page->slot, kvas, cnt);
+
+	for (i = 1; i < cnt; i++)
+		vm_frame_install (pages[i], frames[i]);
+	return true;
+}
+
+/* Returns true if PAGE, an anonymous page that is not resident, would be
+ * read in as all zeros: it has never been written out, and its part of
+ * its segment, if any, lies past the segment's file data. */
+bool
+anon_is_zero (const struct page *page) {
+	return is_anon (page) && page->anon.slot == SLOT_NONE
+		&& (page->anon.seg == NULL
+			|| segment_page_bytes (page->anon.seg, page->va) == 0);
+}
+
+/* Returns true if PAGE, which is resident, has to be written to swap
+ * before its frame can be reused. */
+static bool
+needs_write (struct page *page) {
+	return (page->anon.slot == SLOT_NONE && page->anon.seg == NULL)
+		|| pml4_is_dirty (page->owner->pml4, page->va);
+}
+
+/* Stores in CLUSTER the pages to write out along with PAGE, starting with
+ * PAGE itself, and returns how many there are.  They are the resident,
+ * unshared, unpinned anonymous pages that immediately follow PAGE in its
+ * address space and need writing. */
+static size_t
+gather_cluster (struct page *page, struct page *cluster[]) {
+	size_t cnt;
+
+	cluster[0] = page;
+	for (cnt = 1; cnt < CLUSTER_MAX; cnt++) {
+		struct page *next = spt_find_page (&page->owner->spt,
+				(uint8_t *) page->va + cnt * PGSIZE);
+
+		if (next == NULL || !is_anon (next) || next->frame == NULL
+				|| next->frame->pinned || next->frame->page != next
+				|| next->frame_next != NULL || !needs_write (next))
+			break;
+		cluster[cnt] = next;
+	}
+	return cnt;
+}
+
+/* Makes DST, a page that is not yet in use, an anonymous page with the
+ * same contents as SRC, an anonymous page of another process, which the
+ * caller arranges to stay in SRC's frame or swap slot.  DST shares SRC's
+ * slot and segment if SRC is not resident or is unchanged since it was
+ * written out or read in.  The caller must hold the frame table lock, so
+ * that SRC is not being swapped out. */
+void
+anon_copy (struct page *dst, struct page *src) {
+	ASSERT (is_anon (src));
+
+	dst->operations = &anon_ops;
+	dst->anon.slot = SLOT_NONE;
+	dst->anon.seg = NULL;
+	if (src->frame == NULL || !needs_write (src)) {
+		if (src->anon.slot != SLOT_NONE) {
+			dst->anon.slot = src->anon.slot;
+			slot_dup (dst->anon.slot);
+		}
+		if (src->anon.seg != NULL)
+			dst->anon.seg = segment_get (src->anon.seg);
+	}
+}
+
+/* Writes out the frame of PAGE, which it shares with other pages, for all
+ * of them.  They are copies of one another, so one slot does, unless they
+ * all share a slot already that none has changed. */
+static bool
+swap_out_shared (struct page *page) {
+	struct frame *frame = page->frame;
+	size_t slot = page->anon.slot;
+	struct page *p;
+
+	for (p = page; p != NULL; p = p->frame_next) {
+		ASSERT (is_anon (p));
+		if (p->anon.slot != slot || needs_write (p))
+			break;
+	}
+	if (p == NULL) {
+		clean_cnt++;
+		return true;
+	}
+
+	slot = slot_alloc (1);
+	if (slot == SLOT_NONE)
+		return false;
+	swap_write (slot, &frame->kva, 1);
+	cluster_cnt[1]++;
+
+	for (p = page; p != NULL; p = p->frame_next) {
+		if (p->anon.slot != SLOT_NONE)
+			slot_put (p->anon.slot);
+		p->anon.slot = slot;
+		if (p != page)
+			slot_dup (slot);
+		drop_segment (&p->anon);
+	}
+	return true;
 }
 
 /* Swap out the page by writing contents to the swap disk. */
 static bool
 anon_swap_out (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+	struct page *cluster[CLUSTER_MAX];
+	void *kvas[CLUSTER_MAX];
+	struct tlb_gather g;
+	size_t cnt, slot, i;
+
+	if (swap_map == NULL)
+		return false;
+	if (page->frame_next != NULL)
+		return swap_out_shared (page);
+	if (!needs_write (page)) {
+		clean_cnt++;
+		return true;
+	}
+
+	/* Find slots for a cluster, or failing that for PAGE alone. */
+	cnt = gather_cluster (page, cluster);
+	slot = cnt > 1 ? slot_alloc (cnt) : SLOT_NONE;
+	if (slot == SLOT_NONE) {
+		cnt = 1;
+		if (anon_page->slot != SLOT_NONE && slot_is_private (anon_page->slot))
+			slot = anon_page->slot;
+		else
+			slot = slot_alloc (1);
+		if (slot == SLOT_NONE)
+			return false;
+	}
+
+	/* The other pages stay mapped.  Clear their dirty bits before copying
+	 * them, so that a write that races with the copy marks them dirty
+	 * again. */
+	tlb_gather_init (&g, page->owner->pml4);
+	for (i = 1; i < cnt; i++)
+		pml4_set_dirty_gather (&g, cluster[i]->va, false);
+	tlb_gather_flush (&g);
+
+	for (i = 0; i < cnt; i++) {
+		struct anon_page *a = &cluster[i]->anon;
+
+		if (a->slot != SLOT_NONE && a->slot != slot + i)
+			slot_put (a->slot);
+		a->slot = slot + i;
+		drop_segment (a);
+		kvas[i] = cluster[i]->frame->kva;
+	}
+	swap_write (slot, kvas, cnt);
+	cluster_cnt[cnt]++;
+	return true;
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	if (anon_page->slot != SLOT_NONE)
+		slot_put (anon_page->slot);
+	drop_segment (anon_page);
 }
@@ -1,5 +1,15 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
+#include <hash.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 
 static bool file_backed_swap_in (struct page *page, void *kva);
@@ -14,45 +24,559 @@ static const struct page_operations file_ops = {
 	.type = VM_FILE,
 };
 
+/* Cache of read-only file pages.
+ *
+ * Every process running a program maps the program's code and read-only
+ * data from the same offsets in the same file, and none of them can write
+ * to it.  So that they can share one frame for each such page, the cache
+ * maps each part of a file, identified by its inode, offset and length, to
+ * the frame that holds it, for as long as some page does.  A page that
+ * faults finds the frame here and just maps it.
+ *
+ * The caller holds the frame table lock, which protects the cache. */
+struct file_cache_entry {
+	struct hash_elem elem;
+	struct inode *inode;   /* File. */
+	off_t ofs;             /* Offset of the data in the file. */
+	size_t read_bytes;     /* Length of the data. */
+	struct frame *frame;   /* Frame that holds the data. */
+};
+
+static struct hash file_cache;
+
+static uint64_t
+cache_hash (const struct hash_elem *e_, void *aux UNUSED) {
+	const struct file_cache_entry *e =
+		hash_entry (e_, struct file_cache_entry, elem);
+	uint64_t key[3] = { (uintptr_t) e->inode, e->ofs, e->read_bytes };
+
+	return hash_bytes (key, sizeof key);
+}
+
+static bool
+cache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct file_cache_entry *a =
+		hash_entry (a_, struct file_cache_entry, elem);
+	const struct file_cache_entry *b =
+		hash_entry (b_, struct file_cache_entry, elem);
+
+	if (a->inode != b->inode)
+		return a->inode < b->inode;
+	if (a->ofs != b->ofs)
+		return a->ofs < b->ofs;
+	return a->read_bytes < b->read_bytes;
+}
+
+/* Segments.
+
+   SEGMENT_LOCK protects the reference counts.  A fault reads the page it
+   needs together with the following pages of the segment that are still
+   out, into frames to spare, in one disk command.  The number of pages
+   read starts at RA_MIN, and doubles up to RA_MAX each time the fault is
+   at the page just past the last ones read, as when a program runs
+   straight through its code. */
+#define RA_MIN 4
+#define RA_MAX 32
+
+static struct lock segment_lock;
+
+/* Statistics. */
+static long long seg_read_cnt;   /* Reads, one disk command each. */
+static long long seg_page_cnt;   /* Pages read. */
+static long long seg_ahead_cnt;  /* ...of those, not faulted on. */
+static size_t seg_window_max;    /* Largest read, in pages. */
+
+/* Writeback of mappings.  file_write_back() writes each run of pages
+   that hold adjacent parts of one file with a single call to
+   file_write_pages(), up to WB_RUN_MAX pages at a time.  It counts the
+   pages it writes, by reason, and the writes, for each of the first
+   WB_FILE_MAX files it writes back, identified by inode sector, and for
+   all others together in the last row.  WB_STATS_LOCK protects the
+   counts, because the writeback thread writes without the frame table
+   lock. */
+#define WB_RUN_MAX 16
+#define WB_FILE_MAX 8
+
+struct wb_stats {
+	disk_sector_t inumber;           /* File. */
+	long long pages[WB_REASON_CNT];  /* Pages written, by reason. */
+	long long writes;                /* Calls to file_write_pages(). */
+};
+
+static struct wb_stats wb_stats[WB_FILE_MAX + 1];
+static size_t wb_file_cnt;
+static struct lock wb_stats_lock;
+
+/* Pages that munmap() removes at once. */
+#define MUNMAP_BATCH 16
+
 /* The initializer of file vm */
 void
 vm_file_init (void) {
+	lock_init (&segment_lock);
+	lock_init (&wb_stats_lock);
+	if (!hash_init (&file_cache, cache_hash, cache_less, NULL))
+		PANIC ("cannot allocate file page cache");
+}
+
+/* Prints the writeback counts S. */
+static void
+wb_stats_print (const struct wb_stats *s) {
+	printf ("%lld writes of %lld pages (%lld by writeback thread, "
+			"%lld evicted, %lld unmapped)\n", s->writes,
+			s->pages[WB_THREAD] + s->pages[WB_EVICT] + s->pages[WB_UNMAP],
+			s->pages[WB_THREAD], s->pages[WB_EVICT], s->pages[WB_UNMAP]);
+}
+
+/* Returns the writeback counts for INODE.  The caller holds
+ * WB_STATS_LOCK. */
+static struct wb_stats *
+wb_stats_find (struct inode *inode) {
+	disk_sector_t inumber = inode_get_inumber (inode);
+	size_t i;
+
+	for (i = 0; i < wb_file_cnt; i++)
+		if (wb_stats[i].inumber == inumber)
+			return &wb_stats[i];
+	if (wb_file_cnt == WB_FILE_MAX)
+		return &wb_stats[WB_FILE_MAX];
+	wb_stats[i].inumber = inumber;
+	wb_file_cnt++;
+	return &wb_stats[i];
+}
+
+/* Prints segment readahead and writeback statistics. */
+void
+file_print_stats (void) {
+	printf ("VM: %lld segment reads of %lld pages, %lld read ahead, "
+			"at most %zu at once\n", seg_read_cnt, seg_page_cnt,
+			seg_ahead_cnt, seg_window_max);
+	for (size_t i = 0; i < wb_file_cnt; i++) {
+		printf ("VM: mapped file %"PRDSNu": ", wb_stats[i].inumber);
+		wb_stats_print (&wb_stats[i]);
+	}
+	if (wb_stats[WB_FILE_MAX].writes != 0) {
+		printf ("VM: other mapped files: ");
+		wb_stats_print (&wb_stats[WB_FILE_MAX]);
+	}
+}
+
+/* Returns a new segment of PAGE_CNT pages at START, which hold the
+ * READ_BYTES bytes at OFS in FILE followed by ZERO_BYTES zeros, with its
+ * own handle on FILE and one reference, or a null pointer if memory cannot
+ * be allocated. */
+struct segment *
+segment_create (struct file *file, off_t ofs, void *start,
+		size_t read_bytes, size_t zero_bytes) {
+	struct segment *seg;
+
+	ASSERT (ofs % PGSIZE == 0);
+	ASSERT (pg_ofs (start) == 0);
+	ASSERT ((read_bytes + zero_bytes) % PGSIZE == 0);
+
+	seg = malloc (sizeof *seg);
+	if (seg == NULL)
+		return NULL;
+	seg->file = file_reopen (file);
+	if (seg->file == NULL) {
+		free (seg);
+		return NULL;
+	}
+	seg->ofs = ofs;
+	seg->start = start;
+	seg->read_bytes = read_bytes;
+	seg->page_cnt = (read_bytes + zero_bytes) / PGSIZE;
+	seg->ref_cnt = 1;
+	seg->shared = false;
+	seg->ra_next = NULL;
+	seg->ra_pages = 0;
+	return seg;
+}
+
+/* Adds a reference to SEG and returns it. */
+struct segment *
+segment_get (struct segment *seg) {
+	lock_acquire (&segment_lock);
+	seg->ref_cnt++;
+	lock_release (&segment_lock);
+	return seg;
+}
+
+/* Drops a reference to SEG, freeing it if it was the last. */
+void
+segment_put (struct segment *seg) {
+	bool last;
+
+	lock_acquire (&segment_lock);
+	ASSERT (seg->ref_cnt > 0);
+	last = --seg->ref_cnt == 0;
+	lock_release (&segment_lock);
+
+	if (last) {
+		file_close (seg->file);
+		free (seg);
+	}
+}
+
+/* Returns the number of bytes of the page at VA that come from SEG's
+ * file. */
+size_t
+segment_page_bytes (const struct segment *seg, const void *va) {
+	size_t before = (const uint8_t *) va - seg->start;
+
+	if (before >= seg->read_bytes)
+		return 0;
+	return seg->read_bytes - before < PGSIZE ? seg->read_bytes - before
+		: PGSIZE;
+}
+
+/* Returns true if PAGE is not resident and reads its contents from SEG. */
+static bool
+segment_page_is_out (const struct page *page, const struct segment *seg) {
+	if (page->frame != NULL)
+		return false;
+	switch (VM_TYPE (page->operations->type)) {
+		case VM_ANON:
+			return page->anon.seg == seg;
+		case VM_FILE:
+			return page->file.seg == seg;
+		default:
+			return false;
+	}
+}
+
+/* Reads the contents of PAGE, which belongs to SEG, into KVA, along with
+ * the following pages of SEG that are out, as the readahead window and
+ * the frames to spare allow.  Maps the latter.  Returns true if
+ * successful. */
+bool
+segment_read (struct segment *seg, struct page *page, void *kva) {
+	struct page *pages[RA_MAX];
+	struct frame *frames[RA_MAX];
+	void *kvas[RA_MAX];
+	uint8_t *va = page->va;
+	size_t window, cnt, bytes, i;
+
+	ASSERT (va >= seg->start && va < seg->start + seg->page_cnt * PGSIZE);
+
+	/* A page past the file data needs no reading. */
+	bytes = segment_page_bytes (seg, va);
+	if (bytes == 0) {
+		memset (kva, 0, PGSIZE);
+		return true;
+	}
+
+	/* Grow the window while the faults are sequential. */
+	window = va == seg->ra_next ? seg->ra_pages * 2 : RA_MIN;
+	if (window > RA_MAX)
+		window = RA_MAX;
+
+	pages[0] = page;
+	kvas[0] = kva;
+	for (cnt = 1; cnt < window; cnt++) {
+		uint8_t *next_va = va + cnt * PGSIZE;
+		struct page *next;
+
+		if (segment_page_bytes (seg, next_va) == 0)
+			break;
+		next = spt_find_page (&page->owner->spt, next_va);
+		if (next == NULL || !segment_page_is_out (next, seg))
+			break;
+		frames[cnt] = vm_frame_get_spare ();
+		if (frames[cnt] == NULL)
+			break;
+		pages[cnt] = next;
+		kvas[cnt] = frames[cnt]->kva;
+		bytes += segment_page_bytes (seg, next_va);
+	}
+	seg->ra_next = va + cnt * PGSIZE;
+	seg->ra_pages = window;
+
+	if (file_read_pages (seg->file, kvas, cnt, bytes,
+				seg->ofs + (va - seg->start)) != (off_t) bytes) {
+		for (i = 1; i < cnt; i++)
+			vm_frame_put_spare (frames[i]);
+		return false;
+	}
+	seg_read_cnt++;
+	seg_page_cnt += cnt;
+	seg_ahead_cnt += cnt - 1;
+	if (cnt > seg_window_max)
+		seg_window_max = cnt;
+
+	for (i = 1; i < cnt; i++)
+		vm_frame_install (pages[i], frames[i]);
+	return true;
 }
 
 /* Initialize the file backed page */
 bool
-file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
+file_backed_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &file_ops;
+	page->file.seg = NULL;
+	return true;
+}
 
-	struct file_page *file_page = &page->file;
+/* Makes PAGE, which is not yet in use, a file page that reads from SEG. */
+void
+file_init_segment (struct page *page, struct segment *seg) {
+	page->operations = &file_ops;
+	page->file.seg = segment_get (seg);
+}
+
+/* Makes DST, a new page at the same address as SRC in another process, a
+ * file page that reads from the same segment as SRC. */
+void
+file_backed_copy (struct page *dst, struct page *src) {
+	file_init_segment (dst, src->file.seg);
 }
 
 /* Swap in the page by read contents from the file. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	return segment_read (file_page->seg, page, kva);
 }
 
 /* Swap out the page by writeback contents to the file. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	/* A clean page still matches the file, so it can just be dropped and
+	 * read again.  A dirty page of a mapping is written back first, which
+	 * the writeback thread makes rare. */
+	if (page->writable && pml4_is_dirty (page->owner->pml4, page->va))
+		file_write_back (&page, 1, WB_EVICT);
+	return true;
 }
 
 /* Destory the file backed page. PAGE will be freed by the caller. */
 static void
 file_backed_destroy (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	/* The caller holds the frame table lock, which keeps the page resident
+	 * during the write. */
+	if (page->frame != NULL && page->writable
+			&& pml4_is_dirty (page->owner->pml4, page->va))
+		file_write_back (&page, 1, WB_UNMAP);
+	if (file_page->seg != NULL)
+		segment_put (file_page->seg);
+}
+
+/* If PAGE is a writable page of a mapping made by mmap(), sets *INODE and
+ * *OFS to the file and offset whose contents it holds and returns true.
+ * Otherwise, returns false. */
+bool
+file_mapped_pos (const struct page *page, struct inode **inode,
+		off_t *ofs) {
+	struct segment *seg;
+
+	if (!page->writable || VM_TYPE (page->operations->type) != VM_FILE)
+		return false;
+	seg = page->file.seg;
+	if (seg == NULL || !seg->shared)
+		return false;
+	*inode = file_get_inode (seg->file);
+	*ofs = seg->ofs + ((uint8_t *) page->va - seg->start);
+	return true;
+}
+
+/* Writes the CNT PAGES, resident pages of mappings whose contents have
+ * changed, to their files, for REASON.  Writes each run of pages that hold
+ * adjacent parts of the same file in one call, so PAGES should be sorted
+ * by file and offset.  Does not clear their dirty bits.  The caller keeps
+ * the pages resident and mapped meanwhile, by holding the frame table lock
+ * or, like the writeback thread, by pinning their frames. */
+void
+file_write_back (struct page *const pages[], size_t cnt,
+		enum writeback_reason reason) {
+	void *kvas[WB_RUN_MAX];
+	size_t i, n;
+
+	for (i = 0; i < cnt; i += n) {
+		struct page *page = pages[i];
+		struct inode *inode;
+		struct wb_stats *s;
+		off_t ofs;
+		size_t bytes;
+		bool ok UNUSED;
+
+		ok = file_mapped_pos (page, &inode, &ofs);
+		ASSERT (ok && page->frame != NULL);
+		kvas[0] = page->frame->kva;
+		bytes = segment_page_bytes (page->file.seg, page->va);
+
+		/* Extend the run while each page so far is full of file data and
+		 * the next page holds the data that follows. */
+		for (n = 1; i + n < cnt && n < WB_RUN_MAX && bytes == n * PGSIZE;
+				n++) {
+			struct page *next = pages[i + n];
+			struct inode *next_inode;
+			off_t next_ofs;
+
+			ok = file_mapped_pos (next, &next_inode, &next_ofs);
+			ASSERT (ok && next->frame != NULL);
+			if (next_inode != inode || next_ofs != ofs + (off_t) bytes)
+				break;
+			kvas[n] = next->frame->kva;
+			bytes += segment_page_bytes (next->file.seg, next->va);
+		}
+
+		/* Pages past the end of the file have nothing to write. */
+		if (bytes > 0)
+			file_write_pages (page->file.seg->file, kvas, n, bytes, ofs);
+		lock_acquire (&wb_stats_lock);
+		s = wb_stats_find (inode);
+		if (bytes > 0)
+			s->writes++;
+		s->pages[reason] += n;
+		lock_release (&wb_stats_lock);
+	}
+}
+
+/* Sets KEY to the part of a file that PAGE, a read-only file page, maps.
+ * Returns false if PAGE is not such a page.  Pages of mappings made by
+ * mmap() are never cached, because a writable mapping of the same file
+ * could change the data under them. */
+static bool
+cache_key (struct page *page, struct file_cache_entry *key) {
+	struct segment *seg;
+
+	if (page->writable || VM_TYPE (page->operations->type) != VM_FILE)
+		return false;
+	seg = page->file.seg;
+	if (seg->shared)
+		return false;
+	key->inode = file_get_inode (seg->file);
+	key->ofs = seg->ofs + ((uint8_t *) page->va - seg->start);
+	key->read_bytes = segment_page_bytes (seg, page->va);
+	return true;
+}
+
+/* Returns the frame that holds the contents of PAGE, which is not
+ * resident, if PAGE is a read-only file page and the cache has them, or a
+ * null pointer otherwise. */
+struct frame *
+file_cache_lookup (struct page *page) {
+	struct file_cache_entry key;
+	struct hash_elem *e;
+
+	if (!cache_key (page, &key))
+		return NULL;
+	e = hash_find (&file_cache, &key.elem);
+	return e != NULL ? hash_entry (e, struct file_cache_entry, elem)->frame
+		: NULL;
+}
+
+/* Records that FRAME holds the contents of PAGE, which has just been read
+ * into it, if PAGE is a read-only file page.  Does nothing if the cache
+ * already has another frame with the same contents. */
+void
+file_cache_insert (struct page *page, struct frame *frame) {
+	struct file_cache_entry key;
+	struct file_cache_entry *e;
+
+	ASSERT (frame->cache == NULL);
+
+	if (!cache_key (page, &key))
+		return;
+	e = malloc (sizeof *e);
+	if (e == NULL)
+		return;
+	*e = key;
+	e->frame = frame;
+	if (hash_insert (&file_cache, &e->elem) != NULL)
+		free (e);
+	else
+		frame->cache = e;
+}
+
+/* Forgets the contents of FRAME, which is about to go out of use. */
+void
+file_cache_remove (struct frame *frame) {
+	if (frame->cache != NULL) {
+		hash_delete (&file_cache, &frame->cache->elem);
+		free (frame->cache);
+		frame->cache = NULL;
+	}
 }
 
 /* Do the mmap */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	size_t page_cnt, read_bytes;
+	struct segment *seg;
+	off_t file_len;
+	bool success;
+
+	if (addr == NULL || pg_ofs (addr) != 0 || !is_user_vaddr (addr)
+			|| length == 0 || offset < 0 || offset % PGSIZE != 0
+			|| file == NULL)
+		return NULL;
+	page_cnt = DIV_ROUND_UP (length, PGSIZE);
+	if (page_cnt > (KERN_BASE - (uint64_t) addr) / PGSIZE)
+		return NULL;
+	for (size_t i = 0; i < page_cnt; i++)
+		if (spt_find_page (spt, (uint8_t *) addr + i * PGSIZE) != NULL)
+			return NULL;
+	file_len = file_length (file);
+	if (file_len == 0)
+		return NULL;
+
+	/* The pages hold the file from OFFSET on, up to LENGTH bytes, and
+	 * zeros after its end. */
+	read_bytes = offset < file_len ? (size_t) (file_len - offset) : 0;
+	if (read_bytes > length)
+		read_bytes = length;
+	seg = segment_create (file, offset, addr, read_bytes,
+			page_cnt * PGSIZE - read_bytes);
+	if (seg == NULL)
+		return NULL;
+	seg->shared = true;
+	success = vm_alloc_segment (seg, VM_FILE, writable);
+	segment_put (seg);
+	if (!success) {
+		do_munmap (addr);
+		return NULL;
+	}
+	if (writable)
+		vm_writeback_start ();
+	return addr;
 }
 
 /* Do the munmap */
 void
 do_munmap (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct page *page = spt_find_page (spt, addr);
+	struct page *pages[MUNMAP_BATCH];
+	struct segment *seg;
+	size_t i, n;
+
+	if (page == NULL || VM_TYPE (page->operations->type) != VM_FILE)
+		return;
+	seg = page->file.seg;
+	if (seg == NULL || !seg->shared || seg->start != addr)
+		return;
+
+	/* Remove the pages a batch at a time, writing back the dirty ones,
+	 * adjacent pages together, and flushing the TLB once per batch.  The
+	 * last page removed would free SEG but for our reference. */
+	segment_get (seg);
+	for (i = 0; i < seg->page_cnt; ) {
+		for (n = 0; i < seg->page_cnt && n < MUNMAP_BATCH; i++) {
+			page = spt_find_page (spt, seg->start + i * PGSIZE);
+			if (page != NULL && VM_TYPE (page->operations->type) == VM_FILE
+					&& page->file.seg == seg)
+				pages[n++] = page;
+		}
+		spt_remove_pages (spt, pages, n);
+	}
+	segment_put (seg);
 }
@@ -8,6 +8,8 @@
  * function.
  * */
 
+#include <string.h>
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 #include "vm/uninit.h"
 
@@ -51,7 +53,9 @@ uninit_initialize (struct page *page, void *kva) {
 	vm_initializer *init = uninit->init;
 	void *aux = uninit->aux;
 
-	/* TODO: You may need to fix this function. */
+	/* A page without an initializer starts out zeroed. */
+	if (init == NULL)
+		memset (kva, 0, PGSIZE);
 	return uninit->page_initializer (page, uninit->type, kva) &&
 		(init ? init (page, aux) : true);
 }
@@ -61,8 +65,6 @@ uninit_initialize (struct page *page, void *kva) {
  * exit, which are never referenced during the execution.
  * PAGE will be freed by the caller. */
 static void
-uninit_destroy (struct page *page) {
-	struct uninit_page *uninit UNUSED = &page->uninit;
-	/* TODO: Fill this function.
-	 * TODO: If you don't have anything to do, just return. */
+uninit_destroy (struct page *page UNUSED) {
+	/* The only uninit pages are stack pages, which hold nothing. */
 }
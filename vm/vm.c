@@ -1,9 +1,140 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <stdlib.h>
+#include <string.h>
 #include "threads/malloc.h"
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
 
+/* Largest size the user stack may grow to. */
+#define STACK_MAX (1 << 20)
+
+/* Fault-around.  A read fault on a file page also maps the other file
+   pages in the aligned window of this many pages around it whose
+   contents are already in the file page cache, so that a process
+   running a program that another is running takes one fault per window
+   rather than one per page.  A power of two; 1 disables it.  Set with
+   the -fault-around kernel option. */
+size_t vm_fault_around_pages = 16;
+
+/* The zero page.  A read fault on a page that would be read in as all
+   zeros, such as a stack or BSS page not yet written, maps it read-only
+   to this one page, which every such page of every process shares,
+   instead of giving it a frame.  The first write to the page gives it a
+   zeroed frame of its own through the write-protect fault path.  The zero
+   page comes from the kernel pool and is not in the frame table, so it is
+   never evicted. */
+static void *zero_kva;
+
+/* Huge pages.  With the -huge kernel option, the first fault on a page
+   of a 2 MB aligned region whose pages are all writable anonymous pages
+   that start out zeroed, such as the middle of a large BSS, makes the
+   whole region resident at once in an aligned run of frames, mapped with
+   a single 2 MB page.  That saves the other 511 faults and, above all,
+   TLB entries.  Each page still has its own frame in the frame table, so
+   eviction, fork() and freeing keep working page by page: the first of
+   them to change the mapping of one of the pages splits the huge page
+   (see threads/mmu.c).  A run is only taken while so many frames are
+   free that the reclaimer would not need to run, and never by
+   evicting. */
+bool vm_huge_pages;
+
+/* Frame table.  See struct frame.
+
+   FRAME_LOCK protects the table, the links between pages and frames, and
+   the counters below.  It is held across an eviction, including its
+   I/O, so that a page is never faulted back in while it is being
+   written out.  A frame being filled by vm_do_claim_page() is pinned
+   instead, so that the lock need not be held during the read. */
+static struct lock frame_lock;
+static struct frame *frames;     /* One per user pool page. */
+static size_t frame_cnt;         /* Number of frames. */
+static uint8_t *frame_base;      /* Kernel address of frames[0]. */
+static size_t free_frame_cnt;    /* Frames not in use. */
+static size_t clock_hand;        /* Next frame for the CLOCK to look at. */
+
+/* TLB invalidations queued by an eviction: the accessed bits that the
+   CLOCK clears and the mappings of the victim, for up to EVICT_PML4_MAX
+   page maps at once.  They are all flushed together once the victim is
+   unmapped, before it is written out.  FRAME_LOCK protects them. */
+#define EVICT_PML4_MAX 4
+static struct tlb_gather evict_tlb[EVICT_PML4_MAX];
+static size_t evict_tlb_cnt;
+
+/* The background reclaimer wakes up when fewer than FREE_LOW frames are
+   free, and evicts until FREE_HIGH are, so that page faults seldom have
+   to evict a frame themselves. */
+static size_t free_low, free_high;
+static struct semaphore reclaim_sema;
+static bool reclaim_running;
+
+/* Writeback.  A dirty page of a writable mapping made by mmap() has to be
+   written to its file before its frame can be evicted.  So that eviction
+   seldom waits for that, the writeback thread wakes up every WB_INTERVAL
+   ticks and, if more than VM_DIRTY_RATIO percent of the frames hold dirty
+   mapped pages, or free frames are running short, writes up to
+   WB_SCAN_MAX of them back, sorted by file and offset so that adjacent
+   pages go out in one disk command, and marks them clean.  It pins the
+   frames of WB_BATCH pages at a time and writes them without FRAME_LOCK,
+   so that faults and evictions need not wait for its I/O.  Freeing a page
+   whose frame is being written waits on WRITEBACK_DONE, so that the frame
+   is not reused and a later write of the page cannot be overtaken by the
+   thread's.  It starts with the first writable mapping.  Set the ratio
+   with the -dirty-ratio kernel option. */
+unsigned vm_dirty_ratio = 10;
+
+#define WB_INTERVAL (TIMER_FREQ / 4)
+#define WB_SCAN_MAX 512
+#define WB_BATCH 16
+
+/* A dirty mapped page found by the writeback thread. */
+struct wb_entry {
+	struct frame *frame;     /* Its frame. */
+	struct page *page;       /* The page, valid while FRAME->PAGE is it. */
+	struct inode *inode;     /* File it maps. */
+	off_t ofs;               /* Offset in the file. */
+};
+
+static struct wb_entry wb_entries[WB_SCAN_MAX];
+static bool writeback_started;
+static struct condition writeback_done;
+
+/* Statistics. */
+static long long evict_cnt;      /* Frames evicted. */
+static long long sync_evict_cnt; /* ...of those, by a faulting thread. */
+static long long reclaim_cnt;    /* Reclaimer runs. */
+static long long scan_cnt;       /* Frames examined by the CLOCK. */
+static size_t scan_max;          /* Most frames examined for one eviction. */
+static long long cow_share_cnt;  /* Frames shared by fork(). */
+static long long cow_copy_cnt;   /* Shared frames copied on a write. */
+static long long cow_reuse_cnt;  /* Writes that found the frame unshared. */
+static long long around_cnt;     /* Pages mapped by fault-around. */
+static long long around_used_cnt;   /* ...of those, accessed later. */
+static long long around_unused_cnt; /* ...and freed before access. */
+static long long cache_hit_cnt;  /* Faults mapped to a cached file page. */
+static size_t cache_saved;       /* Pages sharing cached frames, less one
+                                    per frame. */
+static size_t cache_saved_max;   /* Peak of CACHE_SAVED. */
+static long long huge_cnt;       /* Huge pages mapped on a fault. */
+static long long zero_map_cnt;   /* Faults mapped to the zero page. */
+static long long zero_write_cnt; /* ...of those, written later. */
+static size_t zero_mapped_cnt;   /* Pages mapped to the zero page. */
+static size_t zero_mapped_max;   /* Peak of ZERO_MAPPED_CNT. */
+static long long wb_wakeup_cnt;  /* Writeback thread wakeups. */
+static long long wb_pass_cnt;    /* ...that wrote pages back. */
+static long long wb_page_cnt;    /* Pages written back by the thread. */
+static long long wb_redirty_cnt; /* ...of those, written again meanwhile. */
+
+static void frame_table_init (void);
+static void reclaim_thread (void *aux);
+static void writeback_thread (void *aux);
+
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
 void
@@ -15,7 +146,44 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	frame_table_init ();
+	zero_kva = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	thread_create ("reclaim", PRI_DEFAULT, reclaim_thread, NULL);
+
+	/* Round the fault-around window down to a power of two. */
+	while (vm_fault_around_pages & (vm_fault_around_pages - 1))
+		vm_fault_around_pages &= vm_fault_around_pages - 1;
+	if (vm_fault_around_pages == 0)
+		vm_fault_around_pages = 1;
+}
+
+/* Prints frame table statistics. */
+void
+vm_print_stats (void) {
+	printf ("VM: %lld evictions (%lld synchronous), %lld reclaimer runs\n",
+			evict_cnt, sync_evict_cnt, reclaim_cnt);
+	printf ("VM: %lld frames scanned, %lld per eviction, at most %zu\n",
+			scan_cnt, evict_cnt ? scan_cnt / evict_cnt : 0, scan_max);
+	printf ("VM: %lld frames shared by fork, %lld copied on write, "
+			"%lld reused\n", cow_share_cnt, cow_copy_cnt, cow_reuse_cnt);
+	printf ("VM: %lld pages faulted around (window %zu), %lld faults "
+			"avoided, %lld unused\n", around_cnt, vm_fault_around_pages,
+			around_used_cnt, around_unused_cnt);
+	printf ("VM: %lld faults found the file page cache, at most %zu frames "
+			"(%zu kB) saved\n", cache_hit_cnt, cache_saved_max,
+			cache_saved_max * PGSIZE / 1024);
+	printf ("VM: %lld faults mapped the zero page, %lld written later, "
+			"at most %zu pages (%zu kB) at once\n", zero_map_cnt,
+			zero_write_cnt, zero_mapped_max, zero_mapped_max * PGSIZE / 1024);
+	printf ("VM: %lld huge pages (%zu kB) mapped%s\n", huge_cnt,
+			(size_t) (huge_cnt * HPGSIZE / 1024),
+			vm_huge_pages ? "" : " (off)");
+	printf ("VM: %lld writeback wakeups, %lld writing back %lld mapped "
+			"pages (dirty ratio %u%%), %lld redirtied during the write\n",
+			wb_wakeup_cnt, wb_pass_cnt, wb_page_cnt, vm_dirty_ratio,
+			wb_redirty_cnt);
+	file_print_stats ();
+	swap_print_stats ();
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -33,8 +201,10 @@ page_get_type (struct page *page) {
 }
 
 /* Helpers */
-static struct frame *vm_get_victim (void);
+static struct frame *vm_get_victim (size_t *budget);
 static bool vm_do_claim_page (struct page *page);
+static bool claim_in_frame (struct page *page, struct frame *frame);
+static bool claim_cached (struct page *page);
 static struct frame *vm_evict_frame (void);
 
 /* Create the pending page object with initializer. If you want to create a
@@ -50,94 +220,1052 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
+		bool (*initializer) (struct page *, enum vm_type, void *);
+		struct page *page;
+
+		switch (VM_TYPE (type)) {
+			case VM_ANON:
+				initializer = anon_initializer;
+				break;
+			case VM_FILE:
+				initializer = file_backed_initializer;
+				break;
+			default:
+				goto err;
+		}
+
+		page = malloc (sizeof *page);
+		if (page == NULL)
+			goto err;
+		uninit_new (page, pg_round_down (upage), init, type, aux, initializer);
+		page->owner = thread_current ();
+		page->writable = writable;
 
-		/* TODO: Insert the page into the spt. */
+		if (!spt_insert_page (spt, page)) {
+			free (page);
+			goto err;
+		}
+		return true;
 	}
 err:
 	return false;
 }
 
+/* Supplemental page table.  See struct supplemental_page_table. */
+
+#define SPT_LEVELS 4
+#define SPT_FANOUT (PGSIZE / sizeof (void *))
+
+/* Shift of the index bits for each level of the tree, top first. */
+static const unsigned spt_shift[SPT_LEVELS] = {
+	PML4SHIFT, PDPESHIFT, PDXSHIFT, PTXSHIFT
+};
+
+/* Returns the leaf slot for the page at VA in SPT.  If a node on the way
+ * does not exist, creates it if CREATE is true, or returns a null pointer
+ * otherwise or if memory allocation fails. */
+static struct page **
+spt_walk (struct supplemental_page_table *spt, uint64_t va, bool create) {
+	void **slot = (void **) &spt->root;
+
+	for (int level = 0; level < SPT_LEVELS; level++) {
+		void **node = *slot;
+
+		if (node == NULL) {
+			if (!create)
+				return NULL;
+			node = palloc_get_page (PAL_ZERO);
+			if (node == NULL)
+				return NULL;
+			*slot = node;
+		}
+		slot = &node[(va >> spt_shift[level]) & (SPT_FANOUT - 1)];
+	}
+	return (struct page **) slot;
+}
+
 /* Find VA from spt and return page. On error, return NULL. */
 struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function. */
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	struct page **slot;
 
-	return page;
+	if (!is_user_vaddr (va))
+		return NULL;
+	slot = spt_walk (spt, (uint64_t) va, false);
+	return slot != NULL ? *slot : NULL;
 }
 
 /* Insert PAGE into spt with validation. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
+spt_insert_page (struct supplemental_page_table *spt,
+		struct page *page) {
+	struct page **slot;
+
+	ASSERT (pg_ofs (page->va) == 0);
+
+	if (!is_user_vaddr (page->va))
+		return false;
+	slot = spt_walk (spt, (uint64_t) page->va, true);
+	if (slot == NULL || *slot != NULL)
+		return false;
+	*slot = page;
+	spt->page_cnt++;
+	return true;
+}
+
+static void frame_release (struct frame *);
+static void frame_unlink (struct frame *, struct page *);
+static void frame_uncache (struct frame *);
+static void note_around (struct page *);
+static void zero_forget (struct page *);
+static void wait_writeback (struct page *);
+static size_t write_back_dirty (struct page *const pages[], size_t cnt,
+		enum writeback_reason reason);
+
+/* Most frames a free_batch holds back. */
+#define FREE_BATCH_MAX 16
+
+/* Pages of one process being freed together.  The invalidations of their
+ * mappings are queued in TLB, and the frames they leave unused are held
+ * back until those are flushed, so that no frame is reused while the CPU
+ * may still reach it through a stale translation. */
+struct free_batch {
+	struct tlb_gather tlb;
+	struct frame *frames[FREE_BATCH_MAX];
+	size_t frame_cnt;
+};
+
+/* Prepares B to free pages of the process whose page map is PML4. */
+static void
+free_batch_init (struct free_batch *b, uint64_t *pml4) {
+	tlb_gather_init (&b->tlb, pml4);
+	b->frame_cnt = 0;
+}
+
+/* Flushes the invalidations queued in B, then returns the frames it
+ * holds to the user pool.  The caller must hold FRAME_LOCK. */
+static void
+free_batch_flush (struct free_batch *b) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	tlb_gather_flush (&b->tlb);
+	while (b->frame_cnt > 0)
+		frame_release (b->frames[--b->frame_cnt]);
+}
+
+/* Unmaps PAGE, frees its frame, if any, and frees PAGE itself.  Queues
+ * the TLB invalidation on B instead of doing it immediately, along with
+ * the release of the frame, so the caller must flush B with
+ * free_batch_flush() before it lets the process run in user mode again or
+ * drops FRAME_LOCK.  The caller must hold FRAME_LOCK. */
+static void
+page_free (struct page *page, struct free_batch *b) {
+	struct tlb_gather *g = &b->tlb;
 
-	return succ;
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	/* Let the page type write back its contents before the frame goes. */
+	wait_writeback (page);
+	destroy (page);
+	if (page->frame != NULL) {
+		struct frame *frame = page->frame;
+
+		note_around (page);
+		pml4_clear_page_gather (g, page->va);
+		frame_unlink (frame, page);
+		if (frame->page == NULL) {
+			/* Keep faults from finding it through the file page cache
+			 * while it is held back. */
+			frame_uncache (frame);
+			if (b->frame_cnt == FREE_BATCH_MAX)
+				free_batch_flush (b);
+			b->frames[b->frame_cnt++] = frame;
+		}
+	}
+	if (page->zero_mapped) {
+		pml4_clear_page_gather (g, page->va);
+		zero_forget (page);
+	}
+	free (page);
 }
 
+/* Removes PAGE from SPT and frees it. */
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
-	vm_dealloc_page (page);
+	struct page **slot = spt_walk (spt, (uint64_t) page->va, false);
+	struct free_batch b;
+
+	ASSERT (slot != NULL && *slot == page);
+
+	*slot = NULL;
+	spt->page_cnt--;
+	free_batch_init (&b, page->owner->pml4);
+	lock_acquire (&frame_lock);
+	page_free (page, &b);
+	free_batch_flush (&b);
+	lock_release (&frame_lock);
+}
+
+/* Removes the CNT pages in PAGES, pages of one mapping in SPT in address
+ * order, from SPT and frees them.  Writes back the dirty ones first,
+ * adjacent pages together, and invalidates the TLB once for the lot. */
+void
+spt_remove_pages (struct supplemental_page_table *spt,
+		struct page *const pages[], size_t cnt) {
+	struct free_batch b;
+	size_t i;
+
+	if (cnt == 0)
+		return;
+	for (i = 0; i < cnt; i++) {
+		struct page **slot = spt_walk (spt, (uint64_t) pages[i]->va, false);
+
+		ASSERT (slot != NULL && *slot == pages[i]);
+		*slot = NULL;
+		spt->page_cnt--;
+	}
+
+	free_batch_init (&b, pages[0]->owner->pml4);
+	lock_acquire (&frame_lock);
+	for (i = 0; i < cnt; i += WB_BATCH)
+		write_back_dirty (pages + i, cnt - i < WB_BATCH ? cnt - i : WB_BATCH,
+				WB_UNMAP);
+	for (i = 0; i < cnt; i++)
+		page_free (pages[i], &b);
+	free_batch_flush (&b);
+	lock_release (&frame_lock);
+}
+
+/* Calls FUNC for each page in the subtree rooted at NODE, which is at
+ * LEVEL in the tree and starts at address BASE, whose address is in
+ * [START, END), in address order. */
+static bool
+spt_node_for_each (void **node, int level, uint64_t base,
+		uint64_t start, uint64_t end, spt_page_func *func, void *aux) {
+	unsigned shift = spt_shift[level];
+	size_t i = start > base ? (start - base) >> shift : 0;
+
+	for (; i < SPT_FANOUT; i++) {
+		uint64_t va = base + ((uint64_t) i << shift);
+
+		if (va >= end)
+			break;
+		if (node[i] == NULL)
+			continue;
+		if (level == SPT_LEVELS - 1) {
+			if (!func (node[i], aux))
+				return false;
+		} else if (!spt_node_for_each (node[i], level + 1, va, start, end,
+					func, aux))
+			return false;
+	}
 	return true;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Calls FUNC for each page in SPT whose address is in [START, END), in
+ * address order, until FUNC returns false.  FUNC may remove the page it is
+ * passed from SPT, but no other.  Returns false if FUNC did, true
+ * otherwise. */
+bool
+spt_for_each (struct supplemental_page_table *spt, void *start, void *end,
+		spt_page_func *func, void *aux) {
+	if (spt->root == NULL)
+		return true;
+	return spt_node_for_each (spt->root, 0, 0, (uint64_t) pg_round_down (start),
+			(uint64_t) end, func, aux);
+}
+
+/* Sets up the frame table over the user pool. */
+static void
+frame_table_init (void) {
+	void *base;
+
+	palloc_user_pool (&base, &frame_cnt, &free_frame_cnt);
+	frame_base = base;
+	frames = calloc (frame_cnt, sizeof *frames);
+	if (frames == NULL)
+		PANIC ("frame_table_init: out of memory");
+	for (size_t i = 0; i < frame_cnt; i++)
+		frames[i].kva = frame_base + i * PGSIZE;
+
+	lock_init (&frame_lock);
+	cond_init (&writeback_done);
+	free_low = frame_cnt / 64 + 1;
+	free_high = frame_cnt / 32 + 2;
+	sema_init (&reclaim_sema, 0);
+}
+
+/* Returns the frame for KVA, a page of the user pool. */
 static struct frame *
-vm_get_victim (void) {
+frame_of (void *kva) {
+	size_t idx = ((uint8_t *) kva - frame_base) / PGSIZE;
+
+	ASSERT (idx < frame_cnt);
+	return &frames[idx];
+}
+
+/* Returns FRAME to the user pool.  FRAME must not be mapped. */
+static void
+frame_release (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	frame_uncache (frame);
+	frame->page = NULL;
+	frame->ref_cnt = 0;
+	frame->pinned = false;
+	palloc_free_page (frame->kva);
+	free_frame_cnt++;
+}
+
+/* Makes PAGE the only page mapping FRAME, which must be unused. */
+static void
+frame_link (struct frame *frame, struct page *page) {
+	ASSERT (frame->page == NULL);
+
+	frame->page = page;
+	frame->ref_cnt = 1;
+	page->frame = frame;
+	page->frame_next = NULL;
+}
+
+/* Removes PAGE from the pages mapping FRAME.  Does not unmap it. */
+static void
+frame_unlink (struct frame *frame, struct page *page) {
+	struct page **pp;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (pp = &frame->page; *pp != page; pp = &(*pp)->frame_next)
+		ASSERT (*pp != NULL);
+	*pp = page->frame_next;
+	if (frame->cache != NULL && frame->ref_cnt > 1)
+		cache_saved--;
+	frame->ref_cnt--;
+	page->frame = NULL;
+	page->frame_next = NULL;
+}
+
+/* Adds PAGE, which has already been mapped to FRAME, to the pages that
+ * share FRAME. */
+static void
+frame_share (struct frame *frame, struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (frame->page != NULL);
+
+	page->frame = frame;
+	page->frame_next = frame->page;
+	frame->page = page;
+	frame->ref_cnt++;
+	if (frame->cache != NULL && ++cache_saved > cache_saved_max)
+		cache_saved_max = cache_saved;
+}
+
+/* Removes FRAME from the file page cache, if it is there. */
+static void
+frame_uncache (struct frame *frame) {
+	if (frame->cache != NULL) {
+		if (frame->ref_cnt > 1)
+			cache_saved -= frame->ref_cnt - 1;
+		file_cache_remove (frame);
+	}
+}
+
+/* Maps PAGE to KVA, which holds the same contents as PAGE's last mapping
+ * did, keeping the dirty bit of that mapping. */
+static bool
+page_remap (struct page *page, void *kva, bool writable) {
+	uint64_t *pml4 = page->owner->pml4;
+	bool dirty = pml4_is_dirty (pml4, page->va);
+
+	if (!pml4_set_page (pml4, page->va, kva, writable))
+		return false;
+	if (dirty)
+		pml4_set_dirty (pml4, page->va, true);
+	return true;
+}
+
+/* Flushes the TLB invalidations queued in EVICT_TLB. */
+static void
+evict_flush (void) {
+	for (size_t i = 0; i < evict_tlb_cnt; i++)
+		tlb_gather_flush (&evict_tlb[i]);
+	evict_tlb_cnt = 0;
+}
+
+/* Returns the gather in EVICT_TLB for PML4, flushing them all first if
+ * there is none and no room for another. */
+static struct tlb_gather *
+evict_gather (uint64_t *pml4) {
+	for (size_t i = 0; i < evict_tlb_cnt; i++)
+		if (evict_tlb[i].pml4 == pml4)
+			return &evict_tlb[i];
+	if (evict_tlb_cnt == EVICT_PML4_MAX)
+		evict_flush ();
+	tlb_gather_init (&evict_tlb[evict_tlb_cnt], pml4);
+	return &evict_tlb[evict_tlb_cnt++];
+}
+
+/* Returns true if any of the pages mapping FRAME has been accessed since
+ * the last call, clearing their accessed bits.  Queues the invalidations
+ * in EVICT_TLB; until they are flushed, a page may be accessed again
+ * without setting its bit, which only costs it its second chance. */
+static bool
+frame_test_and_clear_accessed (struct frame *frame) {
+	bool accessed = false;
+
+	for (struct page *p = frame->page; p != NULL; p = p->frame_next) {
+		uint64_t *pml4 = p->owner->pml4;
+
+		if (pml4_is_accessed (pml4, p->va)) {
+			note_around (p);
+			pml4_set_accessed_gather (evict_gather (pml4), p->va, false);
+			accessed = true;
+		}
+	}
+	return accessed;
+}
+
+/* Returns true if PAGE, which is resident, is mapped as part of a huge
+ * page. */
+static bool
+page_is_huge (struct page *page) {
+	uint64_t *pte = pml4e_walk (page->owner->pml4, (uint64_t) page->va, 0);
+
+	return pte != NULL && is_huge_pte (pte);
+}
+
+/* Get the struct frame, that will be evicted.
+ *
+ * The CLOCK algorithm: advance the hand around the frame table, giving
+ * each frame whose pages have been accessed a second chance by clearing
+ * their accessed bits, and stopping at the first frame whose pages have
+ * not.  *BUDGET is the number of frames that may still be examined, and
+ * is decremented for each one.  Returns null if it runs out. */
+static struct frame *
+vm_get_victim (size_t *budget) {
 	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
 
+	while (victim == NULL && *budget > 0) {
+		struct frame *frame = &frames[clock_hand];
+
+		clock_hand = (clock_hand + 1) % frame_cnt;
+		--*budget;
+		if (frame->page == NULL || frame->pinned)
+			continue;
+		if (!frame_test_and_clear_accessed (frame))
+			victim = frame;
+		else if (page_is_huge (frame->page)) {
+			/* The other frames of the huge page share the accessed bit
+			 * just cleared, so the next of them would be taken and the
+			 * huge page split even though it is in use.  Pass them by. */
+			uint8_t *end = (uint8_t *) ((uint64_t) frame->kva & ~HPGMASK)
+				+ HPGSIZE;
+			size_t skip = (end - frame_base) / PGSIZE - (frame - frames) - 1;
+
+			if (skip > *budget)
+				skip = *budget;
+			*budget -= skip;
+			clock_hand = (frame - frames + 1 + skip) % frame_cnt;
+		}
+	}
 	return victim;
 }
 
+/* Unmaps FRAME from all of its pages and writes it out.  Returns true if
+ * successful.  On failure, restores the mappings. */
+static bool
+frame_swap_out (struct frame *frame) {
+	struct page *page = frame->page;
+	struct page *p;
+
+	/* Unmap first, so that the pages cannot change while they are
+	 * written.  One flush covers the unmaps and the accessed bits the
+	 * scan cleared. */
+	for (p = page; p != NULL; p = p->frame_next)
+		pml4_clear_page_gather (evict_gather (p->owner->pml4), p->va);
+	evict_flush ();
+
+	if (!swap_out (page)) {
+		for (p = page; p != NULL; p = p->frame_next)
+			page_remap (p, frame->kva, p->writable && frame->ref_cnt == 1);
+		return false;
+	}
+
+	frame_uncache (frame);
+	while (page != NULL) {
+		p = page->frame_next;
+		note_around (page);
+		page->frame = NULL;
+		page->frame_next = NULL;
+		page = p;
+	}
+	frame->page = NULL;
+	frame->ref_cnt = 0;
+	return true;
+}
+
 /* Evict one page and return the corresponding frame.
  * Return NULL on error.*/
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
+	/* Two turns of the hand are enough to find a frame, unless every
+	 * frame is pinned or cannot be written out. */
+	size_t budget = 2 * frame_cnt;
+	struct frame *victim;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
 
-	return NULL;
+	while ((victim = vm_get_victim (&budget)) != NULL)
+		if (frame_swap_out (victim))
+			break;
+	evict_flush ();
+
+	scan_cnt += 2 * frame_cnt - budget;
+	if (2 * frame_cnt - budget > scan_max)
+		scan_max = 2 * frame_cnt - budget;
+	if (victim != NULL)
+		evict_cnt++;
+	return victim;
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
- * and return it. This always return valid address. That is, if the user pool
- * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * and return it.  Returns NULL only if no frame can be evicted.  The frame
+ * is returned pinned. */
 static struct frame *
 vm_get_frame (void) {
 	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
+	void *kva;
 
-	ASSERT (frame != NULL);
-	ASSERT (frame->page == NULL);
+	lock_acquire (&frame_lock);
+	kva = palloc_get_page (PAL_USER);
+	if (kva != NULL) {
+		frame = frame_of (kva);
+		free_frame_cnt--;
+	} else {
+		frame = vm_evict_frame ();
+		if (frame != NULL)
+			sync_evict_cnt++;
+	}
+	if (frame != NULL)
+		frame->pinned = true;
+
+	if (free_frame_cnt < free_low && !reclaim_running) {
+		reclaim_running = true;
+		sema_up (&reclaim_sema);
+	}
+	lock_release (&frame_lock);
+
+	ASSERT (frame == NULL || frame->page == NULL);
 	return frame;
 }
 
+/* Returns a free frame, pinned, to read a page into ahead of need, or a
+ * null pointer if free frames are scarce.  Never evicts. */
+struct frame *
+vm_frame_get_spare (void) {
+	struct frame *frame = NULL;
+	void *kva;
+
+	lock_acquire (&frame_lock);
+	if (free_frame_cnt > free_high) {
+		kva = palloc_get_page (PAL_USER);
+		if (kva != NULL) {
+			frame = frame_of (kva);
+			frame->pinned = true;
+			free_frame_cnt--;
+		}
+	}
+	lock_release (&frame_lock);
+	return frame;
+}
+
+/* Maps PAGE, which is not resident, to FRAME, a frame from
+ * vm_frame_get_spare() that already holds PAGE's contents, and unpins
+ * FRAME.  If the file page cache has another frame with the same contents,
+ * maps that instead and releases FRAME.  Returns false if PAGE cannot be
+ * mapped, releasing FRAME. */
+bool
+vm_frame_install (struct page *page, struct frame *frame) {
+	struct frame *cached;
+	bool success;
+
+	lock_acquire (&frame_lock);
+	cached = file_cache_lookup (page);
+	if (cached != NULL) {
+		frame_release (frame);
+		frame = cached;
+	}
+	success = pml4_set_page (page->owner->pml4, page->va, frame->kva,
+			page->writable);
+	if (!success) {
+		if (cached == NULL)
+			frame_release (frame);
+	} else if (cached != NULL) {
+		frame_share (frame, page);
+		cache_hit_cnt++;
+	} else {
+		frame_link (frame, page);
+		file_cache_insert (page, frame);
+		frame->pinned = false;
+	}
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Releases FRAME, a frame from vm_frame_get_spare() that turned out not to
+ * be needed. */
+void
+vm_frame_put_spare (struct frame *frame) {
+	lock_acquire (&frame_lock);
+	frame_release (frame);
+	lock_release (&frame_lock);
+}
+
+/* Background reclaimer.  Whenever woken up, evicts frames until FREE_HIGH
+ * frames are free, dropping FRAME_LOCK and yielding between evictions so
+ * that faulting threads can take the frames it frees as it goes.  Releasing
+ * the lock alone would not let them in: it wakes a waiter, but does not
+ * preempt for one of the same priority. */
+static void
+reclaim_thread (void *aux UNUSED) {
+	for (;;) {
+		sema_down (&reclaim_sema);
+
+		lock_acquire (&frame_lock);
+		reclaim_cnt++;
+		while (free_frame_cnt < free_high) {
+			struct frame *frame = vm_evict_frame ();
+
+			if (frame == NULL)
+				break;
+			frame_release (frame);
+			lock_release (&frame_lock);
+			thread_yield ();
+			lock_acquire (&frame_lock);
+		}
+		reclaim_running = false;
+		lock_release (&frame_lock);
+	}
+}
+
+/* Waits until the writeback thread is not writing PAGE's frame.  The
+ * caller holds FRAME_LOCK. */
+static void
+wait_writeback (struct page *page) {
+	while (page->frame != NULL && page->frame->writeback)
+		cond_wait (&writeback_done, &frame_lock);
+}
+
+/* Of the CNT pages in PAGES, at most WB_BATCH pages of mappings sorted by
+ * file and offset, stores those that are resident and dirty in DIRTY and
+ * marks them clean.  Returns the number stored.  The caller holds
+ * FRAME_LOCK. */
+static size_t
+take_dirty (struct page *const pages[], size_t cnt, struct page **dirty) {
+	size_t n = 0;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (cnt <= WB_BATCH);
+
+	/* Clear the dirty bits before the write, so that a store that races
+	 * with it marks the page dirty again. */
+	for (size_t i = 0; i < cnt; i++) {
+		struct page *p = pages[i];
+
+		if (p->frame != NULL && pml4_is_dirty (p->owner->pml4, p->va)) {
+			pml4_set_dirty (p->owner->pml4, p->va, false);
+			dirty[n++] = p;
+		}
+	}
+	return n;
+}
+
+/* Writes back those of the CNT pages in PAGES, at most WB_BATCH pages of
+ * mappings sorted by file and offset, that are resident and dirty, for
+ * REASON, and marks them clean.  The caller holds FRAME_LOCK, which stays
+ * held during the write.  Returns the number of pages written back. */
+static size_t
+write_back_dirty (struct page *const pages[], size_t cnt,
+		enum writeback_reason reason) {
+	struct page *dirty[WB_BATCH];
+	size_t n;
+
+	for (size_t i = 0; i < cnt; i++)
+		wait_writeback (pages[i]);
+	n = take_dirty (pages, cnt, dirty);
+	if (n > 0)
+		file_write_back (dirty, n, reason);
+	return n;
+}
+
+/* Starts the writeback thread, if it is not running yet. */
+void
+vm_writeback_start (void) {
+	bool start;
+
+	lock_acquire (&frame_lock);
+	start = !writeback_started;
+	writeback_started = true;
+	lock_release (&frame_lock);
+	if (start)
+		thread_create ("writeback", PRI_DEFAULT, writeback_thread, NULL);
+}
+
+/* Orders wb_entry A before B by file and offset. */
+static int
+wb_entry_compare (const void *a_, const void *b_, void *aux UNUSED) {
+	const struct wb_entry *a = a_;
+	const struct wb_entry *b = b_;
+
+	if (a->inode != b->inode)
+		return a->inode < b->inode ? -1 : 1;
+	return a->ofs < b->ofs ? -1 : a->ofs > b->ofs;
+}
+
+/* Returns true if E still describes a dirty page that may be written
+ * back. */
+static bool
+wb_entry_valid (const struct wb_entry *e) {
+	struct inode *inode;
+	off_t ofs;
+
+	return e->frame->page == e->page && !e->frame->pinned
+		&& file_mapped_pos (e->page, &inode, &ofs)
+		&& inode == e->inode && ofs == e->ofs;
+}
+
+/* Writeback thread.  See the comment on VM_DIRTY_RATIO. */
+static void
+writeback_thread (void *aux UNUSED) {
+	for (;;) {
+		size_t cnt = 0, dirty_cnt = 0;
+
+		timer_sleep (WB_INTERVAL);
+
+		/* Find the dirty mapped pages. */
+		lock_acquire (&frame_lock);
+		wb_wakeup_cnt++;
+		for (size_t i = 0; i < frame_cnt; i++) {
+			struct frame *frame = &frames[i];
+			struct page *page = frame->page;
+			struct inode *inode;
+			off_t ofs;
+
+			if (page == NULL || frame->pinned
+					|| !file_mapped_pos (page, &inode, &ofs)
+					|| !pml4_is_dirty (page->owner->pml4, page->va))
+				continue;
+			dirty_cnt++;
+			if (cnt < WB_SCAN_MAX)
+				wb_entries[cnt++] = (struct wb_entry) {
+					.frame = frame, .page = page, .inode = inode, .ofs = ofs,
+				};
+		}
+		if (dirty_cnt * 100 <= (size_t) vm_dirty_ratio * frame_cnt
+				&& free_frame_cnt >= free_high)
+			cnt = 0;
+		lock_release (&frame_lock);
+		if (cnt == 0)
+			continue;
+
+		/* Write them back in file order, a batch at a time, skipping any
+		 * that were freed or evicted meanwhile.  Pinning the frames keeps
+		 * them from being evicted, and marking them keeps their pages from
+		 * being freed, while FRAME_LOCK is dropped for the write. */
+		sort (wb_entries, cnt, sizeof *wb_entries, wb_entry_compare, NULL);
+		for (size_t i = 0; i < cnt; i += WB_BATCH) {
+			struct page *pages[WB_BATCH];
+			struct page *dirty[WB_BATCH];
+			size_t n = 0;
+
+			lock_acquire (&frame_lock);
+			for (size_t j = i; j < cnt && j < i + WB_BATCH; j++)
+				if (wb_entry_valid (&wb_entries[j]))
+					pages[n++] = wb_entries[j].page;
+			n = take_dirty (pages, n, dirty);
+			for (size_t j = 0; j < n; j++)
+				dirty[j]->frame->pinned = dirty[j]->frame->writeback = true;
+			lock_release (&frame_lock);
+
+			if (n == 0)
+				continue;
+			file_write_back (dirty, n, WB_THREAD);
+
+			lock_acquire (&frame_lock);
+			for (size_t j = 0; j < n; j++) {
+				struct page *p = dirty[j];
+
+				p->frame->pinned = p->frame->writeback = false;
+				if (pml4_is_dirty (p->owner->pml4, p->va))
+					wb_redirty_cnt++;
+			}
+			wb_page_cnt += n;
+			cond_broadcast (&writeback_done, &frame_lock);
+			lock_release (&frame_lock);
+		}
+		wb_pass_cnt++;
+	}
+}
+
 /* Growing the stack. */
 static void
-vm_stack_growth (void *addr UNUSED) {
+vm_stack_growth (void *addr) {
+	vm_alloc_page (VM_ANON | VM_STACK, pg_round_down (addr), true);
+}
+
+/* Returns true if a fault at ADDR with stack pointer RSP looks like an
+ * access to the stack just below its current bottom.  PUSH can fault 8
+ * bytes below RSP before RSP is updated. */
+static bool
+is_stack_access (void *addr, uintptr_t rsp) {
+	uintptr_t va = (uintptr_t) addr;
+
+	return va < USER_STACK && va >= USER_STACK - STACK_MAX && va + 8 >= rsp;
+}
+
+/* Maps the pages that are not yet resident in the fault-around window
+ * around PAGE, which was just faulted in, whose contents are in the file
+ * page cache.  Reading pages in ahead is left to segment_read(). */
+static void
+fault_around (struct page *page) {
+	struct supplemental_page_table *spt = &page->owner->spt;
+	size_t window = vm_fault_around_pages * PGSIZE;
+	uint8_t *start = (uint8_t *) ((uintptr_t) page->va & ~(window - 1));
+
+	for (uint8_t *va = start; va < start + window; va += PGSIZE) {
+		struct page *p = spt_find_page (spt, va);
+
+		if (p != NULL && p->frame == NULL && claim_cached (p)) {
+			p->faulted_around = true;
+			around_cnt++;
+		}
+	}
+}
+
+/* If PAGE was loaded by fault-around and has not been counted since,
+ * counts it as a fault avoided if it has been accessed, or else as a page
+ * loaded in vain.  Called when the accessed bit is about to be cleared or
+ * the page is about to leave its frame; an unmapped page counts as not
+ * accessed, since eviction only picks frames not accessed lately. */
+static void
+note_around (struct page *page) {
+	if (page->faulted_around) {
+		if (pml4_is_accessed (page->owner->pml4, page->va))
+			around_used_cnt++;
+		else
+			around_unused_cnt++;
+		page->faulted_around = false;
+	}
 }
 
-/* Handle the fault on write_protected page */
+/* Returns true if PAGE, which is not resident, would be read in as all
+ * zeros: a stack page never touched, or an anonymous page that
+ * anon_is_zero() says so of. */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+page_is_zero (const struct page *page) {
+	if (VM_TYPE (page->operations->type) == VM_UNINIT)
+		return page->uninit.init == NULL
+			&& VM_TYPE (page->uninit.type) == VM_ANON;
+	return anon_is_zero (page);
+}
+
+/* Maps PAGE, which is not resident and page_is_zero(), read-only to the
+ * zero page. */
+static bool
+map_zero_page (struct page *page) {
+	bool success;
+
+	lock_acquire (&frame_lock);
+	success = pml4_set_page (page->owner->pml4, page->va, zero_kva, false);
+	if (success) {
+		page->zero_mapped = true;
+		zero_map_cnt++;
+		if (++zero_mapped_cnt > zero_mapped_max)
+			zero_mapped_max = zero_mapped_cnt;
+	}
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Notes that PAGE's mapping to the zero page has been replaced or
+ * removed.  The caller must hold FRAME_LOCK. */
+static void
+zero_forget (struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (page->zero_mapped);
+
+	page->zero_mapped = false;
+	zero_mapped_cnt--;
+}
+
+/* Makes PAGE resident along with the rest of its 2 MB region, mapped
+ * with one huge page, if the region qualifies and an aligned run of frames
+ * is free.  See vm_huge_pages.  Returns false, leaving PAGE to be claimed
+ * by itself, if not. */
+static bool
+huge_claim (struct page *page) {
+	struct thread *t = page->owner;
+	uint8_t *base = (uint8_t *) ((uint64_t) page->va & ~HPGMASK);
+	struct page **slots = spt_walk (&t->spt, (uint64_t) base, false);
+	uint8_t *kva = NULL;
+	bool success = false;
+	size_t i;
+
+	/* The region is one leaf of the supplemental page table. */
+	if (slots == NULL || !is_user_vaddr (base + HPGSIZE - 1))
+		return false;
+	for (i = 0; i < HPG_PAGE_CNT; i++) {
+		struct page *p = slots[i];
+
+		if (p == NULL || !p->writable || p->frame != NULL || p->zero_mapped
+				|| !page_is_zero (p))
+			return false;
+	}
+
+	lock_acquire (&frame_lock);
+	if (free_frame_cnt >= free_high + HPG_PAGE_CNT)
+		kva = palloc_get_huge_page (PAL_USER);
+	if (kva != NULL) {
+		free_frame_cnt -= HPG_PAGE_CNT;
+		for (i = 0; i < HPG_PAGE_CNT; i++)
+			frame_of (kva + i * PGSIZE)->pinned = true;
+	}
+	lock_release (&frame_lock);
+	if (kva == NULL)
+		return false;
+
+	/* The pages are all zeros, so this only clears the frames. */
+	for (i = 0; i < HPG_PAGE_CNT; i++)
+		if (!swap_in (slots[i], kva + i * PGSIZE))
+			break;
+
+	lock_acquire (&frame_lock);
+	if (i == HPG_PAGE_CNT && pml4_set_huge_page (t->pml4, base, kva, true)) {
+		for (i = 0; i < HPG_PAGE_CNT; i++) {
+			struct frame *frame = frame_of (kva + i * PGSIZE);
+
+			frame_link (frame, slots[i]);
+			frame->pinned = false;
+		}
+		huge_cnt++;
+		success = true;
+	} else {
+		/* Pages already initialized are anonymous pages now, which read
+		 * back in as zeros all the same. */
+		for (i = 0; i < HPG_PAGE_CNT; i++)
+			frame_release (frame_of (kva + i * PGSIZE));
+	}
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Handle the fault on write_protected page
+ *
+ * PAGE is writable but mapped read-only, because it shares its frame with
+ * copies made by fork(), or because it is mapped to the zero page.  Gives
+ * PAGE a copy of the frame of its own, or if the other pages have gone
+ * since, just makes the mapping writable. */
+static bool
+vm_handle_wp (struct page *page) {
+	struct frame *frame;
+	struct frame *copy = NULL;
+	bool success;
+
+	/* Reading in a page of zeros replaces the zero page mapping. */
+	if (page->zero_mapped) {
+		if (!vm_do_claim_page (page))
+			return false;
+		lock_acquire (&frame_lock);
+		zero_forget (page);
+		zero_write_cnt++;
+		lock_release (&frame_lock);
+		return true;
+	}
+
+	for (;;) {
+		lock_acquire (&frame_lock);
+		frame = page->frame;
+		if (frame == NULL || frame->ref_cnt == 1 || copy != NULL)
+			break;
+
+		/* Allocating may evict, so it needs the lock released. */
+		lock_release (&frame_lock);
+		copy = vm_get_frame ();
+		if (copy == NULL)
+			return false;
+	}
+
+	if (frame == NULL) {
+		/* Evicted while we waited.  Reading it back in gives the page a
+		 * frame of its own. */
+		if (copy != NULL)
+			frame_release (copy);
+		lock_release (&frame_lock);
+		return vm_do_claim_page (page);
+	}
+
+	if (frame->ref_cnt == 1) {
+		struct tlb_gather g;
+
+		if (copy != NULL)
+			frame_release (copy);
+		tlb_gather_init (&g, page->owner->pml4);
+		pml4_set_writable_gather (&g, page->va, true);
+		tlb_gather_flush (&g);
+		cow_reuse_cnt++;
+		lock_release (&frame_lock);
+		return true;
+	}
+
+	memcpy (copy->kva, frame->kva, PGSIZE);
+	frame_unlink (frame, page);
+	frame_link (copy, page);
+	success = page_remap (page, copy->kva, true);
+	copy->pinned = false;
+	cow_copy_cnt++;
+	lock_release (&frame_lock);
+	return success;
 }
 
 /* Return true on success */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
-	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
+vm_try_handle_fault (struct intr_frame *f, void *addr,
+		bool user, bool write, bool not_present) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct page *page;
 
-	return vm_do_claim_page (page);
+	if (addr == NULL || !is_user_vaddr (addr))
+		return false;
+
+	page = spt_find_page (spt, addr);
+	if (page == NULL) {
+		/* A kernel fault's F->rsp is the kernel stack, so a fault in a
+		 * system call checks the user stack pointer saved on entry
+		 * instead.  Other kernel faults cannot grow the stack. */
+		uintptr_t rsp = user ? f->rsp : thread_current ()->user_rsp;
+
+		if (rsp == 0 || !is_stack_access (addr, rsp))
+			return false;
+		vm_stack_growth (addr);
+		page = spt_find_page (spt, addr);
+		if (page == NULL)
+			return false;
+	}
+
+	if (!not_present)
+		return write && page->writable && vm_handle_wp (page);
+	if (write && !page->writable)
+		return false;
+	if (vm_huge_pages && huge_claim (page))
+		return true;
+	if (!write && page_is_zero (page))
+		return map_zero_page (page);
+	if (!vm_do_claim_page (page))
+		return false;
+	if (!write && vm_fault_around_pages > 1
+			&& VM_TYPE (page->operations->type) == VM_FILE)
+		fault_around (page);
+	return true;
 }
 
 /* Free the page.
@@ -148,43 +1276,288 @@ vm_dealloc_page (struct page *page) {
 	free (page);
 }
 
+/* Adds the pages of SEG to the current process, which read their contents
+ * from SEG when first touched.  TYPE is VM_FILE for pages that stay backed
+ * by SEG's file, or VM_ANON for pages that become private copies once
+ * written.  Fails if any of the pages is already in use, possibly after
+ * adding some of them. */
+bool
+vm_alloc_segment (struct segment *seg, enum vm_type type, bool writable) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+
+	for (size_t i = 0; i < seg->page_cnt; i++) {
+		void *va = seg->start + i * PGSIZE;
+		struct page *page;
+
+		if (spt_find_page (spt, va) != NULL)
+			return false;
+		page = malloc (sizeof *page);
+		if (page == NULL)
+			return false;
+		page->va = va;
+		page->owner = thread_current ();
+		page->writable = writable;
+		page->frame = NULL;
+		page->frame_next = NULL;
+		page->faulted_around = false;
+		page->zero_mapped = false;
+		if (type == VM_ANON)
+			anon_init_segment (page, seg);
+		else
+			file_init_segment (page, seg);
+
+		if (!spt_insert_page (spt, page)) {
+			vm_dealloc_page (page);
+			return false;
+		}
+	}
+	return true;
+}
+
 /* Claim the page that allocate on VA. */
 bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
+vm_claim_page (void *va) {
+	struct page *page = spt_find_page (&thread_current ()->spt, va);
 
+	if (page == NULL)
+		return false;
 	return vm_do_claim_page (page);
 }
 
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+	struct frame *frame;
+
+	if (claim_cached (page))
+		return true;
+	frame = vm_get_frame ();
+	if (frame == NULL)
+		return false;
+	return claim_in_frame (page, frame);
+}
+
+/* If PAGE is a read-only file page whose contents are in the file page
+ * cache, maps it to the frame that holds them and returns true. */
+static bool
+claim_cached (struct page *page) {
+	struct frame *frame;
+	bool success = false;
 
+	if (page->writable || page_get_type (page) != VM_FILE)
+		return false;
+	lock_acquire (&frame_lock);
+	frame = file_cache_lookup (page);
+	if (frame != NULL
+			&& pml4_set_page (page->owner->pml4, page->va, frame->kva, false)) {
+		frame_share (frame, page);
+		cache_hit_cnt++;
+		success = true;
+	}
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Loads PAGE into FRAME, a pinned frame not in use, and maps it.  On
+ * failure, releases FRAME. */
+static bool
+claim_in_frame (struct page *page, struct frame *frame) {
 	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	lock_acquire (&frame_lock);
+	frame_link (frame, page);
+	lock_release (&frame_lock);
+
+	/* Fill the frame before mapping it, so that the process never sees a
+	 * partly loaded page.  The frame stays pinned until then. */
+	if (!swap_in (page, frame->kva)
+			|| !pml4_set_page (page->owner->pml4, page->va, frame->kva,
+				page->writable)) {
+		lock_acquire (&frame_lock);
+		frame_unlink (frame, page);
+		frame_release (frame);
+		lock_release (&frame_lock);
+		return false;
+	}
+	lock_acquire (&frame_lock);
+	if (VM_TYPE (page->operations->type) == VM_FILE)
+		file_cache_insert (page, frame);
+	frame->pinned = false;
+	lock_release (&frame_lock);
+	return true;
+}
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+/* Makes PAGE resident, if it is not, and pins its frame so that it stays
+ * resident until page_unpin(). */
+static bool
+page_pin (struct page *page) {
+	for (;;) {
+		lock_acquire (&frame_lock);
+		if (page->frame != NULL) {
+			page->frame->pinned = true;
+			lock_release (&frame_lock);
+			return true;
+		}
+		lock_release (&frame_lock);
 
-	return swap_in (page, frame->kva);
+		if (!vm_do_claim_page (page))
+			return false;
+	}
+}
+
+/* Lets PAGE's frame be evicted again. */
+static void
+page_unpin (struct page *page) {
+	lock_acquire (&frame_lock);
+	page->frame->pinned = false;
+	lock_release (&frame_lock);
 }
 
 /* Initialize new supplemental page table */
 void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	spt->root = NULL;
+	spt->page_cnt = 0;
+}
+
+/* Copies SRC, an anonymous or read-only file page of another process, into
+ * the current process's supplemental page table, sharing its frame, if it
+ * has one, copy-on-write if SRC is writable.  Queues the TLB invalidation
+ * for making SRC read-only on the tlb_gather G_. */
+static bool
+share_page (struct page *src, void *g_) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct tlb_gather *g = g_;
+	struct page *page = malloc (sizeof *page);
+	struct frame *frame;
+	bool success = true;
+
+	if (page == NULL)
+		return false;
+	page->va = src->va;
+	page->owner = thread_current ();
+	page->writable = src->writable;
+	page->frame = NULL;
+	page->frame_next = NULL;
+	page->faulted_around = false;
+	page->zero_mapped = false;
+
+	lock_acquire (&frame_lock);
+	if (VM_TYPE (src->operations->type) == VM_ANON)
+		anon_copy (page, src);
+	else
+		file_backed_copy (page, src);
+	frame = src->frame;
+	if (frame != NULL) {
+		if (pml4_set_page (page->owner->pml4, page->va, frame->kva, false)) {
+			frame_share (frame, page);
+			if (src->writable) {
+				if (g->pml4 == NULL)
+					g->pml4 = src->owner->pml4;
+				pml4_set_writable_gather (g, src->va, false);
+				cow_share_cnt++;
+			}
+		} else
+			success = false;
+	}
+	lock_release (&frame_lock);
+
+	if (!success || !spt_insert_page (spt, page)) {
+		struct free_batch b;
+
+		free_batch_init (&b, page->owner->pml4);
+		lock_acquire (&frame_lock);
+		page_free (page, &b);
+		free_batch_flush (&b);
+		lock_release (&frame_lock);
+		return false;
+	}
+	return true;
+}
+
+/* Copies SRC, a page of another process, into the current process's
+ * supplemental page table. */
+static bool
+copy_page (struct page *src, void *aux) {
+	struct supplemental_page_table *dst = &thread_current ()->spt;
+	struct page *page;
+
+	/* The only pages born uninitialized are stack pages, which have no
+	 * aux to copy. */
+	if (VM_TYPE (src->operations->type) == VM_UNINIT) {
+		ASSERT (src->uninit.aux == NULL);
+		return vm_alloc_page_with_initializer (src->uninit.type, src->va,
+				src->writable, src->uninit.init, NULL);
+	}
+
+	if (VM_TYPE (src->operations->type) == VM_ANON
+			|| (VM_TYPE (src->operations->type) == VM_FILE && !src->writable))
+		return share_page (src, aux);
+
+	/* A writable mapping stays with the parent; the child gets a private
+	 * copy of each page.  Bring the parent's page in, if necessary, and
+	 * copy its contents, with both frames pinned so that neither is
+	 * evicted meanwhile. */
+	if (!vm_alloc_page (VM_ANON, src->va, src->writable))
+		return false;
+	page = spt_find_page (dst, src->va);
+	if (!page_pin (src))
+		return false;
+	if (!page_pin (page)) {
+		page_unpin (src);
+		return false;
+	}
+	memcpy (page->frame->kva, src->frame->kva, PGSIZE);
+	page_unpin (page);
+	page_unpin (src);
+	return true;
 }
 
 /* Copy supplemental page table from src to dst */
 bool
-supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+supplemental_page_table_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	struct tlb_gather g;
+	bool success;
+
+	ASSERT (dst == &thread_current ()->spt);
+
+	/* The parent's pages become read-only as they are shared.  The parent
+	 * is waiting for the fork to complete, so its TLB need only be flushed
+	 * once at the end.  share_page() fills in the page map. */
+	tlb_gather_init (&g, NULL);
+	success = spt_for_each (src, NULL, (void *) KERN_BASE, copy_page, &g);
+	tlb_gather_flush (&g);
+	return success;
+}
+
+/* Frees NODE, which is at LEVEL in the tree, and everything below it,
+ * including the pages in its leaves. */
+static void
+spt_node_free (void **node, int level, struct free_batch *b) {
+	for (size_t i = 0; i < SPT_FANOUT; i++)
+		if (node[i] != NULL) {
+			if (level == SPT_LEVELS - 1)
+				page_free (node[i], b);
+			else
+				spt_node_free (node[i], level + 1, b);
+		}
+	palloc_free_page (node);
 }
 
 /* Free the resource hold by the supplemental page table */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	struct free_batch b;
+
+	if (spt->root == NULL)
+		return;
+
+	/* Unmap the pages in batches rather than flushing the TLB for each. */
+	free_batch_init (&b, thread_current ()->pml4);
+	lock_acquire (&frame_lock);
+	spt_node_free (spt->root, 0, &b);
+	spt->root = NULL;
+	spt->page_cnt = 0;
+	free_batch_flush (&b);
+	lock_release (&frame_lock);
 }
@@ -0,0 +1,309 @@
+/* zswap.c: Compressed cache in front of the swap disk. */
+
+#include "vm/zswap.h"
+#include <debug.h>
+#include <list.h>
+#include <lz.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Compressed swap cache.
+
+   Writing a page to the swap disk takes eight sector writes and
+   reading it back eight more, by PIO.  Instead, anon.c offers each
+   page it swaps out to the cache, which compresses it into a pool
+   of kernel pages and keeps it under its swap slot.  A page that
+   does not compress to STORE_MAX bytes or less goes to the disk as
+   before.  When the pool is full, the cache writes the least
+   recently used pages out to their slots on the disk to make room.
+   Reading a slot takes it from the cache if it is there, and from
+   the disk otherwise.  An entry stays in the cache after it is read,
+   because the page keeps its slot so that it can be evicted again
+   without being written if it does not change; freeing or rewriting
+   the slot drops the entry.
+
+   The pool has at most ZSWAP_POOL_PAGES pages, taken from the kernel
+   pool as needed and given back when empty.  Each is divided into 64
+   chunks, and a compressed page takes a run of adjacent chunks in a
+   single pool page. */
+
+/* Size of the pool in pages, or 0 to disable the cache.  Set with the
+   -zswap kernel option. */
+size_t zswap_pool_pages = 256;
+
+#define SLOT_SECTORS (PGSIZE / DISK_SECTOR_SIZE)
+#define CHUNK_CNT 64                    /* Chunks per pool page. */
+#define CHUNK_SIZE (PGSIZE / CHUNK_CNT) /* Bytes per chunk. */
+#define STORE_MAX (PGSIZE * 3 / 4)      /* Largest compressed page kept. */
+#define WRITEBACK_MAX 16                /* Most pages written back to
+                                           make room for one. */
+
+/* A compressed page in the cache. */
+struct zswap_entry {
+	struct list_elem lru_elem;  /* Element in LRU. */
+	size_t slot;                /* Swap slot whose contents it holds. */
+	size_t size;                /* Compressed size in bytes. */
+	size_t pool_idx;            /* Pool page that holds it. */
+	unsigned chunk;             /* First chunk it occupies there. */
+	unsigned chunk_cnt;         /* Number of chunks. */
+};
+
+/* A page of the pool. */
+struct pool_page {
+	uint8_t *kva;               /* The page, or null if not allocated. */
+	uint64_t used;              /* Chunks in use, one bit each. */
+	unsigned free_cnt;          /* Number of chunks not in use. */
+};
+
+static struct disk *swap_disk;
+static struct zswap_entry **entries;    /* Entry for each slot, or null. */
+static struct list lru;                 /* Entries, least recent first. */
+static struct pool_page *pool;          /* ZSWAP_POOL_PAGES pool pages. */
+static struct lock zswap_lock;          /* Protects all of the above. */
+static void *lz_work;                   /* Work area for lz_compress(). */
+static uint8_t *comp_buf;               /* Page being stored, compressed. */
+static uint8_t *wb_buf;                 /* Page being written back. */
+
+/* Statistics. */
+static size_t pool_used, pool_peak;     /* Pool pages allocated, most. */
+static long long store_cnt;             /* Pages stored. */
+static long long store_bytes;           /* ...their total compressed size. */
+static long long reject_cnt;            /* Pages offered but not stored. */
+static long long hit_cnt, miss_cnt;     /* Slot reads found, not found. */
+static long long writeback_cnt;         /* Pages written back to disk. */
+
+/* Sets up the cache in front of SWAP_DISK, which has SLOT_CNT slots, if
+ * it is enabled. */
+void
+zswap_init (struct disk *disk, size_t slot_cnt) {
+	ASSERT (LZ_WORK_SIZE <= PGSIZE);
+
+	if (zswap_pool_pages == 0)
+		return;
+
+	swap_disk = disk;
+	entries = calloc (slot_cnt, sizeof *entries);
+	pool = calloc (zswap_pool_pages, sizeof *pool);
+	lz_work = palloc_get_page (0);
+	comp_buf = palloc_get_page (0);
+	wb_buf = palloc_get_page (0);
+	if (entries == NULL || pool == NULL || lz_work == NULL || comp_buf == NULL
+			|| wb_buf == NULL)
+		PANIC ("zswap_init: out of memory");
+	list_init (&lru);
+	lock_init (&zswap_lock);
+}
+
+/* Prints compressed cache statistics. */
+void
+zswap_print_stats (void) {
+	long long ratio;
+
+	if (entries == NULL)
+		return;
+
+	ratio = store_bytes ? store_cnt * PGSIZE * 100 / store_bytes : 0;
+	printf ("Zswap: %zu of %zu pool pages used, at most %zu\n",
+			pool_used, zswap_pool_pages, pool_peak);
+	printf ("Zswap: %lld pages stored, compressed %lld.%02lld:1, "
+			"%lld rejected, %lld written back\n", store_cnt, ratio / 100,
+			ratio % 100, reject_cnt, writeback_cnt);
+	printf ("Zswap: %lld of %lld slot reads hit (%lld%%), saving %lld page "
+			"writes and %lld page reads of the swap disk\n", hit_cnt,
+			hit_cnt + miss_cnt,
+			hit_cnt + miss_cnt ? hit_cnt * 100 / (hit_cnt + miss_cnt) : 0,
+			store_cnt - writeback_cnt, hit_cnt);
+}
+
+/* Returns the first of the first run of CNT chunks not in USED, or -1 if
+ * there is none. */
+static int
+find_chunks (uint64_t used, unsigned cnt) {
+	uint64_t mask = cnt < CHUNK_CNT ? (1ULL << cnt) - 1 : ~0ULL;
+
+	for (unsigned i = 0; i + cnt <= CHUNK_CNT; i++)
+		if ((used & (mask << i)) == 0)
+			return i;
+	return -1;
+}
+
+/* Finds room in the pool for SIZE bytes and records it in E.  Allocates
+ * a new pool page if no allocated one has room.  Returns false if the
+ * pool is full. */
+static bool
+pool_alloc (struct zswap_entry *e, size_t size) {
+	unsigned cnt = DIV_ROUND_UP (size, CHUNK_SIZE);
+	size_t empty = SIZE_MAX;
+	struct pool_page *p;
+	int chunk = -1;
+	size_t i;
+
+	for (i = 0; i < zswap_pool_pages; i++) {
+		p = &pool[i];
+		if (p->kva == NULL) {
+			if (empty == SIZE_MAX)
+				empty = i;
+		} else if (p->free_cnt >= cnt
+				&& (chunk = find_chunks (p->used, cnt)) >= 0)
+			break;
+	}
+
+	if (chunk < 0) {
+		if (empty == SIZE_MAX)
+			return false;
+		i = empty;
+		p = &pool[i];
+		p->kva = palloc_get_page (0);
+		if (p->kva == NULL)
+			return false;
+		p->used = 0;
+		p->free_cnt = CHUNK_CNT;
+		chunk = 0;
+		if (++pool_used > pool_peak)
+			pool_peak = pool_used;
+	}
+
+	p->used |= (cnt < CHUNK_CNT ? (1ULL << cnt) - 1 : ~0ULL) << chunk;
+	p->free_cnt -= cnt;
+	e->pool_idx = i;
+	e->chunk = chunk;
+	e->chunk_cnt = cnt;
+	return true;
+}
+
+/* Returns the compressed data of E. */
+static uint8_t *
+entry_data (const struct zswap_entry *e) {
+	return pool[e->pool_idx].kva + e->chunk * CHUNK_SIZE;
+}
+
+/* Removes the entry for SLOT, if any, from the cache and frees it. */
+static void
+entry_free (size_t slot) {
+	struct zswap_entry *e = entries[slot];
+	struct pool_page *p;
+
+	ASSERT (lock_held_by_current_thread (&zswap_lock));
+
+	if (e == NULL)
+		return;
+	p = &pool[e->pool_idx];
+	p->used &= ~((e->chunk_cnt < CHUNK_CNT ? (1ULL << e->chunk_cnt) - 1
+				: ~0ULL) << e->chunk);
+	p->free_cnt += e->chunk_cnt;
+	if (p->used == 0) {
+		palloc_free_page (p->kva);
+		p->kva = NULL;
+		pool_used--;
+	}
+	list_remove (&e->lru_elem);
+	entries[slot] = NULL;
+	free (e);
+}
+
+/* Writes the least recently used page in the cache to its slot on the
+ * disk and drops it from the cache.  Returns false if the cache is
+ * empty. */
+static bool
+writeback_oldest (void) {
+	const void *buffers[SLOT_SECTORS];
+	struct zswap_entry *e;
+	bool ok UNUSED;
+
+	if (list_empty (&lru))
+		return false;
+	e = list_entry (list_front (&lru), struct zswap_entry, lru_elem);
+	ok = lz_decompress (entry_data (e), e->size, wb_buf, PGSIZE);
+	ASSERT (ok);
+	for (size_t j = 0; j < SLOT_SECTORS; j++)
+		buffers[j] = wb_buf + j * DISK_SECTOR_SIZE;
+	disk_writev (swap_disk, e->slot * SLOT_SECTORS, buffers, SLOT_SECTORS);
+	writeback_cnt++;
+	entry_free (e->slot);
+	return true;
+}
+
+/* Stores the page at KVA as the contents of swap slot SLOT, replacing
+ * any it had in the cache.  Writes other pages back to the disk if
+ * needed to make room.  Returns true if successful, false if the caller
+ * must write the page to the disk itself. */
+bool
+zswap_store (size_t slot, const void *kva) {
+	struct zswap_entry *e = NULL;
+	size_t size;
+
+	if (entries == NULL)
+		return false;
+
+	lock_acquire (&zswap_lock);
+	entry_free (slot);
+	size = lz_compress (kva, PGSIZE, comp_buf, STORE_MAX, lz_work);
+	if (size != 0)
+		e = malloc (sizeof *e);
+	if (e != NULL)
+		for (int i = 0; !pool_alloc (e, size); i++)
+			if (i == WRITEBACK_MAX || !writeback_oldest ()) {
+				free (e);
+				e = NULL;
+				break;
+			}
+	if (e == NULL) {
+		reject_cnt++;
+		lock_release (&zswap_lock);
+		return false;
+	}
+
+	memcpy (entry_data (e), comp_buf, size);
+	e->slot = slot;
+	e->size = size;
+	entries[slot] = e;
+	list_push_back (&lru, &e->lru_elem);
+	store_cnt++;
+	store_bytes += size;
+	lock_release (&zswap_lock);
+	return true;
+}
+
+/* Reads the contents of swap slot SLOT into the page at KVA if they are
+ * in the cache, and returns true, or returns false if they are on the
+ * disk. */
+bool
+zswap_load (size_t slot, void *kva) {
+	struct zswap_entry *e;
+	bool ok UNUSED;
+
+	if (entries == NULL)
+		return false;
+
+	lock_acquire (&zswap_lock);
+	e = entries[slot];
+	if (e != NULL) {
+		ok = lz_decompress (entry_data (e), e->size, kva, PGSIZE);
+		ASSERT (ok);
+		list_remove (&e->lru_elem);
+		list_push_back (&lru, &e->lru_elem);
+		hit_cnt++;
+	} else
+		miss_cnt++;
+	lock_release (&zswap_lock);
+	return e != NULL;
+}
+
+/* Drops the contents of swap slot SLOT, which is being freed, from the
+ * cache. */
+void
+zswap_invalidate (size_t slot) {
+	if (entries == NULL)
+		return;
+
+	lock_acquire (&zswap_lock);
+	entry_free (slot);
+	lock_release (&zswap_lock);
+}